@@ -0,0 +1,123 @@
+/*
+cpp-example4.cc - librcnb example code
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+This is a short example of the C++20 coroutine interface. A handful of
+encode streams run interleaved on a single thread; every one of them suspends
+whenever it waits for more input, the way it would on a socket, and the loop
+at the end of main() resumes whichever is ready next.
+*/
+
+#include <rcnb/coroutine.h>
+
+#include <cstdio>
+#include <deque>
+#include <string>
+
+// Coroutines waiting to be resumed.
+static std::deque<std::coroutine_handle<>> ready;
+
+// Hands out a string a piece at a time, and suspends before each piece as if it had to wait for it.
+struct piecewise_source
+{
+    const std::string* text;
+    size_t offset;
+    size_t piece;
+
+    struct awaiter
+    {
+        piecewise_source* source;
+
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> waiting) { ready.push_back(waiting); }
+        std::span<const char> await_resume()
+        {
+            size_t length = std::min(source->piece, source->text->size() - source->offset);
+            std::span<const char> chunk(source->text->data() + source->offset, length);
+            source->offset += length;
+            return chunk;
+        }
+    };
+
+    awaiter operator()() { return awaiter{this}; }
+};
+
+// Hands out a whole string at once, without suspending.
+struct immediate_source
+{
+    const std::wstring* code;
+    bool done;
+
+    struct awaiter
+    {
+        std::span<const wchar_t> chunk;
+
+        bool await_ready() { return true; }
+        void await_suspend(std::coroutine_handle<>) {}
+        std::span<const wchar_t> await_resume() { return chunk; }
+    };
+
+    awaiter operator()()
+    {
+        std::span<const wchar_t> chunk;
+        if (!done)
+            chunk = std::span<const wchar_t>(code->data(), code->size());
+        done = true;
+        return awaiter{chunk};
+    }
+};
+
+// A coroutine that starts right away and cleans up after itself.
+struct task
+{
+    struct promise_type
+    {
+        task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+task encode(std::string text, std::wstring& code_out)
+{
+    auto code = rcnb::encode_stream(piecewise_source{&text, 0, 1000});
+    while (const std::span<const wchar_t>* chunk = co_await code.next())
+        code_out.append(chunk->begin(), chunk->end());
+}
+
+task decode(const std::wstring& code_in, std::string& plaintext_out)
+{
+    auto plaintext = rcnb::decode_stream(immediate_source{&code_in, false});
+    while (const std::span<const char>* chunk = co_await plaintext.next())
+        plaintext_out.append(chunk->begin(), chunk->end());
+}
+
+int main()
+{
+    const int streams = 8;
+    std::string texts[streams];
+    std::wstring codes[streams];
+    for (int i = 0; i < streams; ++i) {
+        for (int j = 0; j < 1000 * (i + 1) + i; ++j)
+            texts[i] += (char)(j * 7 + i);
+        encode(texts[i], codes[i]);
+    }
+
+    while (!ready.empty()) {
+        std::coroutine_handle<> next = ready.front();
+        ready.pop_front();
+        next.resume();
+    }
+
+    for (int i = 0; i < streams; ++i) {
+        std::string plaintext;
+        decode(codes[i], plaintext);
+        std::printf("stream %d: %zu bytes, %zu code units, %s\n", i, texts[i].size(), codes[i].size(),
+                    plaintext == texts[i] ? "round trip ok" : "round trip FAILED");
+    }
+    return 0;
+}
@@ -8,20 +8,74 @@ For details, see https://github.com/rikakomoe/librcnb
 #include <rcnb/decode.h>
 #include <rcnb/encode.h>
 
+extern "C" {
+#include <rcnb/cframe.h>
+#include <rcnb/cescape.h>
+}
+
+// after decode.h, which puts the alphabet it refers to in the rcnb namespace
+namespace rcnb {
+extern "C" {
+#include <rcnb/csearch.h>
+#include <rcnb/cbase64.h>
+}
+}
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <codecvt>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <locale>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <utime.h>
+#endif
 
 void usage()
 {
     std::cerr << \
 		"rcnb: Encodes and Decodes files using rcnb\n" \
-		"Usage: rcnb [-e|-d] [input] [output]\n" \
+		"Usage: rcnb [-e|-d] [options] [input] [output]\n" \
+		"       rcnb [-e|-d] -b [options] [source] [directory]\n" \
+		"       rcnb --calibrate [profile]\n" \
+		"       rcnb grep [-c] [-X] [pattern] [file...]\n" \
 		"   Where [-e] will encode the input file into the output file,\n" \
 		"         [-d] will decode the input file into the output file, and\n" \
-		"         [input] and [output] are the input and output files, respectively.\n";
+		"         [input] and [output] are the input and output files, respectively.\n" \
+		"   With -b, [source] is a directory, a manifest or - for a file list on stdin.\n" \
+		"   Each manifest line is an input file, optionally followed by a tab and its output file;\n" \
+		"   other outputs go to [directory], named after the input with .rcnb added or removed.\n" \
+		"   --calibrate times this machine and saves the best settings to [profile], by default\n" \
+		"   $RCNB_PROFILE or rcnb/profile in the configuration directory, for later runs to use.\n" \
+		"   grep prints the plaintext offsets at which [pattern] occurs in each file, found in the code\n" \
+		"   without decoding it. The files are UTF-8, or UTF-16 when they start with a byte order mark.\n" \
+		"Options:\n" \
+		"   -b        convert many files in one run, keeping their modification times\n" \
+		"   -f        read or write the chunked container format\n" \
+		"   -c SIZE   plaintext bytes per chunk when encoding with -f (default 1048576)\n" \
+		"   -j N      number of threads used with -b or when decoding with -f (default: calibrated, or all cores)\n" \
+		"   -n        with -d, also accept code whose letters Unicode normalization decomposed (NFD)\n" \
+		"   -m        migrate records, one per line: -e reads base64 and writes rcnb, -d reads rcnb and writes base64\n" \
+		"   -x FORM   write or read the code escaped for json, url or html instead of as UTF-8\n" \
+		"   -z        compress with zstd or zlib before encoding, decoding detects it by itself\n" \
+		"   -c        with grep, print the number of matches in each file instead\n" \
+		"   -X        with grep, the pattern is hex digits, as in 89504e47\n";
 }
 
 void usage(const std::string& message)
@@ -31,6 +85,697 @@ void usage(const std::string& message)
     std::cerr << message << std::endl;
 }
 
+std::wstring from_utf8(const std::string& bytes)
+{
+    std::wstring_convert<std::codecvt_utf8<wchar_t>> convert;
+    try
+    {
+        return convert.from_bytes(bytes);
+    }
+    catch (const std::range_error&)
+    {
+        // malformed UTF-8 never decodes, let the caller report it as corrupt
+        return std::wstring();
+    }
+}
+
+std::string read_range(std::ifstream& instream, unsigned long long offset, unsigned long long length)
+{
+    std::string bytes(length, '\0');
+    instream.seekg(offset);
+    instream.read(&bytes[0], length);
+    bytes.resize(instream.gcount());
+    return bytes;
+}
+
+void encode_framed(std::istream& instream, std::wostream& outstream, unsigned long chunk_size)
+{
+    rcnb_frameheader header;
+    rcnb_init_frameheader(&header, chunk_size);
+    std::vector<char> plaintext(header.chunk_size);
+    std::vector<wchar_t> code(std::max<size_t>(rcnb_frame_chunk_length(header.chunk_size), RCNB_FRAME_FOOTER_LENGTH) + 1);
+    std::vector<uint64_t> offsets;
+
+    size_t codelength = rcnb_frame_write_header(&header, code.data());
+    outstream.write(code.data(), codelength);
+    uint64_t offset = rcnb_utf8_length(code.data(), codelength);
+
+    while (instream.read(plaintext.data(), plaintext.size()), instream.gcount() > 0)
+    {
+        codelength = rcnb_frame_encode_chunk(plaintext.data(), instream.gcount(), code.data());
+        outstream.write(code.data(), codelength);
+        offsets.push_back(offset);
+        offset += rcnb_utf8_length(code.data(), codelength);
+    }
+
+    for (uint64_t chunk_offset : offsets)
+    {
+        codelength = rcnb_frame_write_index_entry(chunk_offset, code.data());
+        outstream.write(code.data(), codelength);
+    }
+    codelength = rcnb_frame_write_footer(offset, offsets.size(), code.data());
+    outstream.write(code.data(), codelength);
+}
+
+bool decode_framed(const std::string& input, const std::string& output, unsigned threads)
+{
+    std::ifstream instream(input.c_str(), std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+    unsigned long long file_size = instream.tellg();
+
+    // Each code unit takes one or two bytes, so the footer lies within the last 2 * FOOTER_LENGTH bytes.
+    unsigned long long tail = std::min<unsigned long long>(file_size, 2 * RCNB_FRAME_FOOTER_LENGTH);
+    std::string tail_bytes = read_range(instream, file_size - tail, tail);
+    size_t skip = 0;
+    while (skip < tail_bytes.size() && (tail_bytes[skip] & 0xC0) == 0x80)
+        ++skip;
+    std::wstring footer = from_utf8(tail_bytes.substr(skip));
+    uint64_t index_offset;
+    ptrdiff_t chunks = -1;
+    if (footer.size() >= RCNB_FRAME_FOOTER_LENGTH)
+        chunks = rcnb_frame_read_footer(footer.data() + footer.size() - RCNB_FRAME_FOOTER_LENGTH, &index_offset);
+    if (chunks < 0 || index_offset > file_size)
+    {
+        std::cerr << "rcnb: " << input << " is not a framed rcnb file" << std::endl;
+        return false;
+    }
+
+    rcnb_frameheader header;
+    std::wstring head = from_utf8(read_range(instream, 0, 2 * RCNB_FRAME_HEADER_LENGTH)).substr(0, RCNB_FRAME_HEADER_LENGTH);
+    std::wstring index = from_utf8(read_range(instream, index_offset, file_size - index_offset));
+    if (head.size() < RCNB_FRAME_HEADER_LENGTH || !rcnb_frame_read_header(head.data(), &header)
+        || index.size() != (size_t)chunks * RCNB_FRAME_INDEX_ENTRY_LENGTH + RCNB_FRAME_FOOTER_LENGTH)
+    {
+        std::cerr << "rcnb: " << input << " has a corrupt header or index" << std::endl;
+        return false;
+    }
+
+    std::vector<uint64_t> offsets(chunks + 1, index_offset);
+    for (ptrdiff_t i = 0; i < chunks; ++i)
+    {
+        if (!rcnb_frame_read_index_entry(index.data() + i * RCNB_FRAME_INDEX_ENTRY_LENGTH, &offsets[i])
+            || offsets[i] > index_offset || (i > 0 && offsets[i] < offsets[i - 1]))
+        {
+            std::cerr << "rcnb: " << input << " has a corrupt index" << std::endl;
+            return false;
+        }
+    }
+
+    std::ofstream(output.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    std::mutex report;
+    bool ok = true;
+    auto worker = [&](unsigned first)
+    {
+        std::ifstream chunkin(input.c_str(), std::ios_base::in | std::ios_base::binary);
+        std::fstream chunkout(output.c_str(), std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+        std::vector<char> plaintext(header.chunk_size + 1);
+        for (ptrdiff_t i = first; i < chunks; i += threads)
+        {
+            std::wstring code = from_utf8(read_range(chunkin, offsets[i], offsets[i + 1] - offsets[i]));
+            ptrdiff_t length = -1;
+            if (code.size() <= rcnb_frame_chunk_length(header.chunk_size))
+                length = rcnb_frame_decode_chunk(code.data(), code.size(), plaintext.data());
+            if (length < 0)
+            {
+                std::lock_guard<std::mutex> lock(report);
+                std::cerr << "rcnb: chunk " << i << " at byte " << offsets[i] << " is corrupt" << std::endl;
+                ok = false;
+                continue;
+            }
+            chunkout.seekp((unsigned long long)i * header.chunk_size);
+            chunkout.write(plaintext.data(), length);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& thread : pool)
+        thread.join();
+    return ok;
+}
+
+struct batch_job
+{
+    std::string input;
+    std::string output;
+};
+
+// Buffers a worker keeps across files, so small files cost no allocations once they have grown.
+struct batch_buffers
+{
+    std::string plaintext;
+    std::string bytes;
+    std::vector<wchar_t> code;
+};
+
+bool is_directory(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+bool make_directory(const std::string& path)
+{
+#ifdef _WIN32
+    return is_directory(path) || _mkdir(path.c_str()) == 0;
+#else
+    return is_directory(path) || mkdir(path.c_str(), 0777) == 0;
+#endif
+}
+
+std::string base_name(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+std::string batch_output(const std::string& input, const std::string& directory, bool encode)
+{
+    std::string name = base_name(input);
+    if (encode)
+        name += ".rcnb";
+    else if (name.size() > 5 && name.compare(name.size() - 5, 5, ".rcnb") == 0)
+        name.resize(name.size() - 5);
+    else
+        name += ".out";
+    return directory + "/" + name;
+}
+
+bool list_directory(const std::string& directory, std::vector<std::string>& files)
+{
+#ifdef _WIN32
+    _finddata_t entry;
+    intptr_t handle = _findfirst((directory + "/*").c_str(), &entry);
+    if (handle == -1)
+        return false;
+    do
+    {
+        if (!(entry.attrib & _A_SUBDIR))
+            files.push_back(directory + "/" + entry.name);
+    } while (_findnext(handle, &entry) == 0);
+    _findclose(handle);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (!dir)
+        return false;
+    while (struct dirent* entry = readdir(dir))
+    {
+        std::string path = directory + "/" + entry->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFMT) == S_IFREG)
+            files.push_back(path);
+    }
+    closedir(dir);
+#endif
+    std::sort(files.begin(), files.end());
+    return true;
+}
+
+bool list_batch(const std::string& source, const std::string& directory, bool encode, std::vector<batch_job>& jobs)
+{
+    if (is_directory(source))
+    {
+        std::vector<std::string> files;
+        if (!list_directory(source, files))
+            return false;
+        for (const std::string& file : files)
+            jobs.push_back({file, batch_output(file, directory, encode)});
+        return true;
+    }
+
+    std::ifstream manifest;
+    if (source != "-")
+    {
+        manifest.open(source.c_str());
+        if (!manifest.is_open())
+            return false;
+    }
+    std::istream& lines = source == "-" ? std::cin : manifest;
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos)
+            jobs.push_back({line, batch_output(line, directory, encode)});
+        else
+            jobs.push_back({line.substr(0, tab), line.substr(tab + 1)});
+    }
+    return true;
+}
+
+bool read_file(const std::string& path, std::string& bytes, struct stat& st)
+{
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    bool ok = fstat(fileno(file), &st) == 0;
+    if (ok)
+    {
+        bytes.resize(st.st_size);
+        ok = std::fread(&bytes[0], 1, bytes.size(), file) == bytes.size();
+    }
+    std::fclose(file);
+    return ok;
+}
+
+bool write_file(const std::string& path, const char* data, size_t length, const struct stat& st)
+{
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = std::fwrite(data, 1, length, file) == length;
+    ok = std::fclose(file) == 0 && ok;
+    struct utimbuf times;
+    times.actime = st.st_atime;
+    times.modtime = st.st_mtime;
+    return ok && utime(path.c_str(), &times) == 0;
+}
+
+void encode_utf8(const wchar_t* code, size_t length, std::string& bytes)
+{
+    bytes.clear();
+    for (size_t i = 0; i < length; ++i)
+    {
+        unsigned long c = code[i];
+        if (c < 0x80)
+            bytes += (char)c;
+        else if (c < 0x800)
+        {
+            bytes += (char)(0xC0 | c >> 6);
+            bytes += (char)(0x80 | (c & 0x3F));
+        }
+        else
+        {
+            bytes += (char)(0xE0 | c >> 12);
+            bytes += (char)(0x80 | (c >> 6 & 0x3F));
+            bytes += (char)(0x80 | (c & 0x3F));
+        }
+    }
+}
+
+// Returns false on malformed UTF-8 or code points outside the BMP, neither of which is rcnb.
+bool decode_utf8(const std::string& bytes, std::vector<wchar_t>& code)
+{
+    code.clear();
+    for (size_t i = 0; i < bytes.size();)
+    {
+        unsigned char c = bytes[i];
+        size_t extra = c < 0x80 ? 0 : (c & 0xE0) == 0xC0 ? 1 : (c & 0xF0) == 0xE0 ? 2 : 3;
+        if (extra > 2 || bytes.size() - i <= extra)
+            return false;
+        unsigned long point = extra == 0 ? c : c & (0x3F >> extra);
+        for (size_t k = 1; k <= extra; ++k)
+        {
+            unsigned char next = bytes[i + k];
+            if ((next & 0xC0) != 0x80)
+                return false;
+            point = point << 6 | (next & 0x3F);
+        }
+        code.push_back((wchar_t)point);
+        i += extra + 1;
+    }
+    return true;
+}
+
+bool encode_file(const batch_job& job, batch_buffers& buffers, int compression, std::string& error)
+{
+    struct stat st;
+    if (!read_file(job.input, buffers.plaintext, st))
+    {
+        error = "could not read the input file";
+        return false;
+    }
+    if (compression != RCNB_COMPRESS_NONE)
+    {
+        std::istringstream instream(buffers.plaintext);
+        std::wostringstream outstream;
+        rcnb::encoder E(65536, compression);
+        E.encode(instream, outstream);
+        if (outstream.bad())
+        {
+            error = "compression failed";
+            return false;
+        }
+        std::wstring code = outstream.str();
+        encode_utf8(code.data(), code.size(), buffers.bytes);
+    }
+    else
+    {
+        buffers.code.resize(2 * buffers.plaintext.size() + 1);
+        size_t length = rcnb::rcnb_encode(buffers.plaintext.data(), buffers.plaintext.size(), buffers.code.data());
+        encode_utf8(buffers.code.data(), length, buffers.bytes);
+    }
+    if (!write_file(job.output, buffers.bytes.data(), buffers.bytes.size(), st))
+    {
+        error = "could not write " + job.output;
+        return false;
+    }
+    return true;
+}
+
+bool decode_file(const batch_job& job, batch_buffers& buffers, std::string& error)
+{
+    struct stat st;
+    if (!read_file(job.input, buffers.bytes, st))
+    {
+        error = "could not read the input file";
+        return false;
+    }
+    if (!decode_utf8(buffers.bytes, buffers.code))
+    {
+        error = "is not valid UTF-8";
+        return false;
+    }
+    ptrdiff_t length;
+    if (buffers.code.size() >= RCNB_COMPRESS_MARKER_LENGTH
+        && std::equal(RCNB_COMPRESS_MARKER, RCNB_COMPRESS_MARKER + RCNB_COMPRESS_MARKER_LENGTH, buffers.code.begin()))
+    {
+        std::wistringstream instream(std::wstring(buffers.code.begin(), buffers.code.end()));
+        std::ostringstream outstream;
+        rcnb::decoder D;
+        D.decode(instream, outstream);
+        buffers.plaintext = outstream.str();
+        length = outstream.bad() ? -1 : (ptrdiff_t)buffers.plaintext.size();
+    }
+    else
+    {
+        buffers.plaintext.resize(buffers.code.size() / 2 + 1);
+        length = rcnb::rcnb_decode(buffers.code.data(), buffers.code.size(), &buffers.plaintext[0]);
+    }
+    if (length < 0)
+    {
+        error = "is not valid rcnb or its compressed payload is corrupt";
+        return false;
+    }
+    if (!write_file(job.output, buffers.plaintext.data(), length, st))
+    {
+        error = "could not write " + job.output;
+        return false;
+    }
+    return true;
+}
+
+// Converts every job on a pool of workers; a failing file is reported and skipped, never fatal.
+bool run_batch(const std::vector<batch_job>& jobs, bool encode, int compression, unsigned threads)
+{
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> failed(0);
+    std::mutex report;
+    auto worker = [&]()
+    {
+        batch_buffers buffers;
+        std::string error;
+        for (size_t i = next++; i < jobs.size(); i = next++)
+        {
+            bool ok = encode ? encode_file(jobs[i], buffers, compression, error)
+                             : decode_file(jobs[i], buffers, error);
+            if (!ok)
+            {
+                failed++;
+                std::lock_guard<std::mutex> lock(report);
+                std::cerr << "rcnb: " << jobs[i].input << ": " << error << std::endl;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    threads = std::min<size_t>(threads, std::max<size_t>(jobs.size(), 1));
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& thread : pool)
+        thread.join();
+    if (failed > 0)
+        std::cerr << "rcnb: " << failed << " of " << jobs.size() << " files failed" << std::endl;
+    return failed == 0;
+}
+
+bool convert_escaped(const std::string& input, const std::string& output, bool encode, int format)
+{
+    std::string bytes;
+    struct stat st;
+    if (!read_file(input, bytes, st))
+    {
+        std::cerr << "rcnb: " << input << ": could not read" << std::endl;
+        return false;
+    }
+    std::vector<char> converted(encode ? rcnb_escape_bound(bytes.size(), format) : bytes.size() / 2 + 1);
+    ptrdiff_t length = encode ? (ptrdiff_t)rcnb_encode_escaped(bytes.data(), bytes.size(), converted.data(), format)
+                              : rcnb_decode_escaped(bytes.data(), bytes.size(), converted.data(), format);
+    if (length < 0)
+    {
+        std::cerr << "rcnb: " << input << " is not valid escaped rcnb" << std::endl;
+        return false;
+    }
+    std::ofstream outstream(output.c_str(), std::ios_base::out | std::ios_base::binary);
+    outstream.write(converted.data(), length);
+    outstream.close();
+    if (!outstream)
+    {
+        std::cerr << "rcnb: " << output << ": could not write" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Converts each line of the input between base64 and rcnb code, with no binary in between. A record that does not
+// convert is reported and left empty, so the lines still match up, and the rest carry on.
+bool migrate(const std::string& input, const std::string& output, bool encode)
+{
+    std::ifstream instream(input.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (!instream.is_open())
+    {
+        std::cerr << "rcnb: " << input << ": could not read" << std::endl;
+        return false;
+    }
+    std::ofstream outstream(output.c_str(), std::ios_base::out | std::ios_base::binary);
+    if (!outstream.is_open())
+    {
+        std::cerr << "rcnb: " << output << ": could not write" << std::endl;
+        return false;
+    }
+
+    std::string line;
+    std::vector<wchar_t> code;
+    std::string converted;
+    unsigned long long number = 0;
+    unsigned long long failed = 0;
+    while (std::getline(instream, line))
+    {
+        ++number;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        ptrdiff_t length;
+        if (encode)
+        {
+            code.resize(rcnb::rcnb_base64_code_bound(line.size()));
+            length = rcnb::rcnb_from_base64(line.data(), line.size(), code.data());
+            if (length >= 0)
+                encode_utf8(code.data(), length, converted);
+        }
+        else
+        {
+            length = decode_utf8(line, code) ? 0 : -1;
+            if (length >= 0)
+            {
+                converted.resize(rcnb::rcnb_base64_bound(code.size()));
+                length = rcnb::rcnb_to_base64(code.data(), code.size(), &converted[0]);
+                converted.resize(length >= 0 ? length : 0);
+            }
+        }
+        if (length < 0)
+        {
+            if (failed++ < 10)
+                std::cerr << "rcnb: " << input << ":" << number << " is not valid " << (encode ? "base64" : "rcnb")
+                          << std::endl;
+            converted.clear();
+        }
+        converted += '\n';
+        outstream.write(converted.data(), converted.size());
+    }
+    outstream.close();
+    if (!outstream || instream.bad())
+    {
+        std::cerr << "rcnb: " << output << ": could not write" << std::endl;
+        return false;
+    }
+    if (failed > 10)
+        std::cerr << "rcnb: " << failed << " of " << number << " records were not valid" << std::endl;
+    return failed == 0;
+}
+
+bool calibrate(std::string path)
+{
+    char default_path[4096];
+    if (path.empty())
+    {
+        if (!rcnb::rcnb_profile_path(default_path, sizeof(default_path)))
+        {
+            std::cerr << "rcnb: no configuration directory, name the profile to write" << std::endl;
+            return false;
+        }
+        path = default_path;
+        // create rcnb/ and, if need be, the configuration directory above it
+        size_t slash = path.find_last_of("/\\");
+        size_t parent = slash == std::string::npos || slash == 0 ? std::string::npos : path.find_last_of("/\\", slash - 1);
+        if (parent != std::string::npos && parent > 0)
+            make_directory(path.substr(0, parent));
+        if (slash != std::string::npos && slash > 0)
+            make_directory(path.substr(0, slash));
+    }
+
+    std::cerr << "rcnb: calibrating, this takes a few seconds..." << std::endl;
+    rcnb::rcnb_profile profile;
+    if (!rcnb::rcnb_autotune(&profile))
+    {
+        std::cerr << "rcnb: not enough memory to calibrate" << std::endl;
+        return false;
+    }
+    if (!rcnb::rcnb_save_profile(&profile, path.c_str()))
+    {
+        std::cerr << "rcnb: " << path << ": could not write" << std::endl;
+        return false;
+    }
+    std::cout << "kernel " << profile.kernel << "\n"
+              << "chunk_size " << profile.chunk_size << "\n"
+              << "stream_threshold " << profile.stream_threshold << "\n"
+              << "threads " << profile.threads << "\n"
+              << "saved to " << path << std::endl;
+    return true;
+}
+
+bool parse_hex(const std::string& digits, std::string& bytes)
+{
+    if (digits.size() % 2 != 0)
+        return false;
+    bytes.clear();
+    for (size_t i = 0; i < digits.size(); i += 2)
+    {
+        char pair[3] = { digits[i], digits[i + 1], 0 };
+        char* end;
+        unsigned long value = std::strtoul(pair, &end, 16);
+        if (end != pair + 2 || !std::isxdigit((unsigned char)pair[0]))
+            return false;
+        bytes += (char)value;
+    }
+    return true;
+}
+
+// Prints the offsets of the matches in one file, or their number; returns how many there were, -1 if the file
+// could not be read.
+long long grep_file(const rcnb::rcnb_searcher& searcher, const std::string& path, bool count_only, bool named)
+{
+    std::string bytes;
+    struct stat st;
+    if (!read_file(path, bytes, st))
+    {
+        std::cerr << "rcnb: " << path << ": could not read" << std::endl;
+        return -1;
+    }
+
+    std::vector<unsigned short> units;
+    size_t skip = 0;
+    unsigned short mark = 0;
+    if (bytes.size() >= 2)
+        std::memcpy(&mark, bytes.data(), 2);
+    bool utf16 = mark == 0xFEFF || mark == 0xFFFE;
+    if (utf16)
+    {
+        units.resize(bytes.size() / 2 - 1);
+        std::memcpy(units.data(), bytes.data() + 2, 2 * units.size());
+        if (mark == 0xFFFE)
+            for (unsigned short& unit : units)
+                unit = (unsigned short)(unit << 8 | unit >> 8);
+        while (!units.empty() && (units.back() == '\n' || units.back() == '\r'))
+            units.pop_back();
+    }
+    else
+    {
+        if (bytes.compare(0, 3, "\xEF\xBB\xBF") == 0)
+            skip = 3;
+        while (bytes.size() > skip && (bytes.back() == '\n' || bytes.back() == '\r'))
+            bytes.pop_back();
+    }
+
+    std::vector<size_t> offsets(1024);
+    long long matches = 0;
+    size_t start = 0;
+    while (true)
+    {
+        size_t found = utf16 ? rcnb::rcnb_search_utf16(&searcher, units.data(), units.size(), start, offsets.data(),
+                                                       offsets.size())
+                             : rcnb::rcnb_search_utf8(&searcher, bytes.data() + skip, bytes.size() - skip, start,
+                                                     offsets.data(), offsets.size());
+        matches += found;
+        if (!count_only)
+            for (size_t i = 0; i < found; ++i)
+                std::cout << (named ? path + ":" : "") << offsets[i] << "\n";
+        if (found < offsets.size())
+            break;
+        start = offsets.back() + 1;
+    }
+    if (count_only)
+        std::cout << (named ? path + ":" : "") << matches << "\n";
+    return matches;
+}
+
+int grep(int argc, char** argv)
+{
+    bool count_only = false;
+    bool hex = false;
+    int arg = 2;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != 0; ++arg)
+    {
+        std::string option = argv[arg];
+        if (option == "-c")
+            count_only = true;
+        else if (option == "-X")
+            hex = true;
+        else
+        {
+            usage("Unknown option " + option + "!");
+            return -1;
+        }
+    }
+    if (argc - arg < 2)
+    {
+        usage("grep needs a pattern and at least one file!");
+        return -1;
+    }
+
+    std::string pattern = argv[arg++];
+    if (hex && !parse_hex(argv[arg - 1], pattern))
+    {
+        usage("The pattern is not an even number of hex digits!");
+        return -1;
+    }
+    rcnb::rcnb_searcher searcher;
+    if (pattern.empty() || !rcnb::rcnb_init_searcher(&searcher, pattern.data(), pattern.size(), nullptr))
+    {
+        usage("The pattern must not be empty!");
+        return -1;
+    }
+
+    // like grep, 0 if anything matched, 1 if nothing did
+    bool found = false;
+    bool failed = false;
+    bool named = argc - arg > 1;
+    for (; arg < argc; ++arg)
+    {
+        long long matches = grep_file(searcher, argv[arg], count_only, named);
+        failed = failed || matches < 0;
+        found = found || matches > 0;
+    }
+    std::cout.flush();
+    rcnb::rcnb_free_searcher(&searcher);
+    return failed ? -1 : found ? 0 : 1;
+}
+
 int main(int argc, char** argv)
 {
     if (argc == 1)
@@ -38,18 +783,139 @@ int main(int argc, char** argv)
         usage();
         exit(-1);
     }
-    if (argc != 4)
+    if (std::string(argv[1]) == "--calibrate" && argc <= 3)
+        return calibrate(argc == 3 ? argv[2] : "") ? 0 : -1;
+    if (std::string(argv[1]) == "grep")
+        return grep(argc, argv);
+    if (argc < 4)
     {
         usage("Wrong number of arguments!");
         exit(-1);
     }
 
-    std::string input = argv[2];
-    std::string output = argv[3];
+    bool framed = false;
+    bool compress = false;
+    bool batch = false;
+    bool records = false;
+    bool compose = false;
+    int escape = 0;
+    unsigned long chunk_size = 1 << 20;
+    unsigned threads = rcnb::rcnb_get_profile()->threads;
+    int arg = 2;
+    for (; arg < argc - 2; ++arg)
+    {
+        std::string option = argv[arg];
+        if (option == "-f")
+            framed = true;
+        else if (option == "-b")
+            batch = true;
+        else if (option == "-z")
+            compress = true;
+        else if (option == "-m")
+            records = true;
+        else if (option == "-n")
+            compose = true;
+        else if (option == "-c" && arg + 1 < argc - 2)
+            chunk_size = std::strtoul(argv[++arg], nullptr, 10);
+        else if (option == "-j" && arg + 1 < argc - 2)
+            threads = std::strtoul(argv[++arg], nullptr, 10);
+        else if (option == "-x" && arg + 1 < argc - 2)
+        {
+            std::string form = argv[++arg];
+            escape = form == "json" ? RCNB_ESCAPE_JSON : form == "url" ? RCNB_ESCAPE_URL
+                   : form == "html" ? RCNB_ESCAPE_HTML : -1;
+            if (escape < 0)
+            {
+                usage("Unknown escape form " + form + "!");
+                exit(-1);
+            }
+        }
+        else
+        {
+            usage("Unknown option " + option + "!");
+            exit(-1);
+        }
+    }
+    int compression = compress ? rcnb::rcnb_compress_default_method() : RCNB_COMPRESS_NONE;
+    if (compress && compression == RCNB_COMPRESS_NONE)
+    {
+        usage("rcnb was built without zlib or zstd!");
+        exit(-1);
+    }
+    if (compress && framed)
+    {
+        usage("Compression is not supported in the chunked container format!");
+        exit(-1);
+    }
+    if (batch && framed)
+    {
+        usage("The chunked container format is not supported in batch mode!");
+        exit(-1);
+    }
+    if (escape != 0 && (framed || batch || compress))
+    {
+        usage("Escaped code cannot be combined with -b, -f or -z!");
+        exit(-1);
+    }
+    if (records && (framed || batch || compress || escape != 0))
+    {
+        usage("Migrating records cannot be combined with -b, -f, -x or -z!");
+        exit(-1);
+    }
+    if (compose && (std::string(argv[1]) != "-d" || framed || batch || records || escape != 0))
+    {
+        usage("Decomposed code is only accepted by -d without -b, -f, -m or -x!");
+        exit(-1);
+    }
+    if (chunk_size == 0 || chunk_size > 0x7FFFFFFE || threads == 0)
+    {
+        usage("Chunk size and thread count must be positive and below 2 GiB!");
+        exit(-1);
+    }
+
+    std::string input = argv[arg];
+    std::string output = argv[arg + 1];
 
     // determine whether we need to encode or decode:
     std::string choice = argv[1];
-    if (choice == "-d")
+    if ((choice == "-e" || choice == "-d") && batch)
+    {
+        std::vector<batch_job> jobs;
+        if (!list_batch(input, output, choice == "-e", jobs))
+        {
+            usage("Could not read the batch source!");
+            exit(-1);
+        }
+        if (!make_directory(output))
+        {
+            usage("Could not create the output directory!");
+            exit(-1);
+        }
+        if (!run_batch(jobs, choice == "-e", compression, threads))
+            exit(-1);
+    }
+    else if ((choice == "-e" || choice == "-d") && records)
+    {
+        if (!migrate(input, output, choice == "-e"))
+            exit(-1);
+    }
+    else if ((choice == "-e" || choice == "-d") && escape != 0)
+    {
+        if (!convert_escaped(input, output, choice == "-e", escape))
+            exit(-1);
+    }
+    else if (choice == "-d" && framed)
+    {
+        std::ifstream instream(input.c_str(), std::ios_base::in | std::ios_base::binary);
+        if (!instream.is_open())
+        {
+            usage("Could not open input file!");
+            exit(-1);
+        }
+        if (!decode_framed(input, output, threads))
+            exit(-1);
+    }
+    else if (choice == "-d")
     {
         std::wifstream instream(input.c_str(), std::ios_base::in | std::ios_base::binary);
         if (!instream.is_open())
@@ -67,7 +933,13 @@ int main(int argc, char** argv)
             exit(-1);
         }
         rcnb::decoder D;
+        D.set_compose(compose);
         D.decode(instream, outstream);
+        if (outstream.bad())
+        {
+            std::cerr << "rcnb: " << input << " is not valid rcnb or its compressed payload is corrupt" << std::endl;
+            exit(-1);
+        }
     }
     else if (choice == "-e")
     {
@@ -86,8 +958,21 @@ int main(int argc, char** argv)
         }
         std::locale utf8_locale(std::locale(), new std::codecvt_utf8<wchar_t>);
         outstream.imbue(utf8_locale);
-        rcnb::encoder E;
-        E.encode(instream, outstream);
+        if (framed)
+        {
+            encode_framed(instream, outstream, chunk_size);
+        }
+        else
+        {
+            // larger blocks keep the per-block flush of the compressor cheap
+            rcnb::encoder E(compression != RCNB_COMPRESS_NONE ? 65536 : 0, compression);
+            E.encode(instream, outstream);
+            if (outstream.bad())
+            {
+                std::cerr << "rcnb: compression failed" << std::endl;
+                exit(-1);
+            }
+        }
     }
     else
     {
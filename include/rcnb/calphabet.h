@@ -0,0 +1,54 @@
+/*
+calphabet.h - c header for custom rcnb alphabets
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+An alphabet replaces the four sets of code points that make up a group. The
+sets keep the sizes of the built-in ones (15, 15, 15 and 10), all 55 code
+points must be distinct and lie in U+0001..U+7FFF. rcnb_init_alphabet derives
+the lookup tables of the SIMD kernels from them, so a custom alphabet encodes
+on the same vector paths as the built-in one. It decodes on them too as long as
+each set has a perfect multiplicative hash into 16 slots, which is searched for
+at init time; widely spread sets usually have one, tightly packed ones may not.
+*/
+
+#ifndef RCNB_CALPHABET_H
+#define RCNB_CALPHABET_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef RCNB_API
+#define RCNB_API
+#endif
+
+#define RCNB_ALPHABET_R 15
+#define RCNB_ALPHABET_C 15
+#define RCNB_ALPHABET_N 15
+#define RCNB_ALPHABET_B 10
+
+typedef struct
+{
+    wchar_t r[RCNB_ALPHABET_R];
+    wchar_t c[RCNB_ALPHABET_C];
+    wchar_t n[RCNB_ALPHABET_N];
+    wchar_t b[RCNB_ALPHABET_B];
+
+    /* derived by rcnb_init_alphabet, indexed r, c, n, b */
+    bool simd;                  /* false if no perfect hash was found, decoding then runs scalar */
+    unsigned char lo[4][16];    /* low and high byte of each code point */
+    unsigned char hi[4][16];
+    unsigned short mul[4];      /* a code unit u hashes to (u * mul + add) mod 2^16 >> 12 */
+    unsigned short add[4];
+    unsigned char index[4][16]; /* code point index in each hash slot, 0xFF when the slot is empty */
+    unsigned char check_lo[16]; /* the r code point in each hash slot, telling r from n */
+    unsigned char check_hi[16];
+} rcnb_alphabet;
+
+/* returns false if the sets are not valid, the alphabet is left unusable then */
+RCNB_API bool rcnb_init_alphabet(rcnb_alphabet* alphabet_out, const wchar_t* r, const wchar_t* c,
+        const wchar_t* n, const wchar_t* b);
+RCNB_API const rcnb_alphabet* rcnb_default_alphabet(void);
+
+#endif /* RCNB_CALPHABET_H */
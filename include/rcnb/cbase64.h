@@ -0,0 +1,45 @@
+/*
+cbase64.h - c header for transcoding between base64 and rcnb
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+The transcoders convert a payload from base64 to rcnb code and back without
+the whole of it ever being binary in memory. Each side is decoded a window of
+RCNB_BASE64_WINDOW bytes at a time into a buffer on the stack, which stays in
+L1, and the window is encoded again before the next one is read, by the same
+vector kernels rcnb_encode_block() and rcnb_decode_block() use.
+
+Base64 is read in either the standard or the URL and filename safe alphabet,
+with or without its padding, and is written in the standard alphabet with
+padding. A long payload can be converted piece by piece: every 8 base64 digits
+are 6 bytes, which are 12 code units, so pieces cut at multiples of 8 digits
+or of 12 units come out the same as the whole, the last piece included.
+*/
+
+#ifndef RCNB_CBASE64_H
+#define RCNB_CBASE64_H
+
+#include <stddef.h>
+
+#include <rcnb/calphabet.h>
+
+/* plaintext bytes staged at a time, whole base64 quanta and whole batches of the kernels */
+#define RCNB_BASE64_WINDOW 384
+
+/* enough room for the code of length_in base64 digits and the terminating NUL */
+size_t rcnb_base64_code_bound(size_t length_in);
+/* enough room for the base64 of length_in code units and the terminating NUL */
+size_t rcnb_base64_bound(size_t length_in);
+
+/* writes the code of the payload in base64_in and returns its length; -1 if base64_in is not base64 */
+ptrdiff_t rcnb_from_base64(const char* base64_in, size_t length_in, wchar_t* code_out);
+ptrdiff_t rcnb_from_base64_alphabet(const char* base64_in, size_t length_in, wchar_t* code_out,
+        const rcnb_alphabet* alphabet);
+
+/* writes the base64 of the payload in code_in and returns its length; -1 if code_in is not rcnb */
+ptrdiff_t rcnb_to_base64(const wchar_t* code_in, size_t length_in, char* base64_out);
+ptrdiff_t rcnb_to_base64_alphabet(const wchar_t* code_in, size_t length_in, char* base64_out,
+        const rcnb_alphabet* alphabet);
+
+#endif /* RCNB_CBASE64_H */
@@ -0,0 +1,48 @@
+/*
+cchecksum.h - c header for the checksums used alongside rcnb encoding
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#ifndef RCNB_CCHECKSUM_H
+#define RCNB_CCHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef RCNB_API
+#define RCNB_API
+#endif
+
+#define RCNB_CHECKSUM_NONE 0
+#define RCNB_CHECKSUM_CRC32C 1
+#define RCNB_CHECKSUM_XXH64 2
+
+/* Plaintext bytes checksummed at a time by the encode and decode blocks, small
+   enough that the kernel still finds them in L1. */
+#ifndef RCNB_CHECKSUM_SLICE
+#define RCNB_CHECKSUM_SLICE 16384
+#endif
+
+/* a running checksum over the plaintext, kept by the encode and decode states */
+typedef struct
+{
+    int method;
+    uint32_t crc;
+    uint64_t acc[4];            /* XXH64 lanes, fed 32 bytes at a time */
+    uint64_t total;
+    unsigned char buffer[32];   /* XXH64 bytes not yet making up a stripe */
+    size_t buffered;
+} rcnb_checksumstate;
+
+/* uses SSE4.2 or the ARMv8 CRC32 instructions when the compiler targets them */
+RCNB_API uint32_t rcnb_crc32c(uint32_t crc, const char* data, size_t length);
+RCNB_API uint64_t rcnb_xxh64(uint64_t seed, const char* data, size_t length);
+
+RCNB_API void rcnb_init_checksumstate(rcnb_checksumstate* state_in, int method);
+RCNB_API void rcnb_checksum_update(rcnb_checksumstate* state_in, const char* data, size_t length);
+/* the CRC-32C or XXH64 (seed 0) of everything passed so far, 0 for RCNB_CHECKSUM_NONE */
+RCNB_API uint64_t rcnb_checksum_final(const rcnb_checksumstate* state_in);
+
+#endif /* RCNB_CCHECKSUM_H */
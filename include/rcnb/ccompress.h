@@ -0,0 +1,49 @@
+/*
+ccompress.h - c header for the optional compression stage in front of rcnb
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#ifndef RCNB_CCOMPRESS_H
+#define RCNB_CCOMPRESS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define RCNB_COMPRESS_NONE 0
+#define RCNB_COMPRESS_ZLIB 1
+#define RCNB_COMPRESS_ZSTD 2
+
+/* A compressed rcnb stream starts with this group, which no plain stream can contain
+   since it stands for a value above 0x7FFF, followed by the encoded method byte. */
+#define RCNB_COMPRESS_MARKER L"ɍȼȵþ"
+#define RCNB_COMPRESS_MARKER_LENGTH 4
+
+typedef struct
+{
+    int method;
+    bool decompress;
+    /* whether the decompressed stream has ended, a zlib stream or a whole zstd frame */
+    bool finished;
+    void* stream;
+} rcnb_compressstate;
+
+bool rcnb_compress_supported(int method);
+int rcnb_compress_default_method(void);
+size_t rcnb_compress_bound(size_t length_in);
+
+/* level -1 picks the default level of the method */
+bool rcnb_init_compressstate(rcnb_compressstate* state_in, int method, int level);
+ptrdiff_t rcnb_compress_block(const char* plaintext_in, size_t length_in, char* compressed_out, rcnb_compressstate* state_in);
+ptrdiff_t rcnb_compress_blockend(char* compressed_out, rcnb_compressstate* state_in);
+
+bool rcnb_init_decompressstate(rcnb_compressstate* state_in, int method);
+ptrdiff_t rcnb_decompress_block(const char** compressed_in, size_t* length_in, char* plaintext_out, size_t length_out,
+        rcnb_compressstate* state_in);
+/* frees the state; false if the input ended before the compressed stream did */
+bool rcnb_decompress_blockend(rcnb_compressstate* state_in);
+
+void rcnb_free_compressstate(rcnb_compressstate* state_in);
+
+#endif /* RCNB_CCOMPRESS_H */
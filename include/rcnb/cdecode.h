@@ -10,18 +10,71 @@ For details, see https://github.com/rikakomoe/librcnb
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <rcnb/calphabet.h>
+#include <rcnb/cchecksum.h>
+
+/* plaintext whose code a coalescing state gathers before decoding it, four batches of the SIMD kernels */
+#define RCNB_DECODE_COALESCE_BYTES 128
+
+#ifndef RCNB_API
+#define RCNB_API
+#endif
 
 typedef struct
 {
     size_t i;
     wchar_t trailing_code[4];
+    bool coalesce;
+    size_t pending_length;
+    wchar_t pending[2 * RCNB_DECODE_COALESCE_BYTES];
+    bool compose;
+    bool holding;
+    wchar_t held;
+    const rcnb_alphabet* alphabet;
+    rcnb_checksumstate checksum;
 } rcnb_decodestate;
 
-void rcnb_init_decodestate(rcnb_decodestate* state_in);
-ptrdiff_t rcnb_decode_block(const wchar_t* code_in, size_t length_in, char* plaintext_out, rcnb_decodestate* state_in);
-ptrdiff_t rcnb_decode_blockend(char* plaintext_out, rcnb_decodestate* state_in);
-ptrdiff_t rcnb_decode(const wchar_t* code_in, size_t length_in, char* plaintext_out);
+RCNB_API void rcnb_init_decodestate(rcnb_decodestate* state_in);
+/* like rcnb_init_decodestate, but decodes with the given alphabet, NULL meaning the built-in one */
+RCNB_API void rcnb_init_decodestate_alphabet(rcnb_decodestate* state_in, const rcnb_alphabet* alphabet);
+RCNB_API ptrdiff_t rcnb_decode_block(const wchar_t* code_in, size_t length_in, char* plaintext_out, rcnb_decodestate* state_in);
+RCNB_API ptrdiff_t rcnb_decode_blockend(char* plaintext_out, rcnb_decodestate* state_in);
+/* makes the following blocks keep a running RCNB_CHECKSUM_* of their plaintext, call it right after init */
+RCNB_API void rcnb_decode_set_checksum(rcnb_decodestate* state_in, int method);
+/* makes the following blocks hold back code until 2 * RCNB_DECODE_COALESCE_BYTES units of it can be decoded
+   together, so small or ragged blocks still reach the SIMD kernels; plaintext_out then needs room for
+   length_in / 2 + RCNB_DECODE_COALESCE_BYTES + 1 bytes, and rcnb_decode_blockend decodes what is left */
+RCNB_API void rcnb_decode_set_coalesce(rcnb_decodestate* state_in, bool coalesce);
+/* makes the following blocks accept code that Unicode normalization decomposed, letters such as U+0154 written
+   as R and U+0301, and compose them again; the last unit of each block is held back in case a mark for it starts
+   the next one, and rcnb_decode_blockend then writes up to two bytes before its NUL */
+RCNB_API void rcnb_decode_set_compose(rcnb_decodestate* state_in, bool compose);
+/* like rcnb_decode_blockend, also storing the checksum of the whole plaintext in checksum_out */
+RCNB_API ptrdiff_t rcnb_decode_blockend_checksum(char* plaintext_out, rcnb_decodestate* state_in,
+        uint64_t* checksum_out);
+RCNB_API ptrdiff_t rcnb_decode(const wchar_t* code_in, size_t length_in, char* plaintext_out);
+RCNB_API ptrdiff_t rcnb_decode_alphabet(const wchar_t* code_in, size_t length_in, char* plaintext_out,
+        const rcnb_alphabet* alphabet);
+/* decodes bytes [offset, offset + length) of the payload encoded in code_in[0, length_in) */
+RCNB_API ptrdiff_t rcnb_decode_range(const wchar_t* code_in, size_t length_in, size_t offset, size_t length,
+        char* plaintext_out);
+RCNB_API ptrdiff_t rcnb_decode_range_alphabet(const wchar_t* code_in, size_t length_in, size_t offset, size_t length,
+        char* plaintext_out, const rcnb_alphabet* alphabet);
 
-int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n);
+/* the header-only build declares the SIMD kernels only when it compiles them */
+#if !defined(RCNB_SINGLE_H) || defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+RCNB_API int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet);
+RCNB_API int rcnb_decode_tail_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet);
+/* for 16n units, sets bit i of mask_out[2k] when unit 16k + i is an r or an n, and of mask_out[2k + 1]
+   when it is a c or a b; needs alphabet->simd */
+RCNB_API void rcnb_classify_16n_asm(const char *value_in, unsigned short *mask_out, size_t n,
+        const rcnb_alphabet *alphabet);
+/* for 16n bytes, sets bit i of mask_out[k] when byte 16k + i is first and byte 16k + i + distance is last;
+   reads distance bytes past the 16n */
+RCNB_API void rcnb_match_16n_asm(const char *value_in, unsigned short *mask_out, size_t n, unsigned char first,
+        unsigned char last, size_t distance);
+/* returns the first of n batches of 16 units that holds a combining mark, U+0300 to U+036F, or n if none does */
+RCNB_API size_t rcnb_find_mark_16n_asm(const char *value_in, size_t n);
+#endif
 
 #endif //RCNB_CDECODE_H
@@ -10,18 +10,72 @@ For details, see https://github.com/rikakomoe/librcnb
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <rcnb/calphabet.h>
+#include <rcnb/cchecksum.h>
+
+#ifndef RCNB_API
+/* rcnb_single.h, the header-only build, makes every entry point static inline */
+#define RCNB_API
+#endif
+
+/* plaintext length from which rcnb_encode_block bypasses the cache with streaming stores, by default */
+#ifndef RCNB_STREAM_THRESHOLD
+#define RCNB_STREAM_THRESHOLD (1 << 22)
+#endif
+/* the lowest stream threshold, below which the alignment lead and the fence cost more than the stores save */
+#define RCNB_STREAM_THRESHOLD_MIN (1 << 16)
+/* alignment of the buffers returned by rcnb_alloc_code */
+#define RCNB_ALIGNMENT 64
+/* plaintext a coalescing state gathers before encoding it, four batches of the SIMD kernels */
+#define RCNB_ENCODE_COALESCE_BYTES 128
 
 typedef struct
 {
     bool cached;
     char trailing_byte;
+    bool coalesce;
+    size_t pending_length;
+    char pending[RCNB_ENCODE_COALESCE_BYTES];
+    const rcnb_alphabet* alphabet;
+    rcnb_checksumstate checksum;
 } rcnb_encodestate;
 
-void rcnb_init_encodestate(rcnb_encodestate* state_in);
-size_t rcnb_encode_block(const char* plaintext_in, size_t length_in, wchar_t* code_out, rcnb_encodestate* state_in);
-size_t rcnb_encode_blockend(wchar_t* code_out, rcnb_encodestate* state_in);
-size_t rcnb_encode(const char* plaintext_in, size_t length_in, wchar_t* code_out);
+RCNB_API void rcnb_init_encodestate(rcnb_encodestate* state_in);
+/* like rcnb_init_encodestate, but encodes with the given alphabet, NULL meaning the built-in one */
+RCNB_API void rcnb_init_encodestate_alphabet(rcnb_encodestate* state_in, const rcnb_alphabet* alphabet);
+RCNB_API size_t rcnb_encode_block(const char* plaintext_in, size_t length_in, wchar_t* code_out, rcnb_encodestate* state_in);
+RCNB_API size_t rcnb_encode_blockend(wchar_t* code_out, rcnb_encodestate* state_in);
+/* makes the following blocks keep a running RCNB_CHECKSUM_* of their plaintext, call it right after init */
+RCNB_API void rcnb_encode_set_checksum(rcnb_encodestate* state_in, int method);
+/* makes the following blocks hold back plaintext until RCNB_ENCODE_COALESCE_BYTES of it can be encoded
+   together, so small blocks still reach the SIMD kernels; code_out then needs room for the code of
+   length_in + RCNB_ENCODE_COALESCE_BYTES bytes, and rcnb_encode_blockend encodes what is left */
+RCNB_API void rcnb_encode_set_coalesce(rcnb_encodestate* state_in, bool coalesce);
+/* like rcnb_encode_blockend, also storing the checksum of the whole plaintext in checksum_out */
+RCNB_API size_t rcnb_encode_blockend_checksum(wchar_t* code_out, rcnb_encodestate* state_in, uint64_t* checksum_out);
+/* changes the block length from which rcnb_encode_block streams, raised to RCNB_STREAM_THRESHOLD_MIN; blocks
+   being encoded on other threads meanwhile may see either value, and a profile loaded later keeps it */
+RCNB_API void rcnb_set_stream_threshold(size_t length_in);
+RCNB_API size_t rcnb_get_stream_threshold(void);
+RCNB_API size_t rcnb_encode(const char* plaintext_in, size_t length_in, wchar_t* code_out);
+RCNB_API size_t rcnb_encode_alphabet(const char* plaintext_in, size_t length_in, wchar_t* code_out,
+        const rcnb_alphabet* alphabet);
+/* encodes the groups covering [offset, offset + length), which start at code unit 2 * (offset & ~1) */
+RCNB_API size_t rcnb_encode_range(const char* plaintext_in, size_t length_in, size_t offset, size_t length,
+        wchar_t* code_out);
+RCNB_API size_t rcnb_encode_range_alphabet(const char* plaintext_in, size_t length_in, size_t offset, size_t length,
+        wchar_t* code_out, const rcnb_alphabet* alphabet);
+/* allocates room for the code of length_in plaintext bytes, aligned so large encodes can stream into it */
+RCNB_API wchar_t* rcnb_alloc_code(size_t length_in);
+RCNB_API void rcnb_free_code(wchar_t* code);
 
-void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n);
+/* the header-only build declares the SIMD kernels only when it compiles them */
+#if !defined(RCNB_SINGLE_H) || defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+RCNB_API void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet);
+RCNB_API void rcnb_encode_32n_stream_asm(const char *value_in, char *value_out, size_t n,
+        const rcnb_alphabet *alphabet);
+RCNB_API void rcnb_encode_tail_asm(const char *value_in, char *value_out, size_t length,
+        const rcnb_alphabet *alphabet);
+#endif
 
 #endif /* RCNB_CENCODE_H */
@@ -0,0 +1,39 @@
+/*
+cescape.h - c header for rcnb output in escaped form
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+The escaped forms are plain ASCII, ready to paste into a JSON string, a URL or
+an HTML document. They are written straight from the code of the built-in
+alphabet, code points below 0x80 as they are and the rest as
+
+    RCNB_ESCAPE_JSON   \uXXXX
+    RCNB_ESCAPE_URL    their UTF-8 bytes as %XX%XX
+    RCNB_ESCAPE_HTML   &#xXX; or &#xXXX;
+
+The decoders read the same forms, with hex digits in either case; the HTML one
+also accepts decimal references and the named entities of the alphabet.
+*/
+
+#ifndef RCNB_CESCAPE_H
+#define RCNB_CESCAPE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define RCNB_ESCAPE_JSON 1
+#define RCNB_ESCAPE_URL 2
+#define RCNB_ESCAPE_HTML 3
+
+/* the longest escape of a single code unit, 0 for an unknown format */
+size_t rcnb_escape_max(int format);
+/* enough room for the escaped code of length_in bytes and the terminating NUL */
+size_t rcnb_escape_bound(size_t length_in, int format);
+/* the exact length rcnb_encode_escaped() will return */
+size_t rcnb_escaped_length(const char* plaintext_in, size_t length_in, int format);
+
+size_t rcnb_encode_escaped(const char* plaintext_in, size_t length_in, char* escaped_out, int format);
+ptrdiff_t rcnb_decode_escaped(const char* escaped_in, size_t length_in, char* plaintext_out, int format);
+
+#endif /* RCNB_CESCAPE_H */
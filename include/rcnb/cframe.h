@@ -0,0 +1,56 @@
+/*
+cframe.h - c header for the chunked rcnb container format
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+A framed stream is a header, a run of independently decodable chunks and a
+trailing index, every field of which is itself rcnb-encoded:
+
+    header        "RCNF", version, flags, 2 reserved bytes, chunk size (u32)
+    chunk         plaintext length (u32), CRC-32C of the plaintext (u32), payload
+    index entry   UTF-8 byte offset of a chunk (u64)
+    footer        UTF-8 byte offset of the index (u64), chunk count (u32), "RCNI"
+
+Integers are big-endian. Every chunk but the last holds exactly chunk size
+bytes, so chunks sit at fixed code unit offsets; the index records where they
+start once the stream has been written out as UTF-8.
+*/
+
+#ifndef RCNB_CFRAME_H
+#define RCNB_CFRAME_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RCNB_FRAME_VERSION 1
+#define RCNB_FRAME_HEADER_LENGTH 24
+#define RCNB_FRAME_CHUNK_HEADER_LENGTH 16
+#define RCNB_FRAME_INDEX_ENTRY_LENGTH 16
+#define RCNB_FRAME_FOOTER_LENGTH 32
+
+typedef struct
+{
+    unsigned char version;
+    unsigned char flags;
+    uint32_t chunk_size;
+} rcnb_frameheader;
+
+void rcnb_init_frameheader(rcnb_frameheader* header_in, uint32_t chunk_size);
+size_t rcnb_frame_write_header(const rcnb_frameheader* header_in, wchar_t* code_out);
+bool rcnb_frame_read_header(const wchar_t* code_in, rcnb_frameheader* header_out);
+
+size_t rcnb_frame_chunk_length(size_t length_in);
+size_t rcnb_frame_encode_chunk(const char* plaintext_in, size_t length_in, wchar_t* code_out);
+ptrdiff_t rcnb_frame_read_chunk_header(const wchar_t* code_in, uint32_t* crc_out);
+ptrdiff_t rcnb_frame_decode_chunk(const wchar_t* code_in, size_t length_in, char* plaintext_out);
+
+size_t rcnb_frame_write_index_entry(uint64_t offset_in, wchar_t* code_out);
+bool rcnb_frame_read_index_entry(const wchar_t* code_in, uint64_t* offset_out);
+size_t rcnb_frame_write_footer(uint64_t index_offset, uint32_t chunks, wchar_t* code_out);
+ptrdiff_t rcnb_frame_read_footer(const wchar_t* code_in, uint64_t* index_offset_out);
+
+size_t rcnb_utf8_length(const wchar_t* code_in, size_t length_in);
+
+#endif /* RCNB_CFRAME_H */
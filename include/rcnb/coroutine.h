@@ -0,0 +1,214 @@
+// :mode=c++:
+
+/*
+coroutine.h - c++20 coroutine wrappers for streaming rcnb encoding and decoding
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+encode_stream() and decode_stream() pull their input from a source, a callable
+returning something to co_await that produces the next chunk as a std::span,
+empty once the input is exhausted. They yield the output one chunk at a time:
+
+    auto code = rcnb::encode_stream([&] { return socket.async_read(); });
+    while (const std::span<const wchar_t>* chunk = co_await code.next())
+        co_await send(*chunk);
+
+A yielded chunk stays valid until the following next(), after which the stream
+writes over the same buffer again. An input chunk only has to stay valid until
+the source is called again. Invalid code makes next() throw std::runtime_error.
+*/
+
+#ifndef RCNB_COROUTINE_H
+#define RCNB_COROUTINE_H
+
+#if !defined(__cpp_impl_coroutine) || !__has_include(<coroutine>)
+#error "rcnb/coroutine.h requires C++20 coroutines"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace rcnb {
+
+extern "C" {
+    #include "cencode.h"
+    #include "cdecode.h"
+}
+
+/* plaintext bytes handed to the kernels at a time, a multiple of their 32 byte batches */
+#ifndef RCNB_COROUTINE_CHUNK
+#define RCNB_COROUTINE_CHUNK 16384
+#endif
+
+// A coroutine that yields values to a consumer awaiting next(), and may itself suspend on other awaitables.
+template <typename T>
+class async_generator {
+public:
+    struct promise_type {
+        const T* _value = nullptr;
+        std::coroutine_handle<> _consumer;
+        std::exception_ptr _exception;
+        // running, yielded while the consumer was still inside next(), or the consumer has suspended
+        std::atomic<int> _handoff{0};
+
+        struct transfer {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> producer) noexcept
+            {
+                promise_type& promise = producer.promise();
+                int running = 0;
+                if (promise._handoff.compare_exchange_strong(running, 1))
+                    return std::noop_coroutine();
+                return promise._consumer;
+            }
+            void await_resume() noexcept {}
+        };
+
+        async_generator get_return_object() noexcept
+        {
+            return async_generator(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        transfer final_suspend() noexcept
+        {
+            _value = nullptr;
+            return {};
+        }
+        transfer yield_value(const T& value_in) noexcept
+        {
+            _value = std::addressof(value_in);
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { _exception = std::current_exception(); }
+    };
+
+    // Runs the producer on the consumer's stack until it yields, so chunks that are ready right away
+    // cost no suspension. If the producer has to wait on its source, whoever resumes it later hands
+    // the next value on to the consumer.
+    struct next_awaiter {
+        std::coroutine_handle<promise_type> _producer;
+
+        bool await_ready() noexcept { return !_producer || _producer.done(); }
+        bool await_suspend(std::coroutine_handle<> consumer) noexcept
+        {
+            promise_type& promise = _producer.promise();
+            promise._consumer = consumer;
+            promise._handoff = 0;
+            _producer.resume();
+            int running = 0;
+            return promise._handoff.compare_exchange_strong(running, 2);
+        }
+        const T* await_resume()
+        {
+            if (!_producer)
+                return nullptr;
+            promise_type& promise = _producer.promise();
+            if (promise._exception)
+                std::rethrow_exception(std::exchange(promise._exception, nullptr));
+            return _producer.done() ? nullptr : promise._value;
+        }
+    };
+
+    async_generator(async_generator&& other_in) noexcept : _handle(std::exchange(other_in._handle, nullptr))
+    {
+    }
+
+    async_generator& operator=(async_generator&& other_in) noexcept
+    {
+        if (this != &other_in) {
+            if (_handle)
+                _handle.destroy();
+            _handle = std::exchange(other_in._handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~async_generator()
+    {
+        if (_handle)
+            _handle.destroy();
+    }
+
+    // Resumes the producer; the result points at the next value, or is null once it has finished.
+    next_awaiter next() noexcept
+    {
+        return next_awaiter{_handle};
+    }
+
+private:
+    explicit async_generator(std::coroutine_handle<promise_type> handle_in) : _handle(handle_in)
+    {
+    }
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+template <typename Source>
+async_generator<std::span<const wchar_t>> encode_stream(Source source, size_t chunksize_in = RCNB_COROUTINE_CHUNK,
+                                                        const rcnb_alphabet* alphabet_in = nullptr)
+{
+    rcnb_encodestate state;
+    rcnb_init_encodestate_alphabet(&state, alphabet_in);
+    // whole batches per slice, so that only the end of an input chunk takes the tail path
+    const size_t N = std::max<size_t>(chunksize_in & ~(size_t)31, 32);
+    std::vector<wchar_t> code(2 * N + 3);
+
+    while (true) {
+        std::span<const char> plaintext = co_await source();
+        if (plaintext.empty())
+            break;
+        for (size_t i = 0; i < plaintext.size(); i += N) {
+            size_t codelength = rcnb_encode_block(plaintext.data() + i, std::min(N, plaintext.size() - i),
+                                                  code.data(), &state);
+            if (codelength > 0)
+                co_yield std::span<const wchar_t>(code.data(), codelength);
+        }
+    }
+
+    size_t codelength = rcnb_encode_blockend(code.data(), &state);
+    if (codelength > 0)
+        co_yield std::span<const wchar_t>(code.data(), codelength);
+}
+
+template <typename Source>
+async_generator<std::span<const char>> decode_stream(Source source, size_t chunksize_in = RCNB_COROUTINE_CHUNK,
+                                                     const rcnb_alphabet* alphabet_in = nullptr)
+{
+    rcnb_decodestate state;
+    rcnb_init_decodestate_alphabet(&state, alphabet_in);
+    const size_t N = std::max<size_t>(chunksize_in & ~(size_t)31, 32);
+    std::vector<char> plaintext(N + 4);
+
+    while (true) {
+        std::span<const wchar_t> code = co_await source();
+        if (code.empty())
+            break;
+        for (size_t i = 0; i < code.size(); i += 2 * N) {
+            ptrdiff_t plainlength = rcnb_decode_block(code.data() + i, std::min(2 * N, code.size() - i),
+                                                      plaintext.data(), &state);
+            if (plainlength < 0)
+                throw std::runtime_error("rcnb: invalid code");
+            if (plainlength > 0)
+                co_yield std::span<const char>(plaintext.data(), plainlength);
+        }
+    }
+
+    ptrdiff_t plainlength = rcnb_decode_blockend(plaintext.data(), &state);
+    if (plainlength < 0)
+        throw std::runtime_error("rcnb: truncated code");
+    if (plainlength > 0)
+        co_yield std::span<const char>(plaintext.data(), plainlength);
+}
+
+} // namespace rcnb
+
+#endif // RCNB_COROUTINE_H
@@ -0,0 +1,42 @@
+/*
+cpatch.h - c header for editing rcnb code in place
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+Each pair of plaintext bytes has its own four code units, so a change to the
+plaintext only touches the groups it lies in. rcnb_patch_encoded() overwrites
+bytes of the payload by encoding just those groups, decoding the byte a group
+keeps when the change starts or ends half way through it.
+
+rcnb_splice_encoded() replaces bytes with a different number of bytes. When
+the length changes by an even number, the rest of the payload keeps its
+pairs, and its code is moved with one memmove. When it changes by an odd
+number, every later byte pairs up differently, and the rest is decoded and
+encoded again. Either way the last group of a payload of odd length, the two
+units rcnb_encode_blockend() writes for the byte left over, comes out right.
+*/
+
+#ifndef RCNB_CPATCH_H
+#define RCNB_CPATCH_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <rcnb/calphabet.h>
+
+/* overwrites plaintext bytes [offset, offset + length_in) of the payload encoded in code_in[0, code_length);
+   false if they run past its end or a group at either end does not decode, leaving the code as it was */
+bool rcnb_patch_encoded(wchar_t* code_in, size_t code_length, size_t offset, const char* plaintext_in,
+        size_t length_in);
+bool rcnb_patch_encoded_alphabet(wchar_t* code_in, size_t code_length, size_t offset, const char* plaintext_in,
+        size_t length_in, const rcnb_alphabet* alphabet);
+
+/* replaces plaintext bytes [offset, offset + removed) with inserted bytes from plaintext_in and returns the new
+   code length, which code_in needs room for; -1 on the errors of rcnb_patch_encoded() or when out of memory */
+ptrdiff_t rcnb_splice_encoded(wchar_t* code_in, size_t code_length, size_t offset, size_t removed,
+        const char* plaintext_in, size_t inserted);
+ptrdiff_t rcnb_splice_encoded_alphabet(wchar_t* code_in, size_t code_length, size_t offset, size_t removed,
+        const char* plaintext_in, size_t inserted, const rcnb_alphabet* alphabet);
+
+#endif /* RCNB_CPATCH_H */
@@ -0,0 +1,52 @@
+/*
+crecover.h - c header for decoding damaged rcnb code
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+rcnb_decode_recover() decodes past invalid groups instead of giving up on the
+first one. Every run of code it cannot decode is reported with its offset,
+then skipped or replaced by a substitute byte for every two units it spans.
+
+The code carries no sync marks, but each group starts with an r or an n and
+its second unit is a c or a b, so a unit that was dropped or inserted only
+shifts the groups until the next position where two whole groups decode.
+A mangled unit keeps the groups where they were.
+
+The vector kernels decode the code batch by batch as usual; only a batch they
+reject is gone over again group by group to find the damage.
+*/
+
+#ifndef RCNB_CRECOVER_H
+#define RCNB_CRECOVER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <rcnb/calphabet.h>
+
+#define RCNB_RECOVER_SKIP 0
+#define RCNB_RECOVER_SUBSTITUTE 1
+
+typedef struct
+{
+    /* RCNB_RECOVER_SKIP or RCNB_RECOVER_SUBSTITUTE */
+    int policy;
+    /* byte written in place of the plaintext of invalid code */
+    char substitute;
+    /* NULL for the built-in alphabet */
+    const rcnb_alphabet* alphabet;
+    /* called with the offset and length in code units of every invalid run, may be NULL */
+    void (*report)(size_t offset, size_t length, void* context);
+    void* context;
+} rcnb_recoveroptions;
+
+/* substitutes '?' and reports nothing */
+void rcnb_init_recoveroptions(rcnb_recoveroptions* options_out);
+
+/* decodes code_in[0, length_in) into plaintext_out, which needs length_in / 2 + 1 bytes;
+   returns the plaintext length and stores the number of invalid runs in invalid_out unless it is NULL */
+size_t rcnb_decode_recover(const wchar_t* code_in, size_t length_in, char* plaintext_out,
+        const rcnb_recoveroptions* options_in, size_t* invalid_out);
+
+#endif /* RCNB_CRECOVER_H */
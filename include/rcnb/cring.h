@@ -0,0 +1,72 @@
+/*
+cring.h - c header for a lock-free ring of rcnb code between two threads
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+An rcnb_ring hands code from one producer thread to one consumer thread
+without locks. The producer pushes plaintext and the ring encodes it straight
+into the free part of its buffer; the consumer peeks at the code in place and
+releases it when it is done with it. Neither side ever waits on the other:
+when the ring is full or empty the calls return short and the caller decides
+whether to spin, yield or do something else.
+
+The producer may stage several blocks and publish them with one commit, and
+the consumer may release whatever it has peeked at in one go, so the two
+threads only touch each other's cache lines once per batch. The encoding state
+lives in the ring, so a byte pair split by a push or by the end of the buffer
+comes out the same as in one block. Right after init, the producer may give
+ring->state an alphabet or a checksum as for any rcnb_encodestate.
+*/
+
+#ifndef RCNB_CRING_H
+#define RCNB_CRING_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <rcnb/cencode.h>
+
+typedef struct
+{
+    wchar_t* code;
+    /* code units in the ring, a power of two */
+    size_t capacity;
+    /* what the producer has published, read by the consumer */
+    char padding1[RCNB_ALIGNMENT];
+    size_t head;
+    size_t closed;
+    /* what the consumer has released, read by the producer */
+    char padding2[RCNB_ALIGNMENT];
+    size_t tail;
+    /* the producer's own */
+    char padding3[RCNB_ALIGNMENT];
+    size_t staged;
+    size_t tail_seen;
+    rcnb_encodestate state;
+} rcnb_ring;
+
+/* allocates a ring of at least capacity code units, rounded up to a power of two */
+bool rcnb_init_ring(rcnb_ring* ring_in, size_t capacity);
+void rcnb_free_ring(rcnb_ring* ring_in);
+
+/* producer: encodes as much of the plaintext as the ring has room for without publishing it,
+   and returns how much that was */
+size_t rcnb_ring_stage(rcnb_ring* ring_in, const char* plaintext_in, size_t length_in);
+/* producer: makes everything staged so far visible to the consumer */
+void rcnb_ring_commit(rcnb_ring* ring_in);
+/* producer: stages and commits in one call */
+size_t rcnb_ring_push(rcnb_ring* ring_in, const char* plaintext_in, size_t length_in);
+/* producer: encodes the byte held back by the state and commits; false while there is no room for it,
+   after which nothing more can be pushed */
+bool rcnb_ring_close(rcnb_ring* ring_in);
+
+/* consumer: points code_out at the oldest published code and returns how many units follow it
+   without wrapping, 0 if there are none */
+size_t rcnb_ring_peek(rcnb_ring* ring_in, const wchar_t** code_out);
+/* consumer: gives up the first length units, which need not be whole groups */
+void rcnb_ring_release(rcnb_ring* ring_in, size_t length);
+/* consumer: true once the producer has closed the ring and all of its code was released */
+bool rcnb_ring_finished(rcnb_ring* ring_in);
+
+#endif /* RCNB_CRING_H */
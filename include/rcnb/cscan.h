@@ -0,0 +1,65 @@
+/*
+cscan.h - c header for finding rcnb code in ordinary text
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+rcnb_find_runs() picks the rcnb code out of text such as logs, chat or HTML:
+the maximal runs of whole groups that decode, each possibly ending in the two
+units of an odd byte. rcnb_extract() decodes every run as it finds it. Both
+come in a wide and a UTF-8 form; the offsets of the UTF-8 form count bytes.
+
+The vector kernels classify the text against the r, c, n and b sets 64 units
+at a time, so only the places where four units of the right sets meet are
+looked at closely, and a long run is decoded batch by batch. As letters like r,
+c, n and b are code points of the built-in alphabet, plain words make a group
+now and then; runs of fewer than min_groups groups are taken for text.
+*/
+
+#ifndef RCNB_CSCAN_H
+#define RCNB_CSCAN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <rcnb/calphabet.h>
+
+/* the most min_groups can be */
+#define RCNB_SCAN_MAX_GROUPS 256
+
+typedef struct
+{
+    /* runs of fewer groups are not reported, from 1 to RCNB_SCAN_MAX_GROUPS */
+    size_t min_groups;
+    /* NULL for the built-in alphabet */
+    const rcnb_alphabet* alphabet;
+} rcnb_scanoptions;
+
+typedef struct
+{
+    /* where the run lies in the text, in code units, or in bytes for UTF-8 */
+    size_t offset;
+    size_t length;
+    /* where rcnb_extract() put its plaintext, 0 for rcnb_find_runs() */
+    size_t plaintext_offset;
+    size_t plaintext_length;
+} rcnb_run;
+
+/* runs of 4 groups or more in the built-in alphabet */
+void rcnb_init_scanoptions(rcnb_scanoptions* options_out);
+
+/* stores the first max_runs runs of text_in[0, length_in) in runs_out and returns how many it found;
+   when that is max_runs, carry on from the end of the last one. NULL options scan with the defaults */
+size_t rcnb_find_runs(const wchar_t* text_in, size_t length_in, rcnb_run* runs_out, size_t max_runs,
+        const rcnb_scanoptions* options_in);
+size_t rcnb_find_runs_utf8(const char* text_in, size_t length_in, rcnb_run* runs_out, size_t max_runs,
+        const rcnb_scanoptions* options_in);
+
+/* like rcnb_find_runs, also decoding the runs one after the other into plaintext_out,
+   which needs length_in / 2 + 1 bytes */
+size_t rcnb_extract(const wchar_t* text_in, size_t length_in, char* plaintext_out, rcnb_run* runs_out,
+        size_t max_runs, const rcnb_scanoptions* options_in);
+size_t rcnb_extract_utf8(const char* text_in, size_t length_in, char* plaintext_out, rcnb_run* runs_out,
+        size_t max_runs, const rcnb_scanoptions* options_in);
+
+#endif /* RCNB_CSCAN_H */
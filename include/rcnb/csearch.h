@@ -0,0 +1,68 @@
+/*
+csearch.h - c header for searching rcnb code for a plaintext pattern
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+Two bytes always make the same four code units, so a byte pattern can be
+looked for in the code itself instead of in its decoded plaintext. The
+searcher encodes the whole pairs of the pattern once for a match at an even
+offset and once for a match at an odd one, in the forms the code may be stored
+in. A search runs the vector kernels over the text for the first and last
+bytes of both, compares the candidates and checks them against the group
+grid; only the group the pattern starts in at an odd offset, and the one it
+ends in after an odd number of bytes, are decoded to compare their one byte.
+Patterns of one or two bytes have no whole pair to look for in both
+alignments, and are found by going over the groups one by one.
+
+The text must be the code of a payload from its first group on, as its
+groups are told apart by counting code units. The last group of a payload of
+odd length is taken to end the text, so leave off a trailing line break.
+*/
+
+#ifndef RCNB_CSEARCH_H
+#define RCNB_CSEARCH_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <rcnb/calphabet.h>
+
+typedef struct
+{
+    /* the code of the pattern from its first whole pair on, if it has one */
+    size_t units;
+    wchar_t* wide;
+    unsigned short* utf16;
+    char* utf8;
+    size_t utf8_length;
+} rcnb_searchcore;
+
+typedef struct
+{
+    const rcnb_alphabet* alphabet;
+    size_t length;
+    /* the bytes left outside the whole pairs */
+    unsigned char first;
+    unsigned char last;
+    /* for a match at an even and at an odd plaintext offset */
+    rcnb_searchcore core[2];
+    void* memory;
+} rcnb_searcher;
+
+/* encodes a pattern of length_in >= 1 bytes; a NULL alphabet is the built-in one. False if out of memory */
+bool rcnb_init_searcher(rcnb_searcher* searcher_out, const char* pattern_in, size_t length_in,
+        const rcnb_alphabet* alphabet);
+void rcnb_free_searcher(rcnb_searcher* searcher_in);
+
+/* stores the plaintext offsets of the first max_matches matches at or after the offset start in offsets_out,
+   and returns how many it found; when that is max_matches, carry on from the last one plus one */
+size_t rcnb_search(const rcnb_searcher* searcher_in, const wchar_t* code_in, size_t length_in, size_t start,
+        size_t* offsets_out, size_t max_matches);
+/* the same for code stored as UTF-8, length_in in bytes, or as native-endian UTF-16 */
+size_t rcnb_search_utf8(const rcnb_searcher* searcher_in, const char* text_in, size_t length_in, size_t start,
+        size_t* offsets_out, size_t max_matches);
+size_t rcnb_search_utf16(const rcnb_searcher* searcher_in, const unsigned short* text_in, size_t length_in,
+        size_t start, size_t* offsets_out, size_t max_matches);
+
+#endif /* RCNB_CSEARCH_H */
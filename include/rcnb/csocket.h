@@ -0,0 +1,105 @@
+/*
+csocket.h - c header for streaming rcnb over non-blocking sockets
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+A socksender encodes plaintext into a ring of chunks of UTF-8 code and hands
+as many of them as are ready to a single writev(), so the code is written once
+and never copied again on its way to the kernel. A sockreceiver reads UTF-8
+code off a socket and decodes it as it arrives. Neither of them waits on its
+own: they report when the socket would block, and the caller polls it with
+whatever event loop it runs. rcnb_epoll_encode() and rcnb_epoll_decode() are
+reference loops built on epoll.
+
+The descriptors are expected to be non-blocking. Only available on POSIX systems.
+*/
+
+#ifndef RCNB_CSOCKET_H
+#define RCNB_CSOCKET_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <rcnb/cencode.h>
+#include <rcnb/cdecode.h>
+
+typedef struct
+{
+    /* plaintext bytes encoded into one chunk */
+    size_t chunk_size;
+    /* chunks in the ring, the most a single writev() sends */
+    size_t chunks;
+    /* bytes of code to gather before a flush sends them, 0 sends whatever is ready */
+    size_t batch;
+} rcnb_sockoptions;
+
+typedef struct
+{
+    char* code;
+    size_t length;
+    size_t plaintext;
+} rcnb_sockchunk;
+
+typedef struct
+{
+    int fd;
+    rcnb_sockoptions options;
+    rcnb_encodestate state;
+    rcnb_sockchunk* ring;
+    wchar_t* scratch;
+    size_t head;
+    size_t count;
+    size_t sent;
+    size_t pending;
+    bool finished;
+    /* set while the socket would block, poll it for writing before flushing again */
+    bool blocked;
+} rcnb_socksender;
+
+typedef struct
+{
+    int fd;
+    rcnb_sockoptions options;
+    rcnb_decodestate state;
+    char* bytes;
+    wchar_t* code;
+    size_t buffered;
+    bool eof;
+    /* set while the socket has nothing to read, poll it for reading before reading again */
+    bool blocked;
+} rcnb_sockreceiver;
+
+/* 16 KiB chunks, 16 of them, no batching */
+void rcnb_init_sockoptions(rcnb_sockoptions* options_out);
+
+bool rcnb_init_socksender(rcnb_socksender* sender_in, int fd, const rcnb_sockoptions* options_in);
+/* encodes as much of the plaintext as the ring has room for and returns how much that was */
+size_t rcnb_socksender_push(rcnb_socksender* sender_in, const char* plaintext_in, size_t length_in);
+/* encodes the last byte held back by the state, after which nothing more can be pushed */
+void rcnb_socksender_finish(rcnb_socksender* sender_in);
+/* writes the ready chunks unless fewer than batch bytes are pending and force is false;
+   returns the bytes written, 0 if it sent nothing, or -1 on error with errno set */
+ptrdiff_t rcnb_socksender_flush(rcnb_socksender* sender_in, bool force);
+/* bytes of code still waiting to be written */
+size_t rcnb_socksender_pending(const rcnb_socksender* sender_in);
+/* plaintext bytes the ring can take right now */
+size_t rcnb_socksender_room(const rcnb_socksender* sender_in);
+void rcnb_free_socksender(rcnb_socksender* sender_in);
+
+bool rcnb_init_sockreceiver(rcnb_sockreceiver* receiver_in, int fd, const rcnb_sockoptions* options_in);
+/* room rcnb_sockreceiver_read() needs in plaintext_out */
+size_t rcnb_sockreceiver_bound(const rcnb_sockreceiver* receiver_in);
+/* reads what the socket has and decodes it; returns the plaintext length, which may be 0 while
+   a group is incomplete, the socket would block or has reached its end, or -1 on error or invalid code */
+ptrdiff_t rcnb_sockreceiver_read(rcnb_sockreceiver* receiver_in, char* plaintext_out);
+/* decodes the last byte after eof, -1 if the code was truncated */
+ptrdiff_t rcnb_sockreceiver_end(rcnb_sockreceiver* receiver_in, char* plaintext_out);
+void rcnb_free_sockreceiver(rcnb_sockreceiver* receiver_in);
+
+/* encode everything read from source_fd onto socket_fd, or decode from socket_fd into sink_fd,
+   until the end of the input; both return 0 on success and -1 on error with errno set */
+int rcnb_epoll_encode(int source_fd, int socket_fd, const rcnb_sockoptions* options_in);
+int rcnb_epoll_decode(int socket_fd, int sink_fd, const rcnb_sockoptions* options_in);
+
+#endif /* RCNB_CSOCKET_H */
@@ -0,0 +1,30 @@
+/*
+cstats.h - c header for the rcnb instrumentation counters
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#ifndef RCNB_CSTATS_H
+#define RCNB_CSTATS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct
+{
+    bool enabled;
+    const char* kernel;
+    unsigned long long encode_calls;
+    unsigned long long encode_simd_bytes;
+    unsigned long long encode_scalar_bytes;
+    unsigned long long decode_calls;
+    unsigned long long decode_simd_bytes;
+    unsigned long long decode_scalar_bytes;
+    unsigned long long decode_failures;
+} rcnb_stats;
+
+void rcnb_get_stats(rcnb_stats* stats_out);
+void rcnb_reset_stats(void);
+
+#endif /* RCNB_CSTATS_H */
@@ -0,0 +1,65 @@
+/*
+ctune.h - c header for tuning rcnb to the machine it runs on
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+rcnb_autotune() runs a few seconds of timed encode and decode trials and
+records the block size, the non-temporal store threshold and the number of
+threads that did best. rcnb --calibrate saves the result as a profile, a text
+file of "key value" lines:
+
+    kernel avx2
+    chunk_size 65536
+    stream_threshold 4194304
+    threads 8
+
+The profile is read from the file named by RCNB_PROFILE, or else from rcnb/profile
+in the user's configuration directory, the first time rcnb_get_profile() is
+called, and not before. The C++ wrappers call it when an encoder or decoder is
+constructed and the command line tool when it starts; C code that only uses
+rcnb_encode_block() keeps the built-in threshold unless it calls
+rcnb_get_profile() first. A profile calibrated for a different kernel than the
+library was built with is ignored.
+*/
+
+#ifndef RCNB_CTUNE_H
+#define RCNB_CTUNE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* the block size of the C++ wrappers without a profile */
+#define RCNB_PROFILE_CHUNK 4096
+/* the largest block size a profile may set, as the wrappers size their buffers in multiples of it with int */
+#define RCNB_PROFILE_CHUNK_MAX (1 << 26)
+
+typedef struct
+{
+    /* the kernel the trials ran on, as reported by rcnb_get_stats() */
+    char kernel[16];
+    /* plaintext bytes per block for streaming */
+    size_t chunk_size;
+    /* block length from which encoding bypasses the cache */
+    size_t stream_threshold;
+    /* worker threads for the chunked and batch modes */
+    unsigned threads;
+} rcnb_profile;
+
+/* the defaults of this build, with one thread per core */
+void rcnb_init_profile(rcnb_profile* profile_out);
+/* times the trials on this machine and fills profile_out with the best settings; false if out of memory */
+bool rcnb_autotune(rcnb_profile* profile_out);
+
+bool rcnb_load_profile(rcnb_profile* profile_out, const char* path);
+bool rcnb_save_profile(const rcnb_profile* profile_in, const char* path);
+/* where the profile is looked for, false if there is no configuration directory */
+bool rcnb_profile_path(char* path_out, size_t length);
+
+/* the profile in effect, loaded on the first call */
+const rcnb_profile* rcnb_get_profile(void);
+/* puts a copy of profile_in into effect, including its stream threshold, with both sizes brought within their
+   bounds; the profiles returned before stay valid, so each call keeps its copy for good; false if out of memory */
+bool rcnb_set_profile(const rcnb_profile* profile_in);
+
+#endif /* RCNB_CTUNE_H */
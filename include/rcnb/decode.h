@@ -12,25 +12,45 @@ For details, see https://github.com/rikakomoe/librcnb
 
 #define BUFFERSIZE 4096
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <thread>
+#include <vector>
+
+#include "pipeline.h"
 
 namespace rcnb {
 
 extern "C" {
     #include "cdecode.h"
+    #include "ccompress.h"
+    #include "ctune.h"
 }
 
 struct decoder {
     rcnb_decodestate _state;
     int _buffersize;
+    const rcnb_alphabet* _alphabet;
+    bool _compose = false;
+
+    // A buffersize of 0 takes the chunk size of the machine's profile, see ctune.h.
+    explicit decoder(int buffersize_in = 0, const rcnb_alphabet* alphabet_in = nullptr)
+        : _buffersize(buffersize_in > 0 ? buffersize_in : (int)rcnb_get_profile()->chunk_size),
+          _alphabet(alphabet_in)
+    {
+    }
 
-    explicit decoder(int buffersize_in = BUFFERSIZE) : _buffersize(buffersize_in)
+    // Accepts code that Unicode normalization decomposed, see rcnb_decode_set_compose.
+    void set_compose(bool compose_in)
     {
+        _compose = compose_in;
     }
 
     void initialize()
     {
-        rcnb_init_decodestate(&_state);
+        rcnb_init_decodestate_alphabet(&_state, _alphabet);
+        rcnb_decode_set_compose(&_state, _compose);
     }
 
     ptrdiff_t decode(const wchar_t* code_in, size_t length_in, char* plaintext_out) {
@@ -51,13 +71,26 @@ struct decoder {
         long plainlength;
         long codelength;
 
-        do {
+        istream_in.read(code, N);
+        codelength = istream_in.gcount();
+        if (codelength >= RCNB_COMPRESS_MARKER_LENGTH
+            && std::equal(code, code + RCNB_COMPRESS_MARKER_LENGTH, RCNB_COMPRESS_MARKER)) {
+            decode_compressed(istream_in, ostream_in, code + RCNB_COMPRESS_MARKER_LENGTH,
+                              codelength - RCNB_COMPRESS_MARKER_LENGTH);
+            delete[] code;
+            delete[] plaintext;
+            return;
+        }
+
+        while (true) {
+            plainlength = decode(code, codelength, plaintext);
+            if (plainlength > 0)
+                ostream_in.write(plaintext, plainlength);
+            if (!istream_in.good() || plainlength <= 0)
+                break;
             istream_in.read(code, N);
             codelength = istream_in.gcount();
-
-            plainlength = decode(code, codelength, plaintext);
-            ostream_in.write(plaintext, plainlength);
-        } while (istream_in.good() && plainlength > 0);
+        }
 
         plainlength = decode_end(plaintext);
         ostream_in.write(plaintext, plainlength);
@@ -65,6 +98,82 @@ struct decoder {
         delete[] code;
         delete[] plaintext;
     }
+
+    // Decompresses on a separate thread so that decoding and decompression overlap.
+    void decode_compressed(std::wistream& istream_in, std::ostream& ostream_in,
+                           const wchar_t* code_in, long length_in)
+    {
+        const int N = _buffersize;
+        std::vector<wchar_t> code(code_in, code_in + length_in);
+        code.resize(std::max<size_t>(code.size(), N));
+        std::vector<char> block(code.size() / 2 + 4);
+
+        // the method byte leads the first group after the marker
+        ptrdiff_t blocklength = decode(code.data(), length_in, block.data());
+        int method = blocklength > 0 ? (unsigned char)block[0] : -1;
+        rcnb_compressstate decompress_state;
+        if (!rcnb_init_decompressstate(&decompress_state, method)) {
+            ostream_in.setstate(std::ios_base::badbit);
+            return;
+        }
+        block.erase(block.begin(), block.begin() + 1);
+        block.resize(blocklength - 1);
+
+        channel<std::vector<char>> filled(2), empty(2);
+        empty.push(std::vector<char>(N / 2 + 4));
+        empty.push(std::vector<char>(N / 2 + 4));
+        std::atomic<bool> failed(false);
+
+        std::thread decompressor([&] {
+            std::vector<char> plaintext(N);
+            std::vector<char> compressed;
+            while (filled.pop(compressed)) {
+                const char* next = compressed.data();
+                size_t remaining = compressed.size();
+                while (!failed) {
+                    size_t before = remaining;
+                    ptrdiff_t plainlength = rcnb_decompress_block(&next, &remaining, plaintext.data(), N,
+                                                                  &decompress_state);
+                    if (plainlength < 0 || (plainlength == 0 && remaining != 0 && remaining == before))
+                        failed = true;
+                    else
+                        ostream_in.write(plaintext.data(), plainlength);
+                    if (plainlength < N && remaining == 0)
+                        break;
+                }
+                compressed.resize(compressed.capacity());
+                empty.push(std::move(compressed));
+            }
+        });
+
+        filled.push(std::move(block));
+        while (istream_in.good() && empty.pop(block)) {
+            istream_in.read(code.data(), N);
+            blocklength = decode(code.data(), istream_in.gcount(), block.data());
+            if (blocklength < 0) {
+                failed = true;
+                break;
+            }
+            block.resize(blocklength);
+            filled.push(std::move(block));
+        }
+        if (!failed && empty.pop(block)) {
+            blocklength = decode_end(block.data());
+            if (blocklength < 0)
+                failed = true;
+            block.resize(std::max<ptrdiff_t>(blocklength, 0));
+            filled.push(std::move(block));
+        }
+        filled.close();
+        empty.close();
+        decompressor.join();
+        // a payload cut short decompresses without error as far as it goes
+        if (!rcnb_decompress_blockend(&decompress_state))
+            failed = true;
+
+        if (failed)
+            ostream_in.setstate(std::ios_base::badbit);
+    }
 };
 
 } // namespace rcnb
@@ -12,25 +12,38 @@ For details, see https://github.com/rikakomoe/librcnb
 
 #define BUFFERSIZE 4096
 
+#include <atomic>
 #include <iostream>
+#include <thread>
+#include <vector>
+
+#include "pipeline.h"
 
 namespace rcnb {
 
 extern "C" {
     #include "cencode.h"
+    #include "ccompress.h"
+    #include "ctune.h"
 }
 
 struct encoder {
     rcnb_encodestate _state;
     int _buffersize;
-
-    explicit encoder(int buffersize_in = BUFFERSIZE) : _buffersize(buffersize_in)
+    int _compression;
+    const rcnb_alphabet* _alphabet;
+
+    // A buffersize of 0 takes the chunk size of the machine's profile, see ctune.h.
+    explicit encoder(int buffersize_in = 0, int compression_in = RCNB_COMPRESS_NONE,
+                     const rcnb_alphabet* alphabet_in = nullptr)
+        : _buffersize(buffersize_in > 0 ? buffersize_in : (int)rcnb_get_profile()->chunk_size),
+          _compression(compression_in), _alphabet(alphabet_in)
     {
     }
 
     void initialize()
     {
-        rcnb_init_encodestate(&_state);
+        rcnb_init_encodestate_alphabet(&_state, _alphabet);
     }
 
     size_t encode(const char* plaintext_in, size_t length_in, wchar_t* const code_out) {
@@ -43,6 +56,11 @@ struct encoder {
 
     void encode(std::istream& istream_in, std::wostream& ostream_in)
     {
+        if (_compression != RCNB_COMPRESS_NONE) {
+            encode_compressed(istream_in, ostream_in);
+            return;
+        }
+
         initialize();
 
         const int N = _buffersize;
@@ -65,6 +83,64 @@ struct encoder {
         delete[] code;
         delete[] plaintext;
     }
+
+    // Compresses on a separate thread so that compression and encoding overlap.
+    void encode_compressed(std::istream& istream_in, std::wostream& ostream_in)
+    {
+        rcnb_compressstate compress_state;
+        if (!rcnb_init_compressstate(&compress_state, _compression, -1)) {
+            ostream_in.setstate(std::ios_base::badbit);
+            return;
+        }
+        initialize();
+
+        const int N = _buffersize;
+        channel<std::vector<char>> filled(2), empty(2);
+        empty.push(std::vector<char>(rcnb_compress_bound(N)));
+        empty.push(std::vector<char>(rcnb_compress_bound(N)));
+        std::atomic<bool> failed(false);
+
+        std::thread compressor([&] {
+            std::vector<char> plaintext(N);
+            std::vector<char> block;
+            ptrdiff_t blocklength;
+            while (empty.pop(block)) {
+                istream_in.read(plaintext.data(), N);
+                if (istream_in.gcount() > 0)
+                    blocklength = rcnb_compress_block(plaintext.data(), istream_in.gcount(), block.data(), &compress_state);
+                else
+                    blocklength = rcnb_compress_blockend(block.data(), &compress_state);
+                if (blocklength < 0) {
+                    failed = true;
+                    break;
+                }
+                block.resize(blocklength);
+                filled.push(std::move(block));
+                if (istream_in.gcount() == 0)
+                    break;
+            }
+            rcnb_free_compressstate(&compress_state);
+            filled.close();
+        });
+
+        std::vector<wchar_t> code(2 * rcnb_compress_bound(N) + 3);
+        const char method = (char)_compression;
+        ostream_in.write(RCNB_COMPRESS_MARKER, RCNB_COMPRESS_MARKER_LENGTH);
+        ostream_in.write(code.data(), encode(&method, 1, code.data()));
+
+        std::vector<char> block;
+        while (filled.pop(block)) {
+            ostream_in.write(code.data(), encode(block.data(), block.size(), code.data()));
+            block.resize(block.capacity());
+            empty.push(std::move(block));
+        }
+        empty.close();
+        compressor.join();
+
+        ostream_in.write(code.data(), encode_end(code.data()));
+        if (failed)
+            ostream_in.setstate(std::ios_base::badbit);
+    }
 };
 
 } // namespace rcnb
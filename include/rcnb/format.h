@@ -0,0 +1,227 @@
+// :mode=c++:
+
+/*
+format.h - c++ formatters that write rcnb code straight into std::format and {fmt} output
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+rcnb::as_rcnb() wraps a contiguous range of bytes, or a pointer and a size, so
+that std::format (where the library has <format>) and {fmt} (when
+<fmt/format.h> is included before this header) write it as UTF-8 rcnb code:
+
+    std::format("key={}", rcnb::as_rcnb(key));
+    fmt::format("{:>80w76}", rcnb::as_rcnb(data, size));
+
+The spec is an optional fill and alignment, a width, and w followed by the
+number of code points after which a line is broken. Width and line length are
+counted in code points, and the width includes the line breaks. The bytes are
+encoded RCNB_FORMAT_CHUNK at a time into buffers on the stack and copied on to
+the output, so formatting allocates nothing.
+*/
+
+#ifndef RCNB_FORMAT_H
+#define RCNB_FORMAT_H
+
+#if __cplusplus < 201703L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#error "rcnb/format.h requires C++17"
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+
+#if defined(__has_include)
+#if __has_include(<version>)
+#include <version>
+#endif
+#endif
+#if defined(__cpp_lib_format)
+#include <format>
+#endif
+
+namespace rcnb {
+
+extern "C" {
+    #include "cencode.h"
+}
+
+/* plaintext bytes encoded at a time, a multiple of the 32 byte batches of the kernels */
+#ifndef RCNB_FORMAT_CHUNK
+#define RCNB_FORMAT_CHUNK 512
+#endif
+
+struct formatted_bytes {
+    const char* data;
+    std::size_t size;
+    const rcnb_alphabet* alphabet;
+};
+
+inline formatted_bytes as_rcnb(const void* data, std::size_t size, const rcnb_alphabet* alphabet = nullptr)
+{
+    return formatted_bytes{static_cast<const char*>(data), size, alphabet};
+}
+
+// Any contiguous range of trivially copyable elements, such as a std::span, std::vector or std::string.
+template <typename Range>
+inline auto as_rcnb(const Range& bytes, const rcnb_alphabet* alphabet = nullptr)
+    -> decltype(std::data(bytes), std::size(bytes), formatted_bytes())
+{
+    using element = typename std::remove_pointer<decltype(std::data(bytes))>::type;
+    static_assert(std::is_trivially_copyable<element>::value, "rcnb::as_rcnb needs a range of plain bytes");
+    return formatted_bytes{reinterpret_cast<const char*>(std::data(bytes)), std::size(bytes) * sizeof(element),
+                           alphabet};
+}
+
+struct format_spec {
+    char fill = ' ';
+    char align = '<';
+    std::size_t width = 0;
+    std::size_t wrap = 0;
+};
+
+// Parses [[fill]align][width][w wrap] up to the closing brace, clearing ok if the spec is malformed.
+template <typename Iterator>
+constexpr Iterator parse_format_spec(Iterator it, Iterator end, format_spec& spec, bool& ok)
+{
+    auto is_align = [](char c) { return c == '<' || c == '>' || c == '^'; };
+    ok = true;
+    if (it != end && *it != '}') {
+        Iterator next = it;
+        ++next;
+        if (next != end && is_align(*next) && *it != '{') {
+            spec.fill = *it;
+            spec.align = *next;
+            it = ++next;
+        } else if (is_align(*it)) {
+            spec.align = *it;
+            ++it;
+        }
+    }
+    for (; it != end && *it >= '0' && *it <= '9'; ++it)
+        spec.width = 10 * spec.width + (*it - '0');
+    if (it != end && *it == 'w') {
+        ++it;
+        for (; it != end && *it >= '0' && *it <= '9'; ++it)
+            spec.wrap = 10 * spec.wrap + (*it - '0');
+        ok = spec.wrap > 0;
+    }
+    if (it != end && *it != '}')
+        ok = false;
+    return it;
+}
+
+template <typename OutputIterator>
+OutputIterator copy_text(const char* begin, const char* end, OutputIterator out)
+{
+    return std::copy(begin, end, out);
+}
+
+// The formatters' own iterators take a character at a time through std::copy, but a string view in one go.
+#if defined(__cpp_lib_format)
+inline std::format_context::iterator copy_text(const char* begin, const char* end, std::format_context::iterator out)
+{
+    return std::format_to(out, "{}", std::string_view(begin, end - begin));
+}
+#endif
+#if defined(FMT_VERSION)
+inline fmt::appender copy_text(const char* begin, const char* end, fmt::appender out)
+{
+    return fmt::format_to(out, "{}", fmt::string_view(begin, end - begin));
+}
+#endif
+
+template <typename OutputIterator>
+OutputIterator format_rcnb(OutputIterator out, const formatted_bytes& bytes, const format_spec& spec)
+{
+    // every byte takes two code points, whatever the pairing
+    std::size_t units = 2 * bytes.size;
+    std::size_t length = units + (spec.wrap > 0 && units > 0 ? (units - 1) / spec.wrap : 0);
+    std::size_t padding = spec.width > length ? spec.width - length : 0;
+    std::size_t before = spec.align == '>' ? padding : spec.align == '^' ? padding / 2 : 0;
+    out = std::fill_n(out, before, spec.fill);
+
+    rcnb_encodestate state;
+    rcnb_init_encodestate_alphabet(&state, bytes.alphabet);
+    // a chunk's code, and its UTF-8 of at most three bytes a code point and a line break after each
+    wchar_t code[2 * RCNB_FORMAT_CHUNK + 1];
+    char text[4 * 2 * RCNB_FORMAT_CHUNK];
+    std::size_t column = 0;
+    // the chunks, then one more round for the byte the state holds back
+    for (std::size_t i = 0; i < bytes.size + RCNB_FORMAT_CHUNK; i += RCNB_FORMAT_CHUNK) {
+        std::size_t code_length = i < bytes.size
+            ? rcnb_encode_block(bytes.data + i, std::min<std::size_t>(RCNB_FORMAT_CHUNK, bytes.size - i), code, &state)
+            : rcnb_encode_blockend(code, &state);
+        char* text_char = text;
+        for (std::size_t j = 0; j < code_length; ++j) {
+            if (spec.wrap > 0 && column == spec.wrap) {
+                *text_char++ = '\n';
+                column = 0;
+            }
+            unsigned long value = static_cast<unsigned long>(code[j]);
+            if (value < 0x80) {
+                *text_char++ = static_cast<char>(value);
+            } else if (value < 0x800) {
+                *text_char++ = static_cast<char>(0xC0 | value >> 6);
+                *text_char++ = static_cast<char>(0x80 | (value & 0x3F));
+            } else {
+                *text_char++ = static_cast<char>(0xE0 | value >> 12);
+                *text_char++ = static_cast<char>(0x80 | (value >> 6 & 0x3F));
+                *text_char++ = static_cast<char>(0x80 | (value & 0x3F));
+            }
+            ++column;
+        }
+        out = copy_text(text, text_char, out);
+    }
+    return std::fill_n(out, padding - before, spec.fill);
+}
+
+} // namespace rcnb
+
+#if defined(__cpp_lib_format)
+template <>
+struct std::formatter<rcnb::formatted_bytes, char> {
+    rcnb::format_spec _spec;
+
+    constexpr auto parse(std::format_parse_context& ctx)
+    {
+        bool ok = true;
+        auto it = rcnb::parse_format_spec(ctx.begin(), ctx.end(), _spec, ok);
+        if (!ok)
+            throw std::format_error("invalid format spec for rcnb::as_rcnb");
+        return it;
+    }
+
+    template <typename FormatContext>
+    auto format(const rcnb::formatted_bytes& bytes, FormatContext& ctx) const
+    {
+        return rcnb::format_rcnb(ctx.out(), bytes, _spec);
+    }
+};
+#endif
+
+#if defined(FMT_VERSION)
+template <>
+struct fmt::formatter<rcnb::formatted_bytes> {
+    rcnb::format_spec _spec;
+
+    FMT_CONSTEXPR auto parse(fmt::format_parse_context& ctx) -> decltype(ctx.begin())
+    {
+        bool ok = true;
+        auto it = rcnb::parse_format_spec(ctx.begin(), ctx.end(), _spec, ok);
+        if (!ok)
+            FMT_THROW(fmt::format_error("invalid format spec for rcnb::as_rcnb"));
+        return it;
+    }
+
+    template <typename FormatContext>
+    auto format(const rcnb::formatted_bytes& bytes, FormatContext& ctx) const -> decltype(ctx.out())
+    {
+        return rcnb::format_rcnb(ctx.out(), bytes, _spec);
+    }
+};
+#endif
+
+#endif /* RCNB_FORMAT_H */
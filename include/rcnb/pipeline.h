@@ -0,0 +1,63 @@
+// :mode=c++:
+
+/*
+pipeline.h - c++ helpers for running rcnb stages on separate threads
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#ifndef RCNB_PIPELINE_H
+#define RCNB_PIPELINE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace rcnb {
+
+// Bounded queue handing buffers from one pipeline stage to the next.
+template <typename T>
+class channel {
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::deque<T> _queue;
+    size_t _capacity;
+    bool _closed = false;
+
+public:
+    explicit channel(size_t capacity_in) : _capacity(capacity_in)
+    {
+    }
+
+    void push(T value)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cond.wait(lock, [this] { return _queue.size() < _capacity || _closed; });
+        _queue.push_back(std::move(value));
+        _cond.notify_all();
+    }
+
+    bool pop(T& value)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cond.wait(lock, [this] { return !_queue.empty() || _closed; });
+        if (_queue.empty())
+            return false;
+        value = std::move(_queue.front());
+        _queue.pop_front();
+        _cond.notify_all();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _cond.notify_all();
+    }
+};
+
+} // namespace rcnb
+
+#endif // RCNB_PIPELINE_H
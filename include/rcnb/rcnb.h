@@ -9,19 +9,31 @@ For details, see https://github.com/rikakomoe/librcnb
 #define RCNB_RCNB_H
 
 #include <stddef.h>
+#include <stdbool.h>
+#include <rcnb/calphabet.h>
 
-extern const wchar_t cr[];
-extern const wchar_t cc[];
-extern const wchar_t cn[];
-extern const wchar_t cb[];
+#ifndef RCNB_API
+#define RCNB_API
+#endif
 
-extern const unsigned short sr;
-extern const unsigned short sc;
-extern const unsigned short sn;
-extern const unsigned short sb;
+/* the alphabet of the plain rcnb_encode and rcnb_decode */
+#ifndef RCNB_SINGLE_H /* the header-only build defines it static */
+extern const rcnb_alphabet rcnb_builtin_alphabet;
+#endif
+
+/* alphabet sizes are constants so the divisions below compile to multiplications */
+#define sr RCNB_ALPHABET_R
+#define sc RCNB_ALPHABET_C
+#define sn RCNB_ALPHABET_N
+#define sb RCNB_ALPHABET_B
 
 #define src (sr * sc)
 #define snb (sn * sb)
 #define scnb (sc * snb)
 
+RCNB_API void rcnb_encode_short(unsigned short value_in, wchar_t** value_out, const rcnb_alphabet* alphabet);
+RCNB_API void rcnb_encode_byte(unsigned char value_in, wchar_t** value_out, const rcnb_alphabet* alphabet);
+RCNB_API bool rcnb_decode_short(const wchar_t* value_in, char** value_out, const rcnb_alphabet* alphabet);
+RCNB_API bool rcnb_decode_byte(const wchar_t* value_in, char** value_out, const rcnb_alphabet* alphabet);
+
 #endif // RCNB_RCNB_H
@@ -0,0 +1,255 @@
+// :mode=c++:
+
+/*
+views.h - c++20 range adaptors that encode and decode rcnb on demand
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+rcnb::views::encode turns a contiguous range of bytes into a random access
+range of its code units, and rcnb::views::decode turns a contiguous range of
+code units back into bytes, without encoding or decoding anything up front:
+
+    auto preview = rcnb::views::decode(code) | std::views::take(16);
+    bool png = std::ranges::equal(rcnb::views::decode(code) | std::views::take(4), magic);
+    wchar_t unit = (payload | rcnb::views::encode(alphabet))[1000000];
+
+As two bytes always take four code units, any position maps straight to its
+group. An iterator encodes or decodes the RCNB_VIEW_BLOCK bytes around the
+position it is read at, one batch of the vector kernels, and serves the
+following reads from that block, so a consumer that stops early has only
+touched the input it read. Reading invalid code throws std::runtime_error.
+*/
+
+#ifndef RCNB_VIEWS_H
+#define RCNB_VIEWS_H
+
+#if defined(__has_include)
+#if __has_include(<version>)
+#include <version>
+#endif
+#endif
+#if !defined(__cpp_lib_ranges)
+#error "rcnb/views.h requires C++20 ranges"
+#endif
+
+#include <algorithm>
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <ranges>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace rcnb {
+
+extern "C" {
+    #include "cencode.h"
+    #include "cdecode.h"
+}
+
+/* plaintext bytes an iterator encodes or decodes at a time, a power of two and a multiple of
+   the 32 byte batches of the kernels */
+#ifndef RCNB_VIEW_BLOCK
+#define RCNB_VIEW_BLOCK 32
+#endif
+
+// The bytes of a view and how to encode the block of code units starting at a multiple of block_size.
+struct encode_source {
+    using value_type = wchar_t;
+    static constexpr std::size_t block_size = 2 * RCNB_VIEW_BLOCK;
+
+    const char* data = nullptr;
+    std::size_t length = 0;
+    const rcnb_alphabet* alphabet = nullptr;
+
+    std::size_t size() const { return 2 * length; }
+
+    void fill(std::size_t first, wchar_t* code_out) const
+    {
+        std::size_t offset = first / 2;
+        rcnb_encode_range_alphabet(data, length, offset, std::min<std::size_t>(RCNB_VIEW_BLOCK, length - offset),
+                                   code_out, alphabet);
+    }
+};
+
+struct decode_source {
+    using value_type = char;
+    static constexpr std::size_t block_size = RCNB_VIEW_BLOCK;
+
+    const wchar_t* code = nullptr;
+    std::size_t length = 0;
+    const rcnb_alphabet* alphabet = nullptr;
+
+    std::size_t size() const { return length / 2; }
+
+    void fill(std::size_t first, char* plaintext_out) const
+    {
+        std::size_t count = std::min<std::size_t>(RCNB_VIEW_BLOCK, length / 2 - first);
+        if (rcnb_decode_range_alphabet(code, length, first, count, plaintext_out, alphabet) != (std::ptrdiff_t)count)
+            throw std::runtime_error("rcnb: invalid code");
+    }
+};
+
+// A random access iterator that keeps the block it was last read in, along with a copy of its source,
+// so it stays valid for as long as the underlying range does.
+template <typename Source>
+class block_iterator {
+public:
+    using value_type = typename Source::value_type;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::random_access_iterator_tag;
+    using iterator_category = std::input_iterator_tag;
+
+    block_iterator() = default;
+    block_iterator(const Source& source_in, difference_type index_in) : _source(source_in), _index(index_in) {}
+
+    value_type operator*() const
+    {
+        std::size_t index = static_cast<std::size_t>(_index);
+        std::size_t first = index & ~(Source::block_size - 1);
+        if (first != _first) {
+            _source.fill(first, _block);
+            _first = first;
+        }
+        return _block[index - first];
+    }
+    value_type operator[](difference_type n) const { return *(*this + n); }
+
+    block_iterator& operator++() { ++_index; return *this; }
+    block_iterator operator++(int) { block_iterator it = *this; ++_index; return it; }
+    block_iterator& operator--() { --_index; return *this; }
+    block_iterator operator--(int) { block_iterator it = *this; --_index; return it; }
+    block_iterator& operator+=(difference_type n) { _index += n; return *this; }
+    block_iterator& operator-=(difference_type n) { _index -= n; return *this; }
+
+    friend block_iterator operator+(block_iterator it, difference_type n) { return it += n; }
+    friend block_iterator operator+(difference_type n, block_iterator it) { return it += n; }
+    friend block_iterator operator-(block_iterator it, difference_type n) { return it -= n; }
+    friend difference_type operator-(const block_iterator& a, const block_iterator& b) { return a._index - b._index; }
+    friend bool operator==(const block_iterator& a, const block_iterator& b) { return a._index == b._index; }
+    friend std::strong_ordering operator<=>(const block_iterator& a, const block_iterator& b)
+    {
+        return a._index <=> b._index;
+    }
+
+private:
+    Source _source;
+    difference_type _index = 0;
+    // a first position no block starts at, until the first read
+    mutable std::size_t _first = 1;
+    // one more for the NUL the range functions write after the block
+    mutable value_type _block[Source::block_size + 1];
+};
+
+template <std::ranges::view V>
+    requires std::ranges::contiguous_range<V> && std::ranges::sized_range<V>
+             && (sizeof(std::ranges::range_value_t<V>) == 1)
+             && std::is_trivially_copyable_v<std::ranges::range_value_t<V>>
+class encode_view : public std::ranges::view_interface<encode_view<V>> {
+public:
+    using iterator = block_iterator<encode_source>;
+
+    encode_view() = default;
+    explicit encode_view(V base_in, const rcnb_alphabet* alphabet_in = nullptr)
+        : _base(std::move(base_in)), _alphabet(alphabet_in)
+    {
+    }
+
+    V base() const& { return _base; }
+    V base() && { return std::move(_base); }
+
+    iterator begin() const { return iterator(source(), 0); }
+    iterator end() const { return iterator(source(), (std::ptrdiff_t)size()); }
+    std::size_t size() const { return 2 * std::ranges::size(_base); }
+
+private:
+    encode_source source() const
+    {
+        return encode_source{reinterpret_cast<const char*>(std::ranges::data(_base)), std::ranges::size(_base),
+                             _alphabet};
+    }
+
+    V _base = V();
+    const rcnb_alphabet* _alphabet = nullptr;
+};
+
+template <std::ranges::view V>
+    requires std::ranges::contiguous_range<V> && std::ranges::sized_range<V>
+             && std::same_as<std::remove_cv_t<std::ranges::range_value_t<V>>, wchar_t>
+class decode_view : public std::ranges::view_interface<decode_view<V>> {
+public:
+    using iterator = block_iterator<decode_source>;
+
+    decode_view() = default;
+    explicit decode_view(V base_in, const rcnb_alphabet* alphabet_in = nullptr)
+        : _base(std::move(base_in)), _alphabet(alphabet_in)
+    {
+    }
+
+    V base() const& { return _base; }
+    V base() && { return std::move(_base); }
+
+    iterator begin() const { return iterator(source(), 0); }
+    iterator end() const { return iterator(source(), (std::ptrdiff_t)size()); }
+    // an odd number of code units is invalid, and throws once read
+    std::size_t size() const { return std::ranges::size(_base) / 2; }
+
+private:
+    decode_source source() const
+    {
+        return decode_source{std::ranges::data(_base), std::ranges::size(_base), _alphabet};
+    }
+
+    V _base = V();
+    const rcnb_alphabet* _alphabet = nullptr;
+};
+
+template <typename R>
+encode_view(R&&, const rcnb_alphabet* = nullptr) -> encode_view<std::views::all_t<R>>;
+template <typename R>
+decode_view(R&&, const rcnb_alphabet* = nullptr) -> decode_view<std::views::all_t<R>>;
+
+namespace views {
+
+// Called with a range, or with an alphabet to make a closure for the right of a pipe.
+template <template <typename> class View>
+struct adaptor {
+    const rcnb_alphabet* _alphabet = nullptr;
+
+    template <std::ranges::viewable_range R>
+    auto operator()(R&& range, const rcnb_alphabet* alphabet_in) const
+        -> View<std::views::all_t<R>>
+    {
+        return View<std::views::all_t<R>>(std::views::all(std::forward<R>(range)), alphabet_in);
+    }
+
+    template <std::ranges::viewable_range R>
+    auto operator()(R&& range) const -> View<std::views::all_t<R>>
+    {
+        return View<std::views::all_t<R>>(std::views::all(std::forward<R>(range)), _alphabet);
+    }
+
+    adaptor operator()(const rcnb_alphabet* alphabet_in) const { return adaptor{alphabet_in}; }
+
+    template <std::ranges::viewable_range R>
+    friend auto operator|(R&& range, const adaptor& closure) -> decltype(closure(std::forward<R>(range)))
+    {
+        return closure(std::forward<R>(range));
+    }
+};
+
+inline constexpr adaptor<encode_view> encode{};
+inline constexpr adaptor<decode_view> decode{};
+
+} // namespace views
+
+} // namespace rcnb
+
+template <typename V>
+inline constexpr bool std::ranges::enable_borrowed_range<rcnb::encode_view<V>> = std::ranges::enable_borrowed_range<V>;
+template <typename V>
+inline constexpr bool std::ranges::enable_borrowed_range<rcnb::decode_view<V>> = std::ranges::enable_borrowed_range<V>;
+
+#endif /* RCNB_VIEWS_H */
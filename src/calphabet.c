@@ -0,0 +1,92 @@
+/*
+calphabet.c - c source for custom rcnb alphabets
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/calphabet.h>
+#include <rcnb/rcnb.h>
+
+#include <string.h>
+
+static unsigned hash_slot(wchar_t unit, unsigned mul, unsigned add)
+{
+    return (unsigned short)((unsigned)unit * mul + add) >> 12;
+}
+
+// Looks for a multiplier, and if need be an offset, that sends every code point of a set to its own slot.
+static bool find_hash(const wchar_t* set, unsigned size, unsigned short* mul_out, unsigned short* add_out)
+{
+    for (unsigned k = 0; k < 32; ++k) {
+        unsigned add = (k * 40503u) & 0xFFFF;
+        for (unsigned mul = 1; mul < 0x10000; ++mul) {
+            unsigned used = 0;
+            unsigned i;
+            for (i = 0; i < size; ++i) {
+                unsigned slot = hash_slot(set[i], mul, add);
+                if (used & 1u << slot)
+                    break;
+                used |= 1u << slot;
+            }
+            if (i == size) {
+                *mul_out = (unsigned short)mul;
+                *add_out = (unsigned short)add;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool rcnb_init_alphabet(rcnb_alphabet* alphabet_out, const wchar_t* r, const wchar_t* c,
+        const wchar_t* n, const wchar_t* b)
+{
+    memset(alphabet_out, 0, sizeof(*alphabet_out));
+    memcpy(alphabet_out->r, r, sizeof(alphabet_out->r));
+    memcpy(alphabet_out->c, c, sizeof(alphabet_out->c));
+    memcpy(alphabet_out->n, n, sizeof(alphabet_out->n));
+    memcpy(alphabet_out->b, b, sizeof(alphabet_out->b));
+
+    const wchar_t* sets[4] = { alphabet_out->r, alphabet_out->c, alphabet_out->n, alphabet_out->b };
+    const unsigned sizes[4] = { sr, sc, sn, sb };
+    // the vector decoders narrow code units to 16 bits with signed saturation
+    for (int s = 0; s < 4; ++s) {
+        for (unsigned i = 0; i < sizes[s]; ++i) {
+            wchar_t unit = sets[s][i];
+            if (unit <= 0 || unit > 0x7FFF)
+                return false;
+            for (int t = 0; t <= s; ++t)
+                for (unsigned j = 0; j < (t == s ? i : sizes[t]); ++j)
+                    if (sets[t][j] == unit)
+                        return false;
+            alphabet_out->lo[s][i] = (unsigned char)(unit & 0xFF);
+            alphabet_out->hi[s][i] = (unsigned char)(unit >> 8);
+        }
+    }
+
+    alphabet_out->simd = true;
+    memset(alphabet_out->index, 0xFF, sizeof(alphabet_out->index));
+    for (int s = 0; s < 4; ++s) {
+        if (!find_hash(sets[s], sizes[s], &alphabet_out->mul[s], &alphabet_out->add[s])) {
+            alphabet_out->simd = false;
+            continue;
+        }
+        for (unsigned i = 0; i < sizes[s]; ++i)
+            alphabet_out->index[s][hash_slot(sets[s][i], alphabet_out->mul[s], alphabet_out->add[s])] =
+                    (unsigned char)i;
+    }
+    for (unsigned slot = 0; slot < 16; ++slot) {
+        if (alphabet_out->index[0][slot] == 0xFF)
+            continue;
+        wchar_t unit = alphabet_out->r[alphabet_out->index[0][slot]];
+        alphabet_out->check_lo[slot] = (unsigned char)(unit & 0xFF);
+        alphabet_out->check_hi[slot] = (unsigned char)(unit >> 8);
+    }
+    return true;
+}
+
+const rcnb_alphabet* rcnb_default_alphabet(void)
+{
+    return &rcnb_builtin_alphabet;
+}
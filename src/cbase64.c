@@ -0,0 +1,169 @@
+/*
+cbase64.c - c source to transcoding between base64 and rcnb
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/cbase64.h>
+#include <rcnb/cdecode.h>
+#include <rcnb/cencode.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Base64 digits read for one window of plaintext.
+#define BASE64_DIGITS (RCNB_BASE64_WINDOW / 3 * 4)
+
+static const char base64_digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// The value of each digit of either alphabet, 0xFF for anything else, so an invalid digit sets the top bit.
+static const unsigned char base64_values[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0x3E, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0x3F,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+size_t rcnb_base64_code_bound(size_t length_in)
+{
+    return 2 * 3 * ((length_in + 3) / 4) + 1;
+}
+
+size_t rcnb_base64_bound(size_t length_in)
+{
+    return 4 * ((length_in / 2 + 2) / 3) + 1;
+}
+
+// Decodes whole quanta of four digits, and a last two or three that make one or two bytes; -1 on anything that
+// is not a digit. The validity of the digits is gathered and checked once at the end.
+static ptrdiff_t decode_digits(const unsigned char* digits_in, size_t length_in, unsigned char* bytes_out)
+{
+    unsigned char* byte = bytes_out;
+    unsigned invalid = 0;
+    size_t i = 0;
+    for (; i + 4 <= length_in; i += 4) {
+        unsigned a = base64_values[digits_in[i]];
+        unsigned b = base64_values[digits_in[i + 1]];
+        unsigned c = base64_values[digits_in[i + 2]];
+        unsigned d = base64_values[digits_in[i + 3]];
+        invalid |= a | b | c | d;
+        uint32_t value = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | d;
+        byte[0] = (unsigned char)(value >> 16);
+        byte[1] = (unsigned char)(value >> 8);
+        byte[2] = (unsigned char)value;
+        byte += 3;
+    }
+    if (length_in - i == 1)
+        return -1;
+    if (length_in - i >= 2) {
+        unsigned a = base64_values[digits_in[i]];
+        unsigned b = base64_values[digits_in[i + 1]];
+        unsigned c = length_in - i == 3 ? base64_values[digits_in[i + 2]] : 0;
+        invalid |= a | b | c;
+        uint32_t value = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6;
+        *byte++ = (unsigned char)(value >> 16);
+        if (length_in - i == 3)
+            *byte++ = (unsigned char)(value >> 8);
+    }
+    return invalid & 0x80 ? -1 : byte - bytes_out;
+}
+
+// Encodes the bytes as digits, padding the last one or two; writes no NUL.
+static size_t encode_digits(const unsigned char* bytes_in, size_t length_in, char* digits_out)
+{
+    char* digit = digits_out;
+    size_t i = 0;
+    for (; i + 3 <= length_in; i += 3) {
+        uint32_t value = (uint32_t)bytes_in[i] << 16 | (uint32_t)bytes_in[i + 1] << 8 | bytes_in[i + 2];
+        digit[0] = base64_digits[value >> 18];
+        digit[1] = base64_digits[value >> 12 & 0x3F];
+        digit[2] = base64_digits[value >> 6 & 0x3F];
+        digit[3] = base64_digits[value & 0x3F];
+        digit += 4;
+    }
+    if (i < length_in) {
+        uint32_t value = (uint32_t)bytes_in[i] << 16 | (i + 1 < length_in ? (uint32_t)bytes_in[i + 1] << 8 : 0);
+        digit[0] = base64_digits[value >> 18];
+        digit[1] = base64_digits[value >> 12 & 0x3F];
+        digit[2] = i + 1 < length_in ? base64_digits[value >> 6 & 0x3F] : '=';
+        digit[3] = '=';
+        digit += 4;
+    }
+    return digit - digits_out;
+}
+
+ptrdiff_t rcnb_from_base64(const char* base64_in, size_t length_in, wchar_t* code_out)
+{
+    return rcnb_from_base64_alphabet(base64_in, length_in, code_out, NULL);
+}
+
+ptrdiff_t rcnb_from_base64_alphabet(const char* base64_in, size_t length_in, wchar_t* code_out,
+        const rcnb_alphabet* alphabet)
+{
+    // padding may only fill out the last quantum
+    size_t length = length_in;
+    while (length > 0 && length_in - length < 2 && base64_in[length - 1] == '=')
+        length--;
+    if (length != length_in && length_in % 4 != 0)
+        return -1;
+
+    rcnb_encodestate state;
+    rcnb_init_encodestate_alphabet(&state, alphabet);
+    unsigned char window[RCNB_BASE64_WINDOW];
+    wchar_t* code_char = code_out;
+    for (size_t i = 0; i < length; i += BASE64_DIGITS) {
+        size_t digits = length - i < BASE64_DIGITS ? length - i : BASE64_DIGITS;
+        ptrdiff_t bytes = decode_digits((const unsigned char*)base64_in + i, digits, window);
+        if (bytes < 0)
+            return -1;
+        code_char += rcnb_encode_block((const char*)window, bytes, code_char, &state);
+    }
+    code_char += rcnb_encode_blockend(code_char, &state);
+    return code_char - code_out;
+}
+
+ptrdiff_t rcnb_to_base64(const wchar_t* code_in, size_t length_in, char* base64_out)
+{
+    return rcnb_to_base64_alphabet(code_in, length_in, base64_out, NULL);
+}
+
+ptrdiff_t rcnb_to_base64_alphabet(const wchar_t* code_in, size_t length_in, char* base64_out,
+        const rcnb_alphabet* alphabet)
+{
+    rcnb_decodestate state;
+    rcnb_init_decodestate_alphabet(&state, alphabet);
+    // the decoders end with a NUL, after the byte rcnb_decode_blockend() may add
+    char window[RCNB_BASE64_WINDOW + 2];
+    char* base64_char = base64_out;
+    size_t i = 0;
+    while (true) {
+        size_t units = length_in - i < 2 * RCNB_BASE64_WINDOW ? length_in - i : 2 * RCNB_BASE64_WINDOW;
+        ptrdiff_t bytes = units > 0 ? rcnb_decode_block(code_in + i, units, window, &state) : 0;
+        if (bytes < 0)
+            return -1;
+        i += units;
+        if (i == length_in) {
+            ptrdiff_t end = rcnb_decode_blockend(window + bytes, &state);
+            if (end < 0)
+                return -1;
+            base64_char += encode_digits((const unsigned char*)window, bytes + end, base64_char);
+            break;
+        }
+        base64_char += encode_digits((const unsigned char*)window, bytes, base64_char);
+    }
+    *base64_char = 0;
+    return base64_char - base64_out;
+}
@@ -0,0 +1,263 @@
+/*
+ccompress.c - c source to the optional compression stage in front of rcnb
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/ccompress.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ENABLE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+bool rcnb_compress_supported(int method)
+{
+    switch (method) {
+        case RCNB_COMPRESS_NONE:
+            return true;
+#ifdef ENABLE_ZLIB
+        case RCNB_COMPRESS_ZLIB:
+            return true;
+#endif
+#ifdef ENABLE_ZSTD
+        case RCNB_COMPRESS_ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+int rcnb_compress_default_method(void)
+{
+#if defined(ENABLE_ZSTD)
+    return RCNB_COMPRESS_ZSTD;
+#elif defined(ENABLE_ZLIB)
+    return RCNB_COMPRESS_ZLIB;
+#else
+    return RCNB_COMPRESS_NONE;
+#endif
+}
+
+size_t rcnb_compress_bound(size_t length_in)
+{
+    // Covers both deflateBound and ZSTD_compressBound plus the flush and stream trailer overhead.
+    return length_in + (length_in >> 7) + 256;
+}
+
+bool rcnb_init_compressstate(rcnb_compressstate* state_in, int method, int level)
+{
+    state_in->method = method;
+    state_in->decompress = false;
+    state_in->finished = false;
+    state_in->stream = NULL;
+    switch (method) {
+        case RCNB_COMPRESS_NONE:
+            return true;
+#ifdef ENABLE_ZLIB
+        case RCNB_COMPRESS_ZLIB: {
+            z_stream* stream = (z_stream*)calloc(1, sizeof(z_stream));
+            if (!stream)
+                return false;
+            if (deflateInit(stream, level < 0 ? Z_DEFAULT_COMPRESSION : level) != Z_OK) {
+                free(stream);
+                return false;
+            }
+            state_in->stream = stream;
+            return true;
+        }
+#endif
+#ifdef ENABLE_ZSTD
+        case RCNB_COMPRESS_ZSTD: {
+            ZSTD_CCtx* stream = ZSTD_createCCtx();
+            if (!stream)
+                return false;
+            if (level >= 0)
+                ZSTD_CCtx_setParameter(stream, ZSTD_c_compressionLevel, level);
+            state_in->stream = stream;
+            return true;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+static ptrdiff_t compress_stream(const char* plaintext_in, size_t length_in, char* compressed_out, bool end,
+        rcnb_compressstate* state_in)
+{
+    size_t length_out = rcnb_compress_bound(length_in);
+    switch (state_in->method) {
+        case RCNB_COMPRESS_NONE:
+            memcpy(compressed_out, plaintext_in, length_in);
+            return length_in;
+#ifdef ENABLE_ZLIB
+        case RCNB_COMPRESS_ZLIB: {
+            z_stream* stream = (z_stream*)state_in->stream;
+            int res;
+            stream->next_in = (Bytef*)plaintext_in;
+            stream->avail_in = (uInt)length_in;
+            stream->next_out = (Bytef*)compressed_out;
+            stream->avail_out = (uInt)length_out;
+            // Flush every block so that the output of one call never exceeds rcnb_compress_bound.
+            res = deflate(stream, end ? Z_FINISH : Z_SYNC_FLUSH);
+            if (res != (end ? Z_STREAM_END : Z_OK) || stream->avail_in != 0 || stream->avail_out == 0)
+                return -1;
+            return (char*)stream->next_out - compressed_out;
+        }
+#endif
+#ifdef ENABLE_ZSTD
+        case RCNB_COMPRESS_ZSTD: {
+            ZSTD_inBuffer input = { plaintext_in, length_in, 0 };
+            ZSTD_outBuffer output = { compressed_out, length_out, 0 };
+            size_t res = ZSTD_compressStream2((ZSTD_CCtx*)state_in->stream, &output, &input,
+                    end ? ZSTD_e_end : ZSTD_e_flush);
+            if (ZSTD_isError(res) || res != 0 || input.pos != length_in)
+                return -1;
+            return (ptrdiff_t)output.pos;
+        }
+#endif
+        default:
+            return -1;
+    }
+}
+
+ptrdiff_t rcnb_compress_block(const char* plaintext_in, size_t length_in, char* compressed_out, rcnb_compressstate* state_in)
+{
+    if (length_in == 0)
+        return 0;
+    return compress_stream(plaintext_in, length_in, compressed_out, false, state_in);
+}
+
+ptrdiff_t rcnb_compress_blockend(char* compressed_out, rcnb_compressstate* state_in)
+{
+    ptrdiff_t res = compress_stream(NULL, 0, compressed_out, true, state_in);
+    rcnb_free_compressstate(state_in);
+    return res;
+}
+
+bool rcnb_init_decompressstate(rcnb_compressstate* state_in, int method)
+{
+    state_in->method = method;
+    state_in->decompress = true;
+    state_in->finished = method == RCNB_COMPRESS_NONE;
+    state_in->stream = NULL;
+    switch (method) {
+        case RCNB_COMPRESS_NONE:
+            return true;
+#ifdef ENABLE_ZLIB
+        case RCNB_COMPRESS_ZLIB: {
+            z_stream* stream = (z_stream*)calloc(1, sizeof(z_stream));
+            if (!stream)
+                return false;
+            if (inflateInit(stream) != Z_OK) {
+                free(stream);
+                return false;
+            }
+            state_in->stream = stream;
+            return true;
+        }
+#endif
+#ifdef ENABLE_ZSTD
+        case RCNB_COMPRESS_ZSTD: {
+            ZSTD_DCtx* stream = ZSTD_createDCtx();
+            if (!stream)
+                return false;
+            state_in->stream = stream;
+            return true;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+ptrdiff_t rcnb_decompress_block(const char** compressed_in, size_t* length_in, char* plaintext_out, size_t length_out,
+        rcnb_compressstate* state_in)
+{
+    switch (state_in->method) {
+        case RCNB_COMPRESS_NONE: {
+            size_t length = *length_in < length_out ? *length_in : length_out;
+            memcpy(plaintext_out, *compressed_in, length);
+            *compressed_in += length;
+            *length_in -= length;
+            return length;
+        }
+#ifdef ENABLE_ZLIB
+        case RCNB_COMPRESS_ZLIB: {
+            z_stream* stream = (z_stream*)state_in->stream;
+            stream->next_in = (Bytef*)*compressed_in;
+            stream->avail_in = (uInt)*length_in;
+            stream->next_out = (Bytef*)plaintext_out;
+            stream->avail_out = (uInt)length_out;
+            int res = inflate(stream, Z_NO_FLUSH);
+            if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR)
+                return -1;
+            // anything after the end of the deflate stream is not ours to decode
+            if (res == Z_STREAM_END && stream->avail_in != 0)
+                return -1;
+            state_in->finished = res == Z_STREAM_END;
+            *compressed_in = (const char*)stream->next_in;
+            *length_in = stream->avail_in;
+            return (char*)stream->next_out - plaintext_out;
+        }
+#endif
+#ifdef ENABLE_ZSTD
+        case RCNB_COMPRESS_ZSTD: {
+            ZSTD_inBuffer input = { *compressed_in, *length_in, 0 };
+            ZSTD_outBuffer output = { plaintext_out, length_out, 0 };
+            size_t res = ZSTD_decompressStream((ZSTD_DCtx*)state_in->stream, &output, &input);
+            if (ZSTD_isError(res))
+                return -1;
+            // 0 once a frame is decoded and flushed, until the next one starts
+            state_in->finished = res == 0;
+            *compressed_in += input.pos;
+            *length_in -= input.pos;
+            return (ptrdiff_t)output.pos;
+        }
+#endif
+        default:
+            return -1;
+    }
+}
+
+bool rcnb_decompress_blockend(rcnb_compressstate* state_in)
+{
+    bool finished = state_in->finished;
+    rcnb_free_compressstate(state_in);
+    return finished;
+}
+
+void rcnb_free_compressstate(rcnb_compressstate* state_in)
+{
+    if (!state_in->stream)
+        return;
+    switch (state_in->method) {
+#ifdef ENABLE_ZLIB
+        case RCNB_COMPRESS_ZLIB:
+            if (state_in->decompress)
+                inflateEnd((z_stream*)state_in->stream);
+            else
+                deflateEnd((z_stream*)state_in->stream);
+            free(state_in->stream);
+            break;
+#endif
+#ifdef ENABLE_ZSTD
+        case RCNB_COMPRESS_ZSTD:
+            if (state_in->decompress)
+                ZSTD_freeDCtx((ZSTD_DCtx*)state_in->stream);
+            else
+                ZSTD_freeCCtx((ZSTD_CCtx*)state_in->stream);
+            break;
+#endif
+        default:
+            break;
+    }
+    state_in->stream = NULL;
+}
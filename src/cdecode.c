@@ -7,8 +7,44 @@ For details, see https://github.com/rikakomoe/librcnb
 
 #include <rcnb/cdecode.h>
 #include <rcnb/rcnb.h>
+#include "instrument.h"
 
-int find(const wchar_t* const arr, const unsigned length, const wchar_t target)
+#include <string.h>
+
+// Code units checked for combining marks at a time, and composed at a time from one on.
+#define COMPOSE_SPAN 4096
+#define COMPOSE_WINDOW 256
+
+typedef struct
+{
+    wchar_t base;
+    wchar_t mark;
+    wchar_t composed;
+} composition;
+
+// The letters of the built-in alphabet that canonical decomposition splits into a base letter and a mark, each in
+// the slot of ((base << 8 ^ mark) * 515 mod 2^16) >> 10, which no two of them share.
+#define COMPOSE_HASH(base, mark) ((((unsigned)(base) << 8 ^ (unsigned)(mark)) * 515 & 0xFFFF) >> 10)
+static const composition compositions[64] = {
+    {0, 0, 0}, {0, 0, 0}, {'R', 0x030C, L'Ř'}, {'C', 0x0327, L'Ç'},
+    {'R', 0x030F, L'Ȑ'}, {'R', 0x0311, L'Ȓ'}, {0, 0, 0}, {0, 0, 0},
+    {'c', 0x0301, L'ć'}, {'c', 0x0302, L'ĉ'}, {0, 0, 0}, {'c', 0x0307, L'ċ'},
+    {0, 0, 0}, {'N', 0x0327, L'Ņ'}, {'c', 0x030C, L'č'}, {0, 0, 0},
+    {'R', 0x0327, L'Ŗ'}, {'n', 0x0300, L'ǹ'}, {'n', 0x0301, L'ń'}, {0, 0, 0},
+    {0, 0, 0}, {'r', 0x0301, L'ŕ'}, {0, 0, 0}, {'n', 0x030C, L'ň'},
+    {0, 0, 0}, {0, 0, 0}, {'r', 0x030C, L'ř'}, {0, 0, 0},
+    {'r', 0x030F, L'ȑ'}, {'r', 0x0311, L'ȓ'}, {0, 0, 0}, {0, 0, 0},
+    {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+    {0, 0, 0}, {'n', 0x0327, L'ņ'}, {0, 0, 0}, {0, 0, 0},
+    {'r', 0x0327, L'ŗ'}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+    {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+    {'C', 0x0301, L'Ć'}, {'C', 0x0302, L'Ĉ'}, {0, 0, 0}, {'C', 0x0307, L'Ċ'},
+    {0, 0, 0}, {0, 0, 0}, {'C', 0x030C, L'Č'}, {0, 0, 0},
+    {0, 0, 0}, {'N', 0x0300, L'Ǹ'}, {'N', 0x0301, L'Ń'}, {'N', 0x0303, L'Ñ'},
+    {0, 0, 0}, {'R', 0x0301, L'Ŕ'}, {0, 0, 0}, {'N', 0x030C, L'Ň'},
+};
+
+static int find(const wchar_t* const arr, const unsigned length, const wchar_t target)
 {
     for (const wchar_t* iter = arr; iter != arr + length; ++iter) {
         if (*iter == target)
@@ -18,24 +54,50 @@ int find(const wchar_t* const arr, const unsigned length, const wchar_t target)
 }
 
 void rcnb_init_decodestate(rcnb_decodestate* state_in)
+{
+    rcnb_init_decodestate_alphabet(state_in, NULL);
+}
+
+void rcnb_init_decodestate_alphabet(rcnb_decodestate* state_in, const rcnb_alphabet* alphabet)
 {
     state_in->i = 0;
+    state_in->coalesce = false;
+    state_in->pending_length = 0;
+    state_in->compose = false;
+    state_in->holding = false;
+    state_in->alphabet = alphabet ? alphabet : &rcnb_builtin_alphabet;
+    rcnb_init_checksumstate(&state_in->checksum, RCNB_CHECKSUM_NONE);
+}
+
+void rcnb_decode_set_checksum(rcnb_decodestate* state_in, int method)
+{
+    rcnb_init_checksumstate(&state_in->checksum, method);
+}
+
+void rcnb_decode_set_coalesce(rcnb_decodestate* state_in, bool coalesce)
+{
+    state_in->coalesce = coalesce;
+}
+
+void rcnb_decode_set_compose(rcnb_decodestate* state_in, bool compose)
+{
+    state_in->compose = compose;
 }
 
-bool rcnb_decode_short(const wchar_t* value_in, char** value_out)
+bool rcnb_decode_short(const wchar_t* value_in, char** value_out, const rcnb_alphabet* alphabet)
 {
-    bool reverse = find(cr, sr, *value_in) < 0;
+    bool reverse = find(alphabet->r, sr, *value_in) < 0;
     int idx[4];
     if (!reverse) {
-        idx[0] = find(cr, sr, *value_in);
-        idx[1] = find(cc, sc, *(value_in + 1));
-        idx[2] = find(cn, sn, *(value_in + 2));
-        idx[3] = find(cb, sb, *(value_in + 3));
+        idx[0] = find(alphabet->r, sr, *value_in);
+        idx[1] = find(alphabet->c, sc, *(value_in + 1));
+        idx[2] = find(alphabet->n, sn, *(value_in + 2));
+        idx[3] = find(alphabet->b, sb, *(value_in + 3));
     } else {
-        idx[0] = find(cr, sr, *(value_in + 2));
-        idx[1] = find(cc, sc, *(value_in + 3));
-        idx[2] = find(cn, sn, *value_in);
-        idx[3] = find(cb, sb, *(value_in + 1));
+        idx[0] = find(alphabet->r, sr, *(value_in + 2));
+        idx[1] = find(alphabet->c, sc, *(value_in + 3));
+        idx[2] = find(alphabet->n, sn, *value_in);
+        idx[3] = find(alphabet->b, sb, *(value_in + 1));
     }
     if (idx[0] < 0 || idx[1] < 0 || idx[2] < 0 || idx[3] < 0)
         return false;
@@ -48,13 +110,13 @@ bool rcnb_decode_short(const wchar_t* value_in, char** value_out)
     return true;
 }
 
-bool rcnb_decode_byte(const wchar_t* value_in, char** value_out)
+bool rcnb_decode_byte(const wchar_t* value_in, char** value_out, const rcnb_alphabet* alphabet)
 {
     bool nb = false;
-    int idx[2] = { find(cr, sr, *value_in), find(cc, sc, *(value_in + 1)) };
+    int idx[2] = { find(alphabet->r, sr, *value_in), find(alphabet->c, sc, *(value_in + 1)) };
     if (idx[0] < 0 || idx[1] < 0) {
-        idx[0] = find(cn, sn, *value_in);
-        idx[1] = find(cb, sb, *(value_in + 1));
+        idx[0] = find(alphabet->n, sn, *value_in);
+        idx[1] = find(alphabet->b, sb, *(value_in + 1));
         nb = true;
     }
     if (idx[0] < 0 || idx[1] < 0)
@@ -66,37 +128,68 @@ bool rcnb_decode_byte(const wchar_t* value_in, char** value_out)
     return true;
 }
 
-ptrdiff_t rcnb_decode_block(const wchar_t* code_in, size_t length_in,
+static ptrdiff_t decode_block(const wchar_t* code_in, size_t length_in,
         char* const plaintext_out, rcnb_decodestate* state_in)
 {
+    const rcnb_alphabet* alphabet = state_in->alphabet;
     char* plaintext_char = plaintext_out;
     bool res;
-    while (state_in->i < 4 && length_in > 0) {
-        state_in->trailing_code[state_in->i++] = code_in[0];
-        length_in--;
-        code_in++;
-    }
-    if (length_in == 0)
-        return 0;
-    res = rcnb_decode_short(state_in->trailing_code, &plaintext_char);
-    if (!res)
-        return -1;
-    state_in->i = 0;
+    // complete the group the previous block left off in, if any
+    if (state_in->i > 0) {
+        while (state_in->i < 4 && length_in > 0) {
+            state_in->trailing_code[state_in->i++] = code_in[0];
+            length_in--;
+            code_in++;
+        }
+        if (state_in->i < 4) {
+            *plaintext_char = 0;
+            return 0;
+        }
 #if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
-    size_t batch = length_in >> 6;
-    if (batch > 0) {
-        res = rcnb_decode_32n_asm((const char *)code_in, plaintext_char, batch);
+        if (alphabet->simd) {
+            res = rcnb_decode_tail_asm((const char *)state_in->trailing_code, plaintext_char, 1, alphabet);
+            RCNB_STAT_ADD(decode_simd_bytes, 2);
+        } else
+#endif
+        {
+            res = rcnb_decode_short(state_in->trailing_code, &plaintext_char, alphabet);
+            RCNB_STAT_ADD(decode_scalar_bytes, 2);
+        }
         if (!res)
             return -1;
+        plaintext_char = plaintext_out + 2;
+        state_in->i = 0;
     }
-    plaintext_char += 32 * batch;
-    code_in += 64 * batch;
-    length_in = length_in & 63;
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+    // alphabets without perfect hashes for the vector lookups decode on the scalar path
+    if (alphabet->simd) {
+        size_t batch = length_in >> 6;
+        if (batch > 0) {
+            res = rcnb_decode_32n_asm((const char *)code_in, plaintext_char, batch, alphabet);
+            if (!res)
+                return -1;
+        }
+        plaintext_char += 32 * batch;
+        code_in += 64 * batch;
+        size_t tail = (length_in & 63) >> 2;
+        if (tail > 0) {
+            res = rcnb_decode_tail_asm((const char *)code_in, plaintext_char, tail, alphabet);
+            if (!res)
+                return -1;
+        }
+        RCNB_STAT_ADD(decode_simd_bytes, 32 * batch + 2 * tail);
+        plaintext_char += 2 * tail;
+        code_in += 4 * tail;
+        length_in = length_in & 3;
+    } else
 #endif
-    for (int i = 0; i < (length_in >> 2); ++i) {
-        res = rcnb_decode_short(code_in + i * 4, &plaintext_char);
-        if (!res)
-            return -1;
+    {
+        for (size_t i = 0; i < (length_in >> 2); ++i) {
+            res = rcnb_decode_short(code_in + i * 4, &plaintext_char, alphabet);
+            if (!res)
+                return -1;
+        }
+        RCNB_STAT_ADD(decode_scalar_bytes, (length_in >> 2) * 2);
     }
     state_in->i = length_in % 4;
     for (size_t j = 0; j < state_in->i; ++j) {
@@ -106,26 +199,225 @@ ptrdiff_t rcnb_decode_block(const wchar_t* code_in, size_t length_in,
     return plaintext_char - plaintext_out;
 }
 
+static ptrdiff_t decode_slices(const wchar_t* code_in, size_t length_in,
+        char* const plaintext_out, rcnb_decodestate* state_in)
+{
+    if (state_in->checksum.method == RCNB_CHECKSUM_NONE)
+        return decode_block(code_in, length_in, plaintext_out, state_in);
+    // checksum each slice of plaintext while it is still in L1, right after the kernel wrote it
+    ptrdiff_t result = 0;
+    for (size_t i = 0; i < length_in; i += 2 * RCNB_CHECKSUM_SLICE) {
+        size_t slice = length_in - i < 2 * RCNB_CHECKSUM_SLICE ? length_in - i : 2 * RCNB_CHECKSUM_SLICE;
+        ptrdiff_t plain_length = decode_block(code_in + i, slice, plaintext_out + result, state_in);
+        if (plain_length < 0)
+            return -1;
+        rcnb_checksum_update(&state_in->checksum, plaintext_out + result, plain_length);
+        result += plain_length;
+    }
+    return result;
+}
+
+// Passes on whole batches only, the same way as the coalescing encoder. As the pending code always starts
+// a group, the kernels see whole groups however the blocks split them.
+static ptrdiff_t decode_coalesced(const wchar_t* code_in, size_t length_in,
+        char* const plaintext_out, rcnb_decodestate* state_in)
+{
+    const size_t N = 2 * RCNB_DECODE_COALESCE_BYTES;
+    ptrdiff_t result = 0;
+    if (state_in->pending_length > 0 || length_in < N) {
+        size_t length = N - state_in->pending_length;
+        if (length > length_in)
+            length = length_in;
+        memcpy(state_in->pending + state_in->pending_length, code_in, length * sizeof(wchar_t));
+        state_in->pending_length += length;
+        code_in += length;
+        length_in -= length;
+        if (state_in->pending_length < N) {
+            *plaintext_out = 0;
+            return 0;
+        }
+        result = decode_slices(state_in->pending, N, plaintext_out, state_in);
+        state_in->pending_length = 0;
+        if (result < 0)
+            return -1;
+    }
+    size_t body = length_in & ~(N - 1);
+    if (body > 0) {
+        ptrdiff_t plain_length = decode_slices(code_in, body, plaintext_out + result, state_in);
+        if (plain_length < 0)
+            return -1;
+        result += plain_length;
+    }
+    memcpy(state_in->pending, code_in + body, (length_in - body) * sizeof(wchar_t));
+    state_in->pending_length = length_in - body;
+    plaintext_out[result] = 0;
+    return result;
+}
+
+static ptrdiff_t decode_units(const wchar_t* code_in, size_t length_in,
+        char* const plaintext_out, rcnb_decodestate* state_in)
+{
+    return state_in->coalesce ? decode_coalesced(code_in, length_in, plaintext_out, state_in)
+                              : decode_slices(code_in, length_in, plaintext_out, state_in);
+}
+
+static bool is_mark(wchar_t unit)
+{
+    return (unsigned long)unit - 0x300 < 0x70;
+}
+
+// Returns the letter a base letter and a mark compose to, or 0 if they do not; the empty slots never match a mark.
+static wchar_t compose(wchar_t base, wchar_t mark)
+{
+    const composition* slot = &compositions[COMPOSE_HASH(base, mark)];
+    return slot->base == base && slot->mark == mark ? slot->composed : 0;
+}
+
+// Returns the offset of the first combining mark in the code, or length_in if there is none.
+static size_t find_mark(const wchar_t* code_in, size_t length_in)
+{
+    size_t i = 0;
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+    i = 16 * rcnb_find_mark_16n_asm((const char *)code_in, length_in >> 4);
+#endif
+    for (; i < length_in; ++i) {
+        if (is_mark(code_in[i]))
+            return i;
+    }
+    return length_in;
+}
+
+static ptrdiff_t decode_held(char* const plaintext_out, rcnb_decodestate* state_in)
+{
+    if (!state_in->holding)
+        return 0;
+    state_in->holding = false;
+    return decode_units(&state_in->held, 1, plaintext_out, state_in);
+}
+
+// Code without marks goes on to the kernels as it is, checked a span at a time so that it is still in cache when
+// they read it. From a mark on, a window of code is composed into a buffer first, a mark that does not compose
+// with its letter staying in it for the decoders to reject. The unit before a mark, and the last unit of the
+// block, which a mark at the start of the next block may belong to, are held back until the mark is known.
+static ptrdiff_t decode_composing(const wchar_t* code_in, size_t length_in,
+        char* const plaintext_out, rcnb_decodestate* state_in)
+{
+    ptrdiff_t result = 0;
+    size_t i = 0;
+    while (i < length_in) {
+        size_t span = length_in - i < COMPOSE_SPAN ? length_in - i : COMPOSE_SPAN;
+        size_t clean = find_mark(code_in + i, span);
+        if (clean > 0) {
+            size_t direct = i + clean == length_in || is_mark(code_in[i + clean]) ? clean - 1 : clean;
+            ptrdiff_t held_length = decode_held(plaintext_out + result, state_in);
+            if (held_length < 0)
+                return -1;
+            result += held_length;
+            ptrdiff_t plain_length = decode_units(code_in + i, direct, plaintext_out + result, state_in);
+            if (plain_length < 0)
+                return -1;
+            result += plain_length;
+            i += direct;
+            if (direct < clean) {
+                state_in->held = code_in[i++];
+                state_in->holding = true;
+            }
+        }
+        if (i == length_in || !is_mark(code_in[i]))
+            continue;
+
+        wchar_t window[COMPOSE_WINDOW];
+        size_t n = 0;
+        if (state_in->holding)
+            window[n++] = state_in->held;
+        for (; i < length_in && n < COMPOSE_WINDOW; ++i) {
+            wchar_t composed = n > 0 && is_mark(code_in[i]) ? compose(window[n - 1], code_in[i]) : 0;
+            if (composed != 0)
+                window[n - 1] = composed;
+            else
+                window[n++] = code_in[i];
+        }
+        ptrdiff_t plain_length = decode_units(window, n - 1, plaintext_out + result, state_in);
+        if (plain_length < 0)
+            return -1;
+        result += plain_length;
+        state_in->held = window[n - 1];
+        state_in->holding = true;
+    }
+    plaintext_out[result] = 0;
+    return result;
+}
+
+ptrdiff_t rcnb_decode_block(const wchar_t* code_in, size_t length_in,
+        char* const plaintext_out, rcnb_decodestate* state_in)
+{
+    RCNB_PROBE2(decode__block__entry, code_in, length_in);
+    RCNB_STAT_ADD(decode_calls, 1);
+    ptrdiff_t result = state_in->compose ? decode_composing(code_in, length_in, plaintext_out, state_in)
+                                         : decode_units(code_in, length_in, plaintext_out, state_in);
+    if (result < 0)
+        RCNB_STAT_ADD(decode_failures, 1);
+    RCNB_PROBE1(decode__block__return, result);
+    return result;
+}
+
 ptrdiff_t rcnb_decode_blockend(char* const plaintext_out, rcnb_decodestate* state_in)
 {
-    if (state_in->i != 0 && state_in->i != 2)
+    ptrdiff_t held_length = decode_held(plaintext_out, state_in);
+    if (held_length < 0) {
+        RCNB_STAT_ADD(decode_failures, 1);
         return -1;
-    char* plaintext_char = plaintext_out;
+    }
+    ptrdiff_t pending_length = held_length;
+    if (state_in->pending_length > 0) {
+        pending_length = decode_slices(state_in->pending, state_in->pending_length, plaintext_out + held_length,
+                state_in);
+        state_in->pending_length = 0;
+        if (pending_length < 0) {
+            RCNB_STAT_ADD(decode_failures, 1);
+            return -1;
+        }
+        pending_length += held_length;
+    }
+    if (state_in->i != 0 && state_in->i != 2) {
+        RCNB_STAT_ADD(decode_failures, 1);
+        return -1;
+    }
+    char* const plaintext_byte = plaintext_out + pending_length;
+    char* plaintext_char = plaintext_byte;
     if (state_in->i == 2) {
-        if(!rcnb_decode_byte(state_in->trailing_code, &plaintext_char))
+        if(!rcnb_decode_byte(state_in->trailing_code, &plaintext_char, state_in->alphabet)) {
+            RCNB_STAT_ADD(decode_failures, 1);
             return -1;
+        }
+        RCNB_STAT_ADD(decode_scalar_bytes, 1);
     }
     *plaintext_char = 0;
     state_in->i = 0;
+    rcnb_checksum_update(&state_in->checksum, plaintext_byte, plaintext_char - plaintext_byte);
     return plaintext_char - plaintext_out;
 }
 
+ptrdiff_t rcnb_decode_blockend_checksum(char* const plaintext_out, rcnb_decodestate* state_in,
+        uint64_t* checksum_out)
+{
+    ptrdiff_t plain_length = rcnb_decode_blockend(plaintext_out, state_in);
+    *checksum_out = rcnb_checksum_final(&state_in->checksum);
+    return plain_length;
+}
+
 ptrdiff_t rcnb_decode(const wchar_t* code_in, size_t length_in, char* plaintext_out)
+{
+    return rcnb_decode_alphabet(code_in, length_in, plaintext_out, NULL);
+}
+
+ptrdiff_t rcnb_decode_alphabet(const wchar_t* code_in, size_t length_in, char* plaintext_out,
+        const rcnb_alphabet* alphabet)
 {
     if (length_in == 0)
         return 0;
     rcnb_decodestate es;
-    rcnb_init_decodestate(&es);
+    rcnb_init_decodestate_alphabet(&es, alphabet);
     size_t output_size = 0;
     ptrdiff_t block_size = 0;
     block_size = rcnb_decode_block(code_in, length_in, plaintext_out, &es);
@@ -137,3 +429,48 @@ ptrdiff_t rcnb_decode(const wchar_t* code_in, size_t length_in, char* plaintext_
         return -1;
     return output_size + block_size;
 }
+
+ptrdiff_t rcnb_decode_range(const wchar_t* code_in, size_t length_in, size_t offset, size_t length,
+        char* plaintext_out)
+{
+    return rcnb_decode_range_alphabet(code_in, length_in, offset, length, plaintext_out, NULL);
+}
+
+ptrdiff_t rcnb_decode_range_alphabet(const wchar_t* code_in, size_t length_in, size_t offset, size_t length,
+        char* plaintext_out, const rcnb_alphabet* alphabet)
+{
+    size_t plain_length = length_in / 2;
+    if ((length_in & 1) || offset > plain_length || length > plain_length - offset)
+        return -1;
+    char* plaintext_char = plaintext_out;
+    char pair[3];
+    ptrdiff_t block_size;
+    if (length > 0 && (offset & 1)) {
+        // odd offsets start in the second byte of a full group
+        if (rcnb_decode_alphabet(code_in + 2 * offset - 2, 4, pair, alphabet) != 2)
+            return -1;
+        *plaintext_char++ = pair[1];
+        offset++;
+        length--;
+    }
+    if (offset + length == plain_length) {
+        // runs to the end of the payload, including a trailing single byte group
+        block_size = rcnb_decode_alphabet(code_in + 2 * offset, length_in - 2 * offset, plaintext_char, alphabet);
+        if (block_size != (ptrdiff_t)length)
+            return -1;
+        plaintext_char += length;
+    } else {
+        size_t pairs = length & ~(size_t)1;
+        block_size = rcnb_decode_alphabet(code_in + 2 * offset, 2 * pairs, plaintext_char, alphabet);
+        if (block_size != (ptrdiff_t)pairs)
+            return -1;
+        plaintext_char += pairs;
+        if (length & 1) {
+            if (rcnb_decode_alphabet(code_in + 2 * (offset + pairs), 4, pair, alphabet) != 2)
+                return -1;
+            *plaintext_char++ = pair[0];
+        }
+    }
+    *plaintext_char = 0;
+    return plaintext_char - plaintext_out;
+}
@@ -7,13 +7,80 @@ For details, see https://github.com/rikakomoe/librcnb
 
 #include <rcnb/cencode.h>
 #include <rcnb/rcnb.h>
+#include "instrument.h"
+#include "threshold.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <malloc.h>
+#endif
+
+static size_t stream_threshold = RCNB_STREAM_THRESHOLD;
+// set once the caller picks the threshold, which a profile then leaves alone
+static long threshold_chosen;
+
+// The threshold can be changed while other threads encode, which only need to see one value or the other.
+#if defined(_MSC_VER)
+#define load_threshold() ((size_t)_InterlockedCompareExchangePointer((void* volatile*)&stream_threshold, NULL, NULL))
+#define store_threshold(value) _InterlockedExchangePointer((void* volatile*)&stream_threshold, (void*)(value))
+#define load_chosen() _InterlockedCompareExchange((volatile long*)&threshold_chosen, 0, 0)
+#define store_chosen() _InterlockedExchange((volatile long*)&threshold_chosen, 1)
+#else
+#define load_threshold() __atomic_load_n(&stream_threshold, __ATOMIC_RELAXED)
+#define store_threshold(value) __atomic_store_n(&stream_threshold, value, __ATOMIC_RELAXED)
+#define load_chosen() __atomic_load_n(&threshold_chosen, __ATOMIC_RELAXED)
+#define store_chosen() __atomic_store_n(&threshold_chosen, 1, __ATOMIC_RELAXED)
+#endif
+
+RCNB_API void rcnb_store_stream_threshold(size_t length_in)
+{
+    store_threshold(length_in < RCNB_STREAM_THRESHOLD_MIN ? RCNB_STREAM_THRESHOLD_MIN : length_in);
+}
+
+RCNB_API bool rcnb_stream_threshold_chosen(void)
+{
+    return load_chosen() != 0;
+}
+
+void rcnb_set_stream_threshold(size_t length_in)
+{
+    rcnb_store_stream_threshold(length_in);
+    store_chosen();
+}
+
+size_t rcnb_get_stream_threshold(void)
+{
+    return load_threshold();
+}
 
 void rcnb_init_encodestate(rcnb_encodestate* state_in)
+{
+    rcnb_init_encodestate_alphabet(state_in, NULL);
+}
+
+void rcnb_init_encodestate_alphabet(rcnb_encodestate* state_in, const rcnb_alphabet* alphabet)
 {
     state_in->cached = false;
+    state_in->coalesce = false;
+    state_in->pending_length = 0;
+    state_in->alphabet = alphabet ? alphabet : &rcnb_builtin_alphabet;
+    rcnb_init_checksumstate(&state_in->checksum, RCNB_CHECKSUM_NONE);
+}
+
+void rcnb_encode_set_checksum(rcnb_encodestate* state_in, int method)
+{
+    rcnb_init_checksumstate(&state_in->checksum, method);
 }
 
-void rcnb_encode_short(unsigned short value_in, wchar_t** value_out)
+void rcnb_encode_set_coalesce(rcnb_encodestate* state_in, bool coalesce)
+{
+    state_in->coalesce = coalesce;
+}
+
+void rcnb_encode_short(unsigned short value_in, wchar_t** value_out, const rcnb_alphabet* alphabet)
 {
     bool reverse = false;
     if (value_in > 0x7FFF) {
@@ -22,53 +89,113 @@ void rcnb_encode_short(unsigned short value_in, wchar_t** value_out)
     }
     if (reverse)
         *value_out += 2;
-    *(*value_out)++ = cr[value_in / scnb];
-    *(*value_out)++ = cc[value_in % scnb / snb];
+    *(*value_out)++ = alphabet->r[value_in / scnb];
+    *(*value_out)++ = alphabet->c[value_in % scnb / snb];
     if (reverse)
         *value_out -= 4;
-    *(*value_out)++ = cn[value_in % snb / sb];
-    *(*value_out)++ = cb[value_in % sb];
+    *(*value_out)++ = alphabet->n[value_in % snb / sb];
+    *(*value_out)++ = alphabet->b[value_in % sb];
     if (reverse)
         *value_out += 2;
 }
 
-void rcnb_encode_byte(unsigned char value_in, wchar_t** value_out)
+void rcnb_encode_byte(unsigned char value_in, wchar_t** value_out, const rcnb_alphabet* alphabet)
 {
     if (value_in > 0x7F) {
         value_in = (unsigned char)(value_in & 0x7F);
-        *(*value_out)++ = cn[value_in / sb];
-        *(*value_out)++ = cb[value_in % sb];
+        *(*value_out)++ = alphabet->n[value_in / sb];
+        *(*value_out)++ = alphabet->b[value_in % sb];
         return;
     }
-    *(*value_out)++ = cr[value_in / sc];
-    *(*value_out)++ = cc[value_in % sc];
+    *(*value_out)++ = alphabet->r[value_in / sc];
+    *(*value_out)++ = alphabet->c[value_in % sc];
 }
 
-size_t rcnb_encode_block(const char* plaintext_in, size_t length_in,
-        wchar_t* const code_out, rcnb_encodestate* state_in)
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+static void rcnb_encode_byte_asm(unsigned char value_in, wchar_t** value_out, const rcnb_alphabet* alphabet)
+{
+    // The short b * snb (or 0x8000 | b for b > 0x7F) starts with the same two code units as the byte b.
+    unsigned short value = value_in > 0x7F ? (unsigned short)(0x8000 | (value_in & 0x7F))
+                                           : (unsigned short)(value_in * snb);
+    char pair[2] = { (char)(value >> 8), (char)(value & 0xFF) };
+    wchar_t code[4];
+    rcnb_encode_tail_asm(pair, (char *) code, 2, alphabet);
+    *(*value_out)++ = code[0];
+    *(*value_out)++ = code[1];
+}
+#endif
+
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+// Returns the number of leading plaintext bytes after which the code is RCNB_ALIGNMENT aligned, or -1 if it never is.
+static ptrdiff_t stream_lead(const wchar_t* code_out)
+{
+    for (ptrdiff_t lead = 0; lead < 32; lead += 2)
+        if ((uintptr_t)(code_out + 2 * lead) % RCNB_ALIGNMENT == 0)
+            return lead;
+    return -1;
+}
+#endif
+
+// With stream set, the bulk of the code is written with non-temporal stores.
+static size_t encode_block(const char* plaintext_in, size_t length_in,
+        wchar_t* const code_out, rcnb_encodestate* state_in, bool stream)
 {
     if (length_in == 0)
         return 0;
+    const rcnb_alphabet* alphabet = state_in->alphabet;
     wchar_t* code_char = code_out;
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
     if (state_in->cached) {
-        rcnb_encode_short(*(unsigned char*)(&state_in->trailing_byte) << 8 | *(unsigned char*)(&plaintext_in[0]),
-                &code_char);
+        char pair[2] = { state_in->trailing_byte, plaintext_in[0] };
+        rcnb_encode_tail_asm(pair, (char *) code_char, 2, alphabet);
+        RCNB_STAT_ADD(encode_simd_bytes, 2);
+        code_char += 4;
         plaintext_in++;
         length_in--;
         state_in->cached = false;
     }
-#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+    ptrdiff_t lead = stream ? stream_lead(code_char) : -1;
+    // a slice too short to reach the alignment is not worth streaming
+    if (lead > (ptrdiff_t)length_in)
+        lead = -1;
+    if (lead > 0) {
+        rcnb_encode_tail_asm(plaintext_in, (char *) code_char, lead, alphabet);
+        RCNB_STAT_ADD(encode_simd_bytes, lead);
+        plaintext_in += lead;
+        code_char += 2 * lead;
+        length_in -= lead;
+    }
     size_t batch = length_in >> 5;
-    if (batch > 0) {
-        rcnb_encode_32n_asm(plaintext_in, (char *) code_char, batch);
+    if (batch > 0 && lead >= 0) {
+        rcnb_encode_32n_stream_asm(plaintext_in, (char *) code_char, batch, alphabet);
+    } else if (batch > 0) {
+        rcnb_encode_32n_asm(plaintext_in, (char *) code_char, batch, alphabet);
     }
     plaintext_in += 32 * batch;
     code_char += 64 * batch;
-    length_in = length_in & 31;
-#endif
-    for (int i = 0; i < (length_in >> 1); ++i)
+    size_t tail = length_in & 30;
+    if (tail > 0) {
+        rcnb_encode_tail_asm(plaintext_in, (char *) code_char, tail, alphabet);
+    }
+    RCNB_STAT_ADD(encode_simd_bytes, 32 * batch + tail);
+    plaintext_in += tail;
+    code_char += 2 * tail;
+    length_in = length_in & 1;
+#else
+    (void)stream;
+    if (state_in->cached) {
+        rcnb_encode_short(*(unsigned char*)(&state_in->trailing_byte) << 8 | *(unsigned char*)(&plaintext_in[0]),
+                &code_char, alphabet);
+        RCNB_STAT_ADD(encode_scalar_bytes, 2);
+        plaintext_in++;
+        length_in--;
+        state_in->cached = false;
+    }
+    for (size_t i = 0; i < (length_in >> 1); ++i)
         rcnb_encode_short(*(unsigned char*)(&plaintext_in[i * 2]) << 8 | *(unsigned char*)(&plaintext_in[i * 2 + 1]),
-                &code_char);
+                &code_char, alphabet);
+    RCNB_STAT_ADD(encode_scalar_bytes, length_in & ~(size_t)1);
+#endif
     if (length_in & 1) {
         state_in->trailing_byte = plaintext_in[length_in - 1];
         state_in->cached = true;
@@ -77,23 +204,147 @@ size_t rcnb_encode_block(const char* plaintext_in, size_t length_in,
     return code_char - code_out;
 }
 
+static size_t encode_slices(const char* plaintext_in, size_t length_in,
+        wchar_t* const code_out, rcnb_encodestate* state_in, bool stream)
+{
+    if (state_in->checksum.method == RCNB_CHECKSUM_NONE)
+        return encode_block(plaintext_in, length_in, code_out, state_in, stream);
+    // checksum each slice right before the kernel reads it, so the plaintext crosses the memory bus once
+    size_t code_length = 0;
+    for (size_t i = 0; i < length_in; i += RCNB_CHECKSUM_SLICE) {
+        size_t slice = length_in - i < RCNB_CHECKSUM_SLICE ? length_in - i : RCNB_CHECKSUM_SLICE;
+        rcnb_checksum_update(&state_in->checksum, plaintext_in + i, slice);
+        code_length += encode_block(plaintext_in + i, slice, code_out + code_length, state_in, stream);
+    }
+    return code_length;
+}
+
+// Passes on whole batches only: a block is first used to fill up the pending batch, then its own whole
+// batches are encoded in place, and the rest waits for the next block.
+static size_t encode_coalesced(const char* plaintext_in, size_t length_in,
+        wchar_t* const code_out, rcnb_encodestate* state_in, bool stream)
+{
+    size_t code_length = 0;
+    if (state_in->pending_length > 0 || length_in < RCNB_ENCODE_COALESCE_BYTES) {
+        size_t length = RCNB_ENCODE_COALESCE_BYTES - state_in->pending_length;
+        if (length > length_in)
+            length = length_in;
+        memcpy(state_in->pending + state_in->pending_length, plaintext_in, length);
+        state_in->pending_length += length;
+        plaintext_in += length;
+        length_in -= length;
+        if (state_in->pending_length < RCNB_ENCODE_COALESCE_BYTES) {
+            *code_out = 0;
+            return 0;
+        }
+        code_length = encode_slices(state_in->pending, RCNB_ENCODE_COALESCE_BYTES, code_out, state_in,
+                false);
+        state_in->pending_length = 0;
+    }
+    size_t body = length_in & ~(size_t)(RCNB_ENCODE_COALESCE_BYTES - 1);
+    if (body > 0)
+        code_length += encode_slices(plaintext_in, body, code_out + code_length, state_in, stream);
+    memcpy(state_in->pending, plaintext_in + body, length_in - body);
+    state_in->pending_length = length_in - body;
+    code_out[code_length] = 0;
+    return code_length;
+}
+
+size_t rcnb_encode_block(const char* plaintext_in, size_t length_in,
+        wchar_t* const code_out, rcnb_encodestate* state_in)
+{
+    if (length_in == 0)
+        return 0;
+    RCNB_PROBE2(encode__block__entry, plaintext_in, length_in);
+    RCNB_STAT_ADD(encode_calls, 1);
+    bool stream = length_in >= load_threshold();
+    size_t code_length = state_in->coalesce ? encode_coalesced(plaintext_in, length_in, code_out, state_in, stream)
+                                            : encode_slices(plaintext_in, length_in, code_out, state_in, stream);
+    RCNB_PROBE1(encode__block__return, code_length);
+    return code_length;
+}
+
 size_t rcnb_encode_blockend(wchar_t* const code_out, rcnb_encodestate* state_in)
 {
     wchar_t* code_char = code_out;
+    if (state_in->pending_length > 0) {
+        code_char += encode_slices(state_in->pending, state_in->pending_length, code_char, state_in, false);
+        state_in->pending_length = 0;
+    }
     if (state_in->cached) {
-        rcnb_encode_byte(*(unsigned char*)(&state_in->trailing_byte), &code_char);
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+        rcnb_encode_byte_asm(*(unsigned char*)(&state_in->trailing_byte), &code_char, state_in->alphabet);
+        RCNB_STAT_ADD(encode_simd_bytes, 1);
+#else
+        rcnb_encode_byte(*(unsigned char*)(&state_in->trailing_byte), &code_char, state_in->alphabet);
+        RCNB_STAT_ADD(encode_scalar_bytes, 1);
+#endif
     }
     *code_char = 0;
     state_in->cached = false;
     return code_char - code_out;
 }
 
+size_t rcnb_encode_blockend_checksum(wchar_t* const code_out, rcnb_encodestate* state_in, uint64_t* checksum_out)
+{
+    size_t code_length = rcnb_encode_blockend(code_out, state_in);
+    *checksum_out = rcnb_checksum_final(&state_in->checksum);
+    return code_length;
+}
+
 size_t rcnb_encode(const char* plaintext_in, size_t length_in, wchar_t* code_out)
+{
+    return rcnb_encode_alphabet(plaintext_in, length_in, code_out, NULL);
+}
+
+size_t rcnb_encode_alphabet(const char* plaintext_in, size_t length_in, wchar_t* code_out,
+        const rcnb_alphabet* alphabet)
 {
     rcnb_encodestate es;
-    rcnb_init_encodestate(&es);
+    rcnb_init_encodestate_alphabet(&es, alphabet);
     size_t output_size = 0;
     output_size += rcnb_encode_block(plaintext_in, length_in, code_out, &es);
     output_size += rcnb_encode_blockend(code_out + output_size, &es);
     return output_size;
 }
+
+size_t rcnb_encode_range(const char* plaintext_in, size_t length_in, size_t offset, size_t length,
+        wchar_t* code_out)
+{
+    return rcnb_encode_range_alphabet(plaintext_in, length_in, offset, length, code_out, NULL);
+}
+
+size_t rcnb_encode_range_alphabet(const char* plaintext_in, size_t length_in, size_t offset, size_t length,
+        wchar_t* code_out, const rcnb_alphabet* alphabet)
+{
+    if (length == 0 || offset > length_in || length > length_in - offset)
+        return 0;
+    // widen the range to whole pairs, only the very last byte of the payload stands alone
+    size_t begin = offset & ~(size_t)1;
+    size_t end = offset + length;
+    if ((end & 1) && end < length_in)
+        end++;
+    return rcnb_encode_alphabet(plaintext_in + begin, end - begin, code_out, alphabet);
+}
+
+wchar_t* rcnb_alloc_code(size_t length_in)
+{
+    size_t size = (2 * length_in + 1) * sizeof(wchar_t);
+#ifdef _MSC_VER
+    return (wchar_t*) _aligned_malloc(size, RCNB_ALIGNMENT);
+#else
+    void* code = NULL;
+    if (posix_memalign(&code, RCNB_ALIGNMENT, size) != 0)
+        return NULL;
+    return (wchar_t*) code;
+#endif
+}
+
+void rcnb_free_code(wchar_t* code)
+{
+#ifdef _MSC_VER
+    _aligned_free(code);
+#else
+    free(code);
+#endif
+}
@@ -0,0 +1,305 @@
+/*
+cescape.c - c source to rcnb output in escaped form
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/cescape.h>
+#include <rcnb/cencode.h>
+#include <rcnb/cdecode.h>
+#include <stdint.h>
+#include <string.h>
+
+// Plaintext bytes per round trip through the kernels; the code stays in L1 until it is escaped.
+#define ESCAPE_CHUNK 1024
+
+// Escapes are looked up by code point, every one of the built-in alphabet lies below ESCAPE_TABLE.
+#define ESCAPE_TABLE 0x250
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ESCAPE_WORD_STORES 0
+#else
+#define ESCAPE_WORD_STORES 1
+#endif
+
+#define BUILTIN_ESCAPES(WORD) \
+    [0x72] = WORD(0x72), [0x52] = WORD(0x52), [0x154] = WORD(0x154), [0x155] = WORD(0x155), \
+    [0x156] = WORD(0x156), [0x157] = WORD(0x157), [0x158] = WORD(0x158), [0x159] = WORD(0x159), \
+    [0x1A6] = WORD(0x1A6), [0x210] = WORD(0x210), [0x211] = WORD(0x211), [0x212] = WORD(0x212), \
+    [0x213] = WORD(0x213), [0x24C] = WORD(0x24C), [0x24D] = WORD(0x24D), \
+    [0x63] = WORD(0x63), [0x43] = WORD(0x43), [0x106] = WORD(0x106), [0x107] = WORD(0x107), \
+    [0x108] = WORD(0x108), [0x109] = WORD(0x109), [0x10A] = WORD(0x10A), [0x10B] = WORD(0x10B), \
+    [0x10C] = WORD(0x10C), [0x10D] = WORD(0x10D), [0x187] = WORD(0x187), [0x188] = WORD(0x188), \
+    [0xC7] = WORD(0xC7), [0x23B] = WORD(0x23B), [0x23C] = WORD(0x23C), \
+    [0x6E] = WORD(0x6E), [0x4E] = WORD(0x4E), [0x143] = WORD(0x143), [0x144] = WORD(0x144), \
+    [0x145] = WORD(0x145), [0x146] = WORD(0x146), [0x147] = WORD(0x147), [0x148] = WORD(0x148), \
+    [0x19D] = WORD(0x19D), [0x19E] = WORD(0x19E), [0xD1] = WORD(0xD1), [0x1F8] = WORD(0x1F8), \
+    [0x1F9] = WORD(0x1F9), [0x220] = WORD(0x220), [0x235] = WORD(0x235), \
+    [0x62] = WORD(0x62), [0x42] = WORD(0x42), [0x180] = WORD(0x180), [0x181] = WORD(0x181), \
+    [0x183] = WORD(0x183), [0x184] = WORD(0x184), [0x185] = WORD(0x185), [0xDF] = WORD(0xDF), \
+    [0xDE] = WORD(0xDE), [0xFE] = WORD(0xFE)
+
+// An escape word holds the escape in its low bytes, first character first, and its length in the top byte.
+#define HEX(d) ((uint64_t)((d) < 10 ? '0' + (d) : 'A' - 10 + (d)))
+#define ASCII_WORD(u) ((uint64_t)(u) | (uint64_t)1 << 56)
+#define JSON_WORD(u) ((u) < 0x80 ? ASCII_WORD(u) \
+    : '\\' | 'u' << 8 | HEX((u) >> 12 & 15) << 16 | HEX((u) >> 8 & 15) << 24 \
+      | HEX((u) >> 4 & 15) << 32 | HEX((u) & 15) << 40 | (uint64_t)6 << 56)
+#define URL_WORD(u) ((u) < 0x80 ? ASCII_WORD(u) \
+    : '%' | HEX(0xC | (u) >> 10) << 8 | HEX((u) >> 6 & 15) << 16 | '%' << 24 \
+      | HEX(8 | ((u) >> 4 & 3)) << 32 | HEX((u) & 15) << 40 | (uint64_t)6 << 56)
+#define HTML_WORD(u) ((u) < 0x80 ? ASCII_WORD(u) \
+    : (u) < 0x100 ? '&' | '#' << 8 | 'x' << 16 | HEX((u) >> 4) << 24 | HEX((u) & 15) << 32 \
+                    | (uint64_t)';' << 40 | (uint64_t)6 << 56 \
+    : '&' | '#' << 8 | 'x' << 16 | HEX((u) >> 8) << 24 | HEX((u) >> 4 & 15) << 32 \
+      | HEX((u) & 15) << 40 | (uint64_t)';' << 48 | (uint64_t)7 << 56)
+
+static const uint64_t json_words[ESCAPE_TABLE] = { BUILTIN_ESCAPES(JSON_WORD) };
+static const uint64_t url_words[ESCAPE_TABLE] = { BUILTIN_ESCAPES(URL_WORD) };
+static const uint64_t html_words[ESCAPE_TABLE] = { BUILTIN_ESCAPES(HTML_WORD) };
+
+static const struct
+{
+    const char* name;
+    size_t length;
+    wchar_t value;
+} html_entities[] = {
+    {"Ccedil;", 7, 0xC7},
+    {"Ntilde;", 7, 0xD1},
+    {"THORN;", 6, 0xDE},
+    {"szlig;", 6, 0xDF},
+    {"thorn;", 6, 0xFE},
+};
+
+// Hex digit values plus one, so that every other character maps to -1 below.
+static const unsigned char hex_values[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+static int hex_value(char c)
+{
+    return hex_values[(unsigned char)c] - 1;
+}
+
+static const uint64_t* escape_words(int format)
+{
+    switch (format) {
+    case RCNB_ESCAPE_JSON:
+        return json_words;
+    case RCNB_ESCAPE_URL:
+        return url_words;
+    case RCNB_ESCAPE_HTML:
+        return html_words;
+    default:
+        return NULL;
+    }
+}
+
+// Escapes length_in code units, after which following more units are still to be written.
+static char* escape(const wchar_t* code_in, size_t length_in, size_t following, char* escaped_out,
+        const uint64_t* words)
+{
+    size_t i = 0;
+    if (ESCAPE_WORD_STORES && length_in + following > 7) {
+        // a whole word per unit; the 7 or more units after it overwrite whatever lands past its escape
+        size_t stores = length_in + following - 7 < length_in ? length_in + following - 7 : length_in;
+        for (; i < stores; ++i) {
+            uint64_t word = words[code_in[i]];
+            memcpy(escaped_out, &word, 8);
+            escaped_out += word >> 56;
+        }
+    }
+    for (; i < length_in; ++i) {
+        uint64_t word = words[code_in[i]];
+        for (unsigned j = 0; j < (word >> 56); ++j)
+            *escaped_out++ = (char)(word >> 8 * j);
+    }
+    return escaped_out;
+}
+
+// Encodes the chunk at offset, or flushes the state once offset has passed the last one.
+static size_t encode_chunk(const char* plaintext_in, size_t length_in, size_t offset, wchar_t* code_out,
+        rcnb_encodestate* state_in)
+{
+    if (offset + ESCAPE_CHUNK > length_in) {
+        size_t code_length = rcnb_encode_block(plaintext_in + offset, length_in - offset, code_out, state_in);
+        return code_length + rcnb_encode_blockend(code_out + code_length, state_in);
+    }
+    return rcnb_encode_block(plaintext_in + offset, ESCAPE_CHUNK, code_out, state_in);
+}
+
+size_t rcnb_escape_max(int format)
+{
+    switch (format) {
+    case RCNB_ESCAPE_JSON:
+        return 6;
+    case RCNB_ESCAPE_URL:
+        return 6;
+    case RCNB_ESCAPE_HTML:
+        return 7;
+    default:
+        return 0;
+    }
+}
+
+size_t rcnb_escape_bound(size_t length_in, int format)
+{
+    return 2 * length_in * rcnb_escape_max(format) + 1;
+}
+
+size_t rcnb_escaped_length(const char* plaintext_in, size_t length_in, int format)
+{
+    const uint64_t* words = escape_words(format);
+    if (!words)
+        return 0;
+    wchar_t code[2 * ESCAPE_CHUNK + 1];
+    rcnb_encodestate state;
+    rcnb_init_encodestate(&state);
+    size_t escaped_length = 0;
+    for (size_t i = 0; i <= length_in; i += ESCAPE_CHUNK) {
+        size_t code_length = encode_chunk(plaintext_in, length_in, i, code, &state);
+        for (size_t j = 0; j < code_length; ++j)
+            escaped_length += words[code[j]] >> 56;
+    }
+    return escaped_length;
+}
+
+size_t rcnb_encode_escaped(const char* plaintext_in, size_t length_in, char* escaped_out, int format)
+{
+    const uint64_t* words = escape_words(format);
+    if (!words)
+        return 0;
+    wchar_t code[2 * ESCAPE_CHUNK + 1];
+    rcnb_encodestate state;
+    rcnb_init_encodestate(&state);
+    char* escaped_char = escaped_out;
+    size_t following = 2 * length_in;
+    for (size_t i = 0; i <= length_in; i += ESCAPE_CHUNK) {
+        size_t code_length = encode_chunk(plaintext_in, length_in, i, code, &state);
+        following -= code_length;
+        escaped_char = escape(code, code_length, following, escaped_char, words);
+    }
+    *escaped_char = 0;
+    return escaped_char - escaped_out;
+}
+
+// Reads one escaped code unit, returns the number of characters it took or 0 if there is none.
+static size_t unescape_json(const char* escaped_in, size_t length_in, wchar_t* value_out)
+{
+    if (escaped_in[0] != '\\') {
+        *value_out = (unsigned char)escaped_in[0];
+        return escaped_in[0] & 0x80 ? 0 : 1;
+    }
+    if (length_in < 6 || escaped_in[1] != 'u')
+        return 0;
+    int digits[4] = { hex_value(escaped_in[2]), hex_value(escaped_in[3]),
+                      hex_value(escaped_in[4]), hex_value(escaped_in[5]) };
+    if ((digits[0] | digits[1] | digits[2] | digits[3]) < 0)
+        return 0;
+    *value_out = (wchar_t)(digits[0] << 12 | digits[1] << 8 | digits[2] << 4 | digits[3]);
+    return 6;
+}
+
+static int url_byte(const char* escaped_in, size_t length_in)
+{
+    if (length_in < 3 || escaped_in[0] != '%')
+        return -1;
+    int high = hex_value(escaped_in[1]);
+    int low = hex_value(escaped_in[2]);
+    return (high | low) < 0 ? -1 : high << 4 | low;
+}
+
+static size_t unescape_url(const char* escaped_in, size_t length_in, wchar_t* value_out)
+{
+    if (escaped_in[0] != '%') {
+        *value_out = (unsigned char)escaped_in[0];
+        return escaped_in[0] & 0x80 ? 0 : 1;
+    }
+    int lead = url_byte(escaped_in, length_in);
+    size_t count = lead >= 0xC2 && lead < 0xE0 ? 1 : lead >= 0xE0 && lead < 0xF0 ? 2 : 0;
+    if (count == 0 || length_in < 3 * (count + 1))
+        return 0;
+    unsigned long value = (unsigned long)lead & (count == 1 ? 0x1F : 0x0F);
+    for (size_t i = 1; i <= count; ++i) {
+        int trail = url_byte(escaped_in + 3 * i, length_in - 3 * i);
+        if ((trail & 0xC0) != 0x80)
+            return 0;
+        value = value << 6 | (unsigned long)(trail & 0x3F);
+    }
+    if (count == 2 && value < 0x800)
+        return 0;
+    *value_out = (wchar_t)value;
+    return 3 * (count + 1);
+}
+
+static size_t unescape_html(const char* escaped_in, size_t length_in, wchar_t* value_out)
+{
+    if (escaped_in[0] != '&') {
+        *value_out = (unsigned char)escaped_in[0];
+        return escaped_in[0] & 0x80 ? 0 : 1;
+    }
+    if (length_in > 1 && escaped_in[1] != '#') {
+        for (size_t i = 0; i < sizeof(html_entities) / sizeof(html_entities[0]); ++i) {
+            if (length_in > html_entities[i].length
+                && memcmp(escaped_in + 1, html_entities[i].name, html_entities[i].length) == 0) {
+                *value_out = html_entities[i].value;
+                return 1 + html_entities[i].length;
+            }
+        }
+        return 0;
+    }
+    bool hex = length_in > 2 && (escaped_in[2] == 'x' || escaped_in[2] == 'X');
+    size_t i = hex ? 3 : 2;
+    unsigned long value = 0;
+    // code points stop at 0xFFFF, which keeps value from overflowing and leading zeros bounded
+    for (; i < length_in && i < 12 && escaped_in[i] != ';'; ++i) {
+        int digit = hex ? hex_value(escaped_in[i]) : escaped_in[i] >= '0' && escaped_in[i] <= '9' ? escaped_in[i] - '0' : -1;
+        if (digit < 0)
+            return 0;
+        value = value * (hex ? 16 : 10) + (unsigned long)digit;
+        if (value > 0xFFFF)
+            return 0;
+    }
+    if (i == (hex ? 3u : 2u) || i >= length_in || escaped_in[i] != ';')
+        return 0;
+    *value_out = (wchar_t)value;
+    return i + 1;
+}
+
+ptrdiff_t rcnb_decode_escaped(const char* escaped_in, size_t length_in, char* plaintext_out, int format)
+{
+    if (!escape_words(format))
+        return -1;
+    wchar_t code[2 * ESCAPE_CHUNK];
+    size_t code_length = 0;
+    rcnb_decodestate state;
+    rcnb_init_decodestate(&state);
+    ptrdiff_t plain_length = 0;
+    ptrdiff_t block_length;
+    for (size_t i = 0; i < length_in;) {
+        size_t used = format == RCNB_ESCAPE_JSON ? unescape_json(escaped_in + i, length_in - i, &code[code_length])
+                    : format == RCNB_ESCAPE_URL ? unescape_url(escaped_in + i, length_in - i, &code[code_length])
+                    : unescape_html(escaped_in + i, length_in - i, &code[code_length]);
+        if (used == 0)
+            return -1;
+        i += used;
+        if (++code_length == 2 * ESCAPE_CHUNK) {
+            block_length = rcnb_decode_block(code, code_length, plaintext_out + plain_length, &state);
+            if (block_length < 0)
+                return -1;
+            plain_length += block_length;
+            code_length = 0;
+        }
+    }
+    block_length = rcnb_decode_block(code, code_length, plaintext_out + plain_length, &state);
+    if (block_length < 0)
+        return -1;
+    plain_length += block_length;
+    block_length = rcnb_decode_blockend(plaintext_out + plain_length, &state);
+    if (block_length < 0)
+        return -1;
+    return plain_length + block_length;
+}
@@ -0,0 +1,156 @@
+/*
+cframe.c - c source to the chunked rcnb container format
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/cframe.h>
+#include <rcnb/cencode.h>
+#include <rcnb/cdecode.h>
+#include <rcnb/cchecksum.h>
+#include <string.h>
+
+static const char frame_magic[4] = {'R', 'C', 'N', 'F'};
+static const char index_magic[4] = {'R', 'C', 'N', 'I'};
+
+static void put_be(char* bytes_out, uint64_t value_in, int size)
+{
+    for (int i = size - 1; i >= 0; --i) {
+        bytes_out[i] = (char)(value_in & 0xFF);
+        value_in >>= 8;
+    }
+}
+
+static uint64_t get_be(const char* bytes_in, int size)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < size; ++i)
+        value = value << 8 | *(unsigned char*)(&bytes_in[i]);
+    return value;
+}
+
+// Decodes a fixed size field of 2 * length_in code units.
+static bool decode_field(const wchar_t* code_in, size_t length_in, char* bytes_out)
+{
+    char bytes[17];
+    if (rcnb_decode(code_in, 2 * length_in, bytes) != (ptrdiff_t)length_in)
+        return false;
+    memcpy(bytes_out, bytes, length_in);
+    return true;
+}
+
+void rcnb_init_frameheader(rcnb_frameheader* header_in, uint32_t chunk_size)
+{
+    header_in->version = RCNB_FRAME_VERSION;
+    header_in->flags = 0;
+    // Keep chunks even so that no chunk but the last ends in a single byte.
+    header_in->chunk_size = (chunk_size + 1) & ~(uint32_t)1;
+}
+
+size_t rcnb_frame_write_header(const rcnb_frameheader* header_in, wchar_t* code_out)
+{
+    char bytes[12] = {0};
+    memcpy(bytes, frame_magic, 4);
+    bytes[4] = (char)header_in->version;
+    bytes[5] = (char)header_in->flags;
+    put_be(bytes + 8, header_in->chunk_size, 4);
+    return rcnb_encode(bytes, sizeof(bytes), code_out);
+}
+
+bool rcnb_frame_read_header(const wchar_t* code_in, rcnb_frameheader* header_out)
+{
+    char bytes[12];
+    if (!decode_field(code_in, sizeof(bytes), bytes))
+        return false;
+    if (memcmp(bytes, frame_magic, 4) != 0 || bytes[4] != RCNB_FRAME_VERSION)
+        return false;
+    header_out->version = (unsigned char)bytes[4];
+    header_out->flags = (unsigned char)bytes[5];
+    header_out->chunk_size = (uint32_t)get_be(bytes + 8, 4);
+    return header_out->chunk_size > 0 && (header_out->chunk_size & 1) == 0;
+}
+
+size_t rcnb_frame_chunk_length(size_t length_in)
+{
+    return RCNB_FRAME_CHUNK_HEADER_LENGTH + 2 * length_in;
+}
+
+size_t rcnb_frame_encode_chunk(const char* plaintext_in, size_t length_in, wchar_t* code_out)
+{
+    char bytes[8];
+    put_be(bytes, length_in, 4);
+    put_be(bytes + 4, rcnb_crc32c(0, plaintext_in, length_in), 4);
+    size_t code_length = rcnb_encode(bytes, sizeof(bytes), code_out);
+    return code_length + rcnb_encode(plaintext_in, length_in, code_out + code_length);
+}
+
+ptrdiff_t rcnb_frame_read_chunk_header(const wchar_t* code_in, uint32_t* crc_out)
+{
+    char bytes[8];
+    if (!decode_field(code_in, sizeof(bytes), bytes))
+        return -1;
+    if (crc_out)
+        *crc_out = (uint32_t)get_be(bytes + 4, 4);
+    return (ptrdiff_t)get_be(bytes, 4);
+}
+
+ptrdiff_t rcnb_frame_decode_chunk(const wchar_t* code_in, size_t length_in, char* plaintext_out)
+{
+    if (length_in < RCNB_FRAME_CHUNK_HEADER_LENGTH)
+        return -1;
+    uint32_t crc;
+    ptrdiff_t plain_length = rcnb_frame_read_chunk_header(code_in, &crc);
+    if (plain_length < 0 || rcnb_frame_chunk_length(plain_length) != length_in)
+        return -1;
+    if (rcnb_decode(code_in + RCNB_FRAME_CHUNK_HEADER_LENGTH, 2 * plain_length, plaintext_out) != plain_length)
+        return -1;
+    if (rcnb_crc32c(0, plaintext_out, plain_length) != crc)
+        return -1;
+    return plain_length;
+}
+
+size_t rcnb_frame_write_index_entry(uint64_t offset_in, wchar_t* code_out)
+{
+    char bytes[8];
+    put_be(bytes, offset_in, 8);
+    return rcnb_encode(bytes, sizeof(bytes), code_out);
+}
+
+bool rcnb_frame_read_index_entry(const wchar_t* code_in, uint64_t* offset_out)
+{
+    char bytes[8];
+    if (!decode_field(code_in, sizeof(bytes), bytes))
+        return false;
+    *offset_out = get_be(bytes, 8);
+    return true;
+}
+
+size_t rcnb_frame_write_footer(uint64_t index_offset, uint32_t chunks, wchar_t* code_out)
+{
+    char bytes[16];
+    put_be(bytes, index_offset, 8);
+    put_be(bytes + 8, chunks, 4);
+    memcpy(bytes + 12, index_magic, 4);
+    return rcnb_encode(bytes, sizeof(bytes), code_out);
+}
+
+ptrdiff_t rcnb_frame_read_footer(const wchar_t* code_in, uint64_t* index_offset_out)
+{
+    char bytes[16];
+    if (!decode_field(code_in, sizeof(bytes), bytes))
+        return -1;
+    if (memcmp(bytes + 12, index_magic, 4) != 0)
+        return -1;
+    *index_offset_out = get_be(bytes, 8);
+    return (ptrdiff_t)get_be(bytes + 8, 4);
+}
+
+size_t rcnb_utf8_length(const wchar_t* code_in, size_t length_in)
+{
+    // Every rcnb code point lies below U+0800.
+    size_t length = length_in;
+    for (size_t i = 0; i < length_in; ++i)
+        length += code_in[i] > 0x7F;
+    return length;
+}
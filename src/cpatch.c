@@ -0,0 +1,136 @@
+/*
+cpatch.c - c source to editing rcnb code in place
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/cpatch.h>
+#include <rcnb/cdecode.h>
+#include <rcnb/cencode.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+// Plaintext bytes at the end of an edit encoded into a buffer first, enough for a whole batch of the kernels.
+#define PATCH_LAST 32
+
+typedef struct
+{
+    const char* plaintext;
+    size_t length;
+} piece;
+
+static void add_piece(piece* pieces, size_t* count, const char* plaintext, size_t length)
+{
+    pieces[*count].plaintext = plaintext;
+    pieces[*count].length = length;
+    (*count)++;
+}
+
+// Encodes the pieces one after the other at code_out and returns the number of units written. The encoders end
+// their code with a NUL, which may not land on the code that follows, so the last bytes go through a buffer.
+static size_t encode_pieces(wchar_t* code_out, const piece* pieces, size_t count, const rcnb_alphabet* alphabet)
+{
+    rcnb_encodestate state;
+    rcnb_init_encodestate_alphabet(&state, alphabet);
+    wchar_t last[2 * PATCH_LAST + 4];
+    size_t last_length = 0;
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+        total += pieces[i].length;
+    size_t direct = total > PATCH_LAST ? total - PATCH_LAST : 0;
+
+    wchar_t* code_char = code_out;
+    size_t done = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const char* plaintext = pieces[i].plaintext;
+        size_t length = pieces[i].length;
+        if (done < direct) {
+            size_t now = direct - done < length ? direct - done : length;
+            code_char += rcnb_encode_block(plaintext, now, code_char, &state);
+            plaintext += now;
+            length -= now;
+            done += now;
+        }
+        last_length += rcnb_encode_block(plaintext, length, last + last_length, &state);
+        done += length;
+    }
+    last_length += rcnb_encode_blockend(last + last_length, &state);
+    memcpy(code_char, last, last_length * sizeof(wchar_t));
+    return code_char + last_length - code_out;
+}
+
+ptrdiff_t rcnb_splice_encoded(wchar_t* code_in, size_t code_length, size_t offset, size_t removed,
+        const char* plaintext_in, size_t inserted)
+{
+    return rcnb_splice_encoded_alphabet(code_in, code_length, offset, removed, plaintext_in, inserted, NULL);
+}
+
+ptrdiff_t rcnb_splice_encoded_alphabet(wchar_t* code_in, size_t code_length, size_t offset, size_t removed,
+        const char* plaintext_in, size_t inserted, const rcnb_alphabet* alphabet)
+{
+    size_t length = code_length / 2;
+    if ((code_length & 1) || offset > length || removed > length - offset)
+        return -1;
+    size_t tail = offset + removed;
+    size_t moved_tail = offset + inserted;
+    size_t new_length = length - removed + inserted;
+    if (removed == 0 && inserted == 0)
+        return (ptrdiff_t)code_length;
+
+    // the byte before the edit, when it shares a group with its first byte
+    char before[2];
+    size_t begin = offset & ~(size_t)1;
+    if ((offset & 1) && rcnb_decode_range_alphabet(code_in, code_length, begin, 1, before, alphabet) != 1)
+        return -1;
+    piece pieces[3];
+    size_t count = 0;
+    if (offset & 1)
+        add_piece(pieces, &count, before, 1);
+    add_piece(pieces, &count, plaintext_in, inserted);
+
+    if ((removed - inserted) & 1) {
+        // the rest of the payload pairs up the other way round, all of it has to be encoded again
+        char* rest = (char*)malloc(length - tail + 1);
+        if (rest == NULL)
+            return -1;
+        if (rcnb_decode_range_alphabet(code_in, code_length, tail, length - tail, rest, alphabet)
+            != (ptrdiff_t)(length - tail)) {
+            free(rest);
+            return -1;
+        }
+        add_piece(pieces, &count, rest, length - tail);
+        encode_pieces(code_in + 2 * begin, pieces, count, alphabet);
+        free(rest);
+        return (ptrdiff_t)(2 * new_length);
+    }
+
+    // the first byte after the edit, when it shares a group with its last byte, and the groups behind it
+    char after[2];
+    size_t rest = tail;
+    if ((tail & 1) && tail < length) {
+        if (rcnb_decode_range_alphabet(code_in, code_length, tail, 1, after, alphabet) != 1)
+            return -1;
+        add_piece(pieces, &count, after, 1);
+        rest++;
+    }
+    if (rest < length && moved_tail != tail)
+        memmove(code_in + 2 * (rest - tail + moved_tail), code_in + 2 * rest,
+                2 * (length - rest) * sizeof(wchar_t));
+    encode_pieces(code_in + 2 * begin, pieces, count, alphabet);
+    return (ptrdiff_t)(2 * new_length);
+}
+
+bool rcnb_patch_encoded(wchar_t* code_in, size_t code_length, size_t offset, const char* plaintext_in,
+        size_t length_in)
+{
+    return rcnb_patch_encoded_alphabet(code_in, code_length, offset, plaintext_in, length_in, NULL);
+}
+
+bool rcnb_patch_encoded_alphabet(wchar_t* code_in, size_t code_length, size_t offset, const char* plaintext_in,
+        size_t length_in, const rcnb_alphabet* alphabet)
+{
+    return rcnb_splice_encoded_alphabet(code_in, code_length, offset, length_in, plaintext_in, length_in,
+            alphabet) >= 0;
+}
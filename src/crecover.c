@@ -0,0 +1,203 @@
+/*
+crecover.c - c source to decoding damaged rcnb code
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/crecover.h>
+#include <rcnb/cdecode.h>
+#include <rcnb/rcnb.h>
+
+// Batches handed to the kernels at once; a span they reject is retried a batch at a time.
+#define RECOVER_SPAN 64
+
+// Positions after an invalid group searched for groups that decode again, and how many of them to try there.
+#define RESYNC_WINDOW 8
+#define RESYNC_LOOKAHEAD 16
+
+typedef struct
+{
+    const rcnb_recoveroptions* options;
+    const rcnb_alphabet* alphabet;
+    const wchar_t* code;
+    size_t length;
+    char* plaintext_char;
+    // the invalid run in progress, if any
+    bool invalid;
+    size_t start;
+    size_t runs;
+} recovery;
+
+void rcnb_init_recoveroptions(rcnb_recoveroptions* options_out)
+{
+    options_out->policy = RCNB_RECOVER_SUBSTITUTE;
+    options_out->substitute = '?';
+    options_out->alphabet = NULL;
+    options_out->report = NULL;
+    options_out->context = NULL;
+}
+
+static bool decode_group(const recovery* recovery_in, size_t offset, char* pair_out)
+{
+    return offset + 4 <= recovery_in->length && rcnb_decode_short(recovery_in->code + offset, &pair_out,
+                                                                   recovery_in->alphabet);
+}
+
+static bool decode_last_byte(const recovery* recovery_in, size_t offset, char* byte_out)
+{
+    return offset + 2 == recovery_in->length && rcnb_decode_byte(recovery_in->code + offset, &byte_out,
+                                                                 recovery_in->alphabet);
+}
+
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+// The kernels confirm every unit is the code point they decode it as, so a span they accept is valid as a whole.
+static bool decode_span(const wchar_t* code_in, char* plaintext_out, size_t batch, const rcnb_alphabet* alphabet)
+{
+    return rcnb_decode_32n_asm((const char *)code_in, plaintext_out, batch, alphabet) != 0;
+}
+#endif
+
+static void open_run(recovery* recovery_in, size_t offset)
+{
+    if (!recovery_in->invalid) {
+        recovery_in->invalid = true;
+        recovery_in->start = offset;
+    }
+}
+
+// Ends the invalid run in progress at offset, reporting it and writing its substitutes.
+static void close_run(recovery* recovery_in, size_t offset)
+{
+    if (!recovery_in->invalid)
+        return;
+    recovery_in->invalid = false;
+    recovery_in->runs++;
+    size_t length = offset - recovery_in->start;
+    const rcnb_recoveroptions* options = recovery_in->options;
+    if (options->report)
+        options->report(recovery_in->start, length, options->context);
+    if (options->policy == RCNB_RECOVER_SUBSTITUTE) {
+        for (size_t i = 0; i < length / 2; ++i)
+            *recovery_in->plaintext_char++ = options->substitute;
+    }
+}
+
+// How well decoding picks up at offset: the groups that decode in a row there, up to RESYNC_LOOKAHEAD, which
+// also stands for a row that runs cleanly into the end of the code.
+static size_t resync_score(const recovery* recovery_in, size_t offset)
+{
+    char pair[2];
+    size_t score = 0;
+    while (score < RESYNC_LOOKAHEAD && decode_group(recovery_in, offset, pair)) {
+        score++;
+        offset += 4;
+    }
+    if (score > 0 && (offset == recovery_in->length || decode_last_byte(recovery_in, offset, pair)))
+        score = RESYNC_LOOKAHEAD;
+    return score;
+}
+
+// Finds where to go on after the invalid group at offset. The next group comes first, since a mangled unit
+// leaves the alignment as it was. Failing that, the nearby position where the most groups decode in a row,
+// at least two; an r group wins a tie, as a run of r groups read two units off also decodes, as n groups.
+// A later position in the alignment already picked would only drop the groups before it.
+static size_t resync(const recovery* recovery_in, size_t offset)
+{
+    char pair[2];
+    if (decode_group(recovery_in, offset + 4, pair))
+        return offset + 4;
+    size_t best = offset + 4;
+    size_t best_score = 1;
+    bool best_reversed = true;
+    for (size_t next = offset + 1; next < offset + RESYNC_WINDOW; ++next) {
+        size_t score = resync_score(recovery_in, next);
+        if (score < 2 || (best_score >= 2 && (next - best) % 4 == 0))
+            continue;
+        decode_group(recovery_in, next, pair);
+        bool reversed = (pair[0] & 0x80) != 0;
+        if (score > best_score || (score == best_score && best_reversed && !reversed)) {
+            best = next;
+            best_score = score;
+            best_reversed = reversed;
+        }
+    }
+    return best;
+}
+
+// Decodes the groups from offset until fewer than four units are left before end, and returns where it
+// stopped, which resynchronizing may have moved past end.
+static size_t decode_groups(recovery* recovery_in, size_t offset, size_t end)
+{
+    char pair[2];
+    while (offset + 4 <= end) {
+        if (decode_group(recovery_in, offset, pair)) {
+            close_run(recovery_in, offset);
+            *recovery_in->plaintext_char++ = pair[0];
+            *recovery_in->plaintext_char++ = pair[1];
+            offset += 4;
+        } else {
+            open_run(recovery_in, offset);
+            offset = resync(recovery_in, offset);
+        }
+    }
+    return offset;
+}
+
+size_t rcnb_decode_recover(const wchar_t* code_in, size_t length_in, char* plaintext_out,
+        const rcnb_recoveroptions* options_in, size_t* invalid_out)
+{
+    recovery recovery_in;
+    recovery_in.options = options_in;
+    recovery_in.alphabet = options_in->alphabet ? options_in->alphabet : &rcnb_builtin_alphabet;
+    recovery_in.code = code_in;
+    recovery_in.length = length_in;
+    recovery_in.plaintext_char = plaintext_out;
+    recovery_in.invalid = false;
+    recovery_in.start = 0;
+    recovery_in.runs = 0;
+    size_t offset = 0;
+
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+    if (recovery_in.alphabet->simd) {
+        while (offset + 64 <= length_in) {
+            size_t batch = (length_in - offset) >> 6;
+            if (batch > RECOVER_SPAN)
+                batch = RECOVER_SPAN;
+            // an invalid run in progress has to be closed by the scalar path, which knows where it ends
+            if (!recovery_in.invalid &&
+                decode_span(code_in + offset, recovery_in.plaintext_char, batch, recovery_in.alphabet)) {
+                recovery_in.plaintext_char += 32 * batch;
+                offset += 64 * batch;
+                continue;
+            }
+            for (size_t end = offset + 64 * batch; offset + 64 <= end;) {
+                if (!recovery_in.invalid &&
+                    decode_span(code_in + offset, recovery_in.plaintext_char, 1, recovery_in.alphabet)) {
+                    recovery_in.plaintext_char += 32;
+                    offset += 64;
+                } else {
+                    offset = decode_groups(&recovery_in, offset, offset + 64);
+                }
+            }
+        }
+    }
+#endif
+
+    offset = decode_groups(&recovery_in, offset, length_in);
+    if (offset > length_in)
+        offset = length_in;
+    char byte;
+    if (offset < length_in && decode_last_byte(&recovery_in, offset, &byte)) {
+        close_run(&recovery_in, offset);
+        *recovery_in.plaintext_char++ = byte;
+    } else if (offset < length_in) {
+        open_run(&recovery_in, offset);
+    }
+    close_run(&recovery_in, length_in);
+
+    if (invalid_out)
+        *invalid_out = recovery_in.runs;
+    *recovery_in.plaintext_char = 0;
+    return recovery_in.plaintext_char - plaintext_out;
+}
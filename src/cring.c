@@ -0,0 +1,139 @@
+/*
+cring.c - c source to a lock-free ring of rcnb code between two threads
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/cring.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// The smallest ring, one batch of the SIMD kernels.
+#define RING_MINIMUM 64
+
+#if defined(_MSC_VER)
+#define load_acquire(counter) ((size_t)_InterlockedCompareExchangePointer((void* volatile*)(counter), NULL, NULL))
+#define store_release(counter, value) _InterlockedExchangePointer((void* volatile*)(counter), (void*)(value))
+#else
+#define load_acquire(counter) __atomic_load_n(counter, __ATOMIC_ACQUIRE)
+#define store_release(counter, value) __atomic_store_n(counter, value, __ATOMIC_RELEASE)
+#endif
+
+bool rcnb_init_ring(rcnb_ring* ring_in, size_t capacity)
+{
+    size_t units = RING_MINIMUM;
+    while (units < capacity)
+        units <<= 1;
+    // rcnb_alloc_code leaves one unit over for the NUL a block ending at the end of the buffer writes
+    ring_in->code = rcnb_alloc_code(units / 2);
+    if (ring_in->code == NULL)
+        return false;
+    ring_in->capacity = units;
+    ring_in->head = 0;
+    ring_in->closed = 0;
+    ring_in->tail = 0;
+    ring_in->staged = 0;
+    ring_in->tail_seen = 0;
+    rcnb_init_encodestate(&ring_in->state);
+    return true;
+}
+
+void rcnb_free_ring(rcnb_ring* ring_in)
+{
+    rcnb_free_code(ring_in->code);
+    ring_in->code = NULL;
+}
+
+// Units free at the producer's end of the ring as of the last tail it has seen, without wrapping. Each block
+// ends with a NUL, so a stretch that runs up to the consumer's tail gives up its last unit.
+static size_t room_before(const rcnb_ring* ring_in, size_t end)
+{
+    size_t free = ring_in->capacity - (ring_in->staged - ring_in->tail_seen);
+    if (free >= end)
+        return end;
+    return free > 0 ? free - 1 : 0;
+}
+
+// Only goes back to the consumer's cache line when what the producer knows is not enough for wanted units.
+static size_t contiguous_room(rcnb_ring* ring_in, size_t wanted)
+{
+    size_t end = ring_in->capacity - (ring_in->staged & (ring_in->capacity - 1));
+    size_t room = room_before(ring_in, end);
+    if (room < wanted && room < end) {
+        ring_in->tail_seen = load_acquire(&ring_in->tail);
+        room = room_before(ring_in, end);
+    }
+    return room;
+}
+
+size_t rcnb_ring_stage(rcnb_ring* ring_in, const char* plaintext_in, size_t length_in)
+{
+    size_t threshold = rcnb_get_stream_threshold();
+    size_t done = 0;
+    while (done < length_in) {
+        // the staged code is always whole groups, so each stretch of room takes whole pairs
+        size_t groups = contiguous_room(ring_in, 2 * (length_in - done) + 4) / 4;
+        if (groups == 0)
+            break;
+        size_t length = 2 * groups - (ring_in->state.cached ? 1 : 0);
+        if (length > length_in - done)
+            length = length_in - done;
+        // keep clear of the streaming stores, the consumer is about to read the code
+        if (length >= threshold)
+            length = threshold - 1;
+        ring_in->staged += rcnb_encode_block(plaintext_in + done, length,
+                ring_in->code + (ring_in->staged & (ring_in->capacity - 1)), &ring_in->state);
+        done += length;
+    }
+    return done;
+}
+
+void rcnb_ring_commit(rcnb_ring* ring_in)
+{
+    store_release(&ring_in->head, ring_in->staged);
+}
+
+size_t rcnb_ring_push(rcnb_ring* ring_in, const char* plaintext_in, size_t length_in)
+{
+    size_t length = rcnb_ring_stage(ring_in, plaintext_in, length_in);
+    rcnb_ring_commit(ring_in);
+    return length;
+}
+
+bool rcnb_ring_close(rcnb_ring* ring_in)
+{
+    if (ring_in->state.cached) {
+        // the last byte takes two units, and its NUL may not land on code the consumer still holds
+        if (contiguous_room(ring_in, 3) < 2)
+            return false;
+        ring_in->staged += rcnb_encode_blockend(ring_in->code + (ring_in->staged & (ring_in->capacity - 1)),
+                &ring_in->state);
+    }
+    rcnb_ring_commit(ring_in);
+    store_release(&ring_in->closed, 1);
+    return true;
+}
+
+size_t rcnb_ring_peek(rcnb_ring* ring_in, const wchar_t** code_out)
+{
+    size_t position = ring_in->tail & (ring_in->capacity - 1);
+    size_t length = load_acquire(&ring_in->head) - ring_in->tail;
+    if (length > ring_in->capacity - position)
+        length = ring_in->capacity - position;
+    *code_out = ring_in->code + position;
+    return length;
+}
+
+void rcnb_ring_release(rcnb_ring* ring_in, size_t length)
+{
+    store_release(&ring_in->tail, ring_in->tail + length);
+}
+
+bool rcnb_ring_finished(rcnb_ring* ring_in)
+{
+    // closed is published after the last head, so the head read after it is final
+    return load_acquire(&ring_in->closed) && load_acquire(&ring_in->head) == ring_in->tail;
+}
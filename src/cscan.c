@@ -0,0 +1,356 @@
+/*
+cscan.c - c source to finding rcnb code in ordinary text
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/cscan.h>
+#include <rcnb/cdecode.h>
+#include <rcnb/cencode.h>
+#include <rcnb/rcnb.h>
+
+#include <stdint.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Code units classified at a time while looking for a run, one bit each in a candidate mask.
+#define SCAN_BLOCK 64
+// Batches handed to the kernels at once while decoding a run.
+#define SCAN_SPAN 16
+// Code units of UTF-8 text decoded at a time; a run too short to report yet is scanned again with the next window.
+#define SCAN_WINDOW 4096
+
+#define CLASS_R 1
+#define CLASS_C 2
+#define CLASS_N 4
+#define CLASS_B 8
+
+typedef struct
+{
+    const rcnb_alphabet* alphabet;
+    size_t min_groups;
+    rcnb_run* runs;
+    size_t max_runs;
+    size_t count;
+    // the plaintext of rcnb_extract, NULL when it only goes to the scratch
+    char* plaintext_out;
+    char* plaintext_char;
+    char scratch[32 * SCAN_SPAN];
+    // the run being decoded; one that has min_groups groups is carried from a UTF-8 window to the next
+    bool open;
+    size_t start;
+    size_t groups;
+    char* run_plaintext;
+} scanner;
+
+void rcnb_init_scanoptions(rcnb_scanoptions* options_out)
+{
+    options_out->min_groups = 4;
+    options_out->alphabet = NULL;
+}
+
+static void init_scanner(scanner* scanner_in, const rcnb_scanoptions* options_in, rcnb_run* runs_out,
+        size_t max_runs, char* plaintext_out)
+{
+    rcnb_scanoptions options;
+    if (options_in)
+        options = *options_in;
+    else
+        rcnb_init_scanoptions(&options);
+    if (options.min_groups < 1)
+        options.min_groups = 1;
+    if (options.min_groups > RCNB_SCAN_MAX_GROUPS)
+        options.min_groups = RCNB_SCAN_MAX_GROUPS;
+    scanner_in->alphabet = options.alphabet ? options.alphabet : &rcnb_builtin_alphabet;
+    scanner_in->min_groups = options.min_groups;
+    scanner_in->runs = runs_out;
+    scanner_in->max_runs = max_runs;
+    scanner_in->count = 0;
+    scanner_in->plaintext_out = plaintext_out;
+    scanner_in->plaintext_char = plaintext_out;
+    scanner_in->open = false;
+}
+
+// Where the next plaintext goes, and moving past it once it is decoded.
+static char* output(scanner* scanner_in)
+{
+    return scanner_in->plaintext_out ? scanner_in->plaintext_char : scanner_in->scratch;
+}
+
+static void advance(scanner* scanner_in, size_t length)
+{
+    if (scanner_in->plaintext_out)
+        scanner_in->plaintext_char += length;
+}
+
+// The scalar classification, by the same hash lookup as the kernels, or by search for an alphabet that has none.
+static unsigned classify(const rcnb_alphabet* alphabet, wchar_t unit)
+{
+    const wchar_t* sets[4] = { alphabet->r, alphabet->c, alphabet->n, alphabet->b };
+    const unsigned sizes[4] = { sr, sc, sn, sb };
+    unsigned classes = 0;
+    for (int s = 0; s < 4; ++s) {
+        if (alphabet->simd) {
+            unsigned char i = alphabet->index[s][(unsigned short)((unsigned)unit * alphabet->mul[s] +
+                                                                  alphabet->add[s]) >> 12];
+            if (i != 0xFF && sets[s][i] == unit)
+                classes |= 1u << s;
+            continue;
+        }
+        for (unsigned i = 0; i < sizes[s]; ++i) {
+            if (sets[s][i] == unit) {
+                classes |= 1u << s;
+                break;
+            }
+        }
+    }
+    return classes;
+}
+
+// Sets bit i where a group could start at text_in[i]: an r or n, a c or b, an r or n and a c or b. Only the
+// first length - 3 bits can be set.
+static uint64_t candidates(const scanner* scanner_in, const wchar_t* text_in, size_t length)
+{
+    uint64_t first = 0;
+    uint64_t second = 0;
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+    if (length == SCAN_BLOCK && scanner_in->alphabet->simd) {
+        unsigned short masks[SCAN_BLOCK / 8];
+        rcnb_classify_16n_asm((const char *)text_in, masks, SCAN_BLOCK / 16, scanner_in->alphabet);
+        for (size_t k = 0; k < SCAN_BLOCK / 16; ++k) {
+            first |= (uint64_t)masks[2 * k] << 16 * k;
+            second |= (uint64_t)masks[2 * k + 1] << 16 * k;
+        }
+    } else
+#endif
+    {
+        for (size_t i = 0; i < length; ++i) {
+            unsigned classes = classify(scanner_in->alphabet, text_in[i]);
+            first |= (uint64_t)((classes & (CLASS_R | CLASS_N)) != 0) << i;
+            second |= (uint64_t)((classes & (CLASS_C | CLASS_B)) != 0) << i;
+        }
+    }
+    return first & second >> 1 & first >> 2 & second >> 3;
+}
+
+static unsigned lowest_bit(uint64_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward64(&i, mask);
+    return (unsigned)i;
+#else
+    return (unsigned)__builtin_ctzll(mask);
+#endif
+}
+
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+// The kernels look code units up by perfect hash without confirming them, so a span only counts as decoded
+// once its plaintext encodes back to the same code.
+static bool scan_span(const wchar_t* text_in, char* plaintext_out, size_t batch, const rcnb_alphabet* alphabet)
+{
+    wchar_t code[64 * SCAN_SPAN];
+    if (!rcnb_decode_32n_asm((const char *)text_in, plaintext_out, batch, alphabet))
+        return false;
+    rcnb_encode_32n_asm(plaintext_out, (char *)code, batch, alphabet);
+    return memcmp(code, text_in, 64 * batch * sizeof(wchar_t)) == 0;
+}
+#endif
+
+// Decodes the groups of the open run from offset on while they are valid, and returns where they end. It stops
+// short of the last three units of the window, where a group may be cut off.
+static size_t extend_run(scanner* scanner_in, const wchar_t* text_in, size_t offset, size_t length)
+{
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+    if (scanner_in->alphabet->simd) {
+        // whole spans while they decode, then single batches, and the batch the run ends in group by group
+        size_t span = SCAN_SPAN;
+        while (offset + 64 <= length) {
+            size_t batch = (length - offset) >> 6;
+            if (batch > span)
+                batch = span;
+            if (!scan_span(text_in + offset, output(scanner_in), batch, scanner_in->alphabet)) {
+                if (batch == 1)
+                    break;
+                span = 1;
+                continue;
+            }
+            advance(scanner_in, 32 * batch);
+            scanner_in->groups += 16 * batch;
+            offset += 64 * batch;
+        }
+    }
+#endif
+    while (offset + 4 <= length) {
+        char* plaintext_char = output(scanner_in);
+        if (!rcnb_decode_short(text_in + offset, &plaintext_char, scanner_in->alphabet))
+            break;
+        advance(scanner_in, 2);
+        scanner_in->groups++;
+        offset += 4;
+    }
+    return offset;
+}
+
+// Scans the units text_in[0, length) and returns how many of them it is done with. Unless last is set, the rest
+// have to be passed again, ahead of the text that follows. offsets gives the position of each unit in the text
+// and of its end, NULL when they are the same.
+static size_t scan(scanner* scanner_in, const wchar_t* text_in, size_t length, const size_t* offsets, bool last)
+{
+    const rcnb_alphabet* alphabet = scanner_in->alphabet;
+    size_t offset = 0;
+    size_t opened = 0;
+    while (scanner_in->count < scanner_in->max_runs) {
+        if (!scanner_in->open) {
+            bool found = false;
+            while (!found && offset + 4 <= length) {
+                size_t block = length - offset < SCAN_BLOCK ? length - offset : SCAN_BLOCK;
+                uint64_t mask = candidates(scanner_in, text_in + offset, block);
+                for (; mask != 0; mask &= mask - 1) {
+                    char pair[2];
+                    char* pair_char = pair;
+                    if (rcnb_decode_short(text_in + offset + lowest_bit(mask), &pair_char, alphabet)) {
+                        found = true;
+                        break;
+                    }
+                }
+                // the last three units of a block are looked at again as the start of the next
+                offset = found ? offset + lowest_bit(mask) : offset + block - 3;
+            }
+            if (!found)
+                return last ? length : offset;
+            scanner_in->open = true;
+            scanner_in->start = offsets ? offsets[offset] : offset;
+            scanner_in->groups = 0;
+            scanner_in->run_plaintext = scanner_in->plaintext_char;
+            opened = offset;
+        }
+
+        size_t end = extend_run(scanner_in, text_in, offset, length);
+        if (!last && end + 4 > length) {
+            // the run may go on in the next window: carry it if it is long enough, or else look at it again there
+            if (scanner_in->groups >= scanner_in->min_groups)
+                return end;
+            scanner_in->open = false;
+            scanner_in->plaintext_char = scanner_in->run_plaintext;
+            return opened;
+        }
+        char* plaintext_char = output(scanner_in);
+        if (end + 2 <= length && rcnb_decode_byte(text_in + end, &plaintext_char, alphabet)) {
+            advance(scanner_in, 1);
+            end += 2;
+        }
+        scanner_in->open = false;
+        if (scanner_in->groups < scanner_in->min_groups) {
+            // likely ordinary words, a longer run may still start within it
+            scanner_in->plaintext_char = scanner_in->run_plaintext;
+            offset = opened + 1;
+            continue;
+        }
+        rcnb_run* run = &scanner_in->runs[scanner_in->count++];
+        run->offset = scanner_in->start;
+        run->length = (offsets ? offsets[end] : end) - scanner_in->start;
+        run->plaintext_offset = scanner_in->plaintext_out ? scanner_in->run_plaintext - scanner_in->plaintext_out : 0;
+        run->plaintext_length = scanner_in->plaintext_out ? scanner_in->plaintext_char - scanner_in->run_plaintext : 0;
+        offset = end;
+    }
+    return offset;
+}
+
+// Decodes one UTF-8 sequence into unit_out and returns its length. Malformed bytes are taken one at a time as
+// U+FFFD, which no alphabet holds, and so are code points beyond it.
+static size_t next_unit(const unsigned char* bytes_in, size_t length_in, wchar_t* unit_out)
+{
+    unsigned long value = bytes_in[0];
+    size_t count = value < 0x80 ? 0 : value >= 0xC2 && value < 0xE0 ? 1 : value >= 0xE0 && value < 0xF0 ? 2
+                 : value >= 0xF0 && value < 0xF5 ? 3 : 4;
+    *unit_out = 0xFFFD;
+    if (count == 4 || count >= length_in)
+        return 1;
+    value &= count == 0 ? 0x7F : count == 1 ? 0x1F : count == 2 ? 0x0F : 0x07;
+    for (size_t j = 1; j <= count; ++j) {
+        if ((bytes_in[j] & 0xC0) != 0x80)
+            return 1;
+        value = value << 6 | (bytes_in[j] & 0x3F);
+    }
+    if ((count == 2 && value < 0x800) || (count == 3 && value < 0x10000))
+        return 1;
+    if (count < 3)
+        *unit_out = (wchar_t)value;
+    return count + 1;
+}
+
+static void scan_utf8(scanner* scanner_in, const char* text_in, size_t length_in)
+{
+    const unsigned char* bytes = (const unsigned char*)text_in;
+    wchar_t units[SCAN_WINDOW];
+    size_t offsets[SCAN_WINDOW + 1];
+    size_t count = 0;
+    size_t position = 0;
+    while (scanner_in->count < scanner_in->max_runs) {
+        while (count < SCAN_WINDOW && position < length_in) {
+            // ASCII text is widened eight bytes at a time
+            uint64_t word;
+            if (count + 8 <= SCAN_WINDOW && position + 8 <= length_in &&
+                (memcpy(&word, bytes + position, 8), (word & 0x8080808080808080ull) == 0)) {
+                for (size_t i = 0; i < 8; ++i) {
+                    offsets[count] = position + i;
+                    units[count++] = bytes[position + i];
+                }
+                position += 8;
+                continue;
+            }
+            offsets[count] = position;
+            position += next_unit(bytes + position, length_in - position, &units[count++]);
+        }
+        offsets[count] = position;
+        bool last = position == length_in;
+        size_t done = scan(scanner_in, units, count, offsets, last);
+        if (last)
+            break;
+        memmove(units, units + done, (count - done) * sizeof(wchar_t));
+        memmove(offsets, offsets + done, (count - done) * sizeof(size_t));
+        count -= done;
+    }
+}
+
+size_t rcnb_find_runs(const wchar_t* text_in, size_t length_in, rcnb_run* runs_out, size_t max_runs,
+        const rcnb_scanoptions* options_in)
+{
+    scanner scanner_in;
+    init_scanner(&scanner_in, options_in, runs_out, max_runs, NULL);
+    scan(&scanner_in, text_in, length_in, NULL, true);
+    return scanner_in.count;
+}
+
+size_t rcnb_find_runs_utf8(const char* text_in, size_t length_in, rcnb_run* runs_out, size_t max_runs,
+        const rcnb_scanoptions* options_in)
+{
+    scanner scanner_in;
+    init_scanner(&scanner_in, options_in, runs_out, max_runs, NULL);
+    scan_utf8(&scanner_in, text_in, length_in);
+    return scanner_in.count;
+}
+
+size_t rcnb_extract(const wchar_t* text_in, size_t length_in, char* plaintext_out, rcnb_run* runs_out,
+        size_t max_runs, const rcnb_scanoptions* options_in)
+{
+    scanner scanner_in;
+    init_scanner(&scanner_in, options_in, runs_out, max_runs, plaintext_out);
+    scan(&scanner_in, text_in, length_in, NULL, true);
+    *scanner_in.plaintext_char = 0;
+    return scanner_in.count;
+}
+
+size_t rcnb_extract_utf8(const char* text_in, size_t length_in, char* plaintext_out, rcnb_run* runs_out,
+        size_t max_runs, const rcnb_scanoptions* options_in)
+{
+    scanner scanner_in;
+    init_scanner(&scanner_in, options_in, runs_out, max_runs, plaintext_out);
+    scan_utf8(&scanner_in, text_in, length_in);
+    *scanner_in.plaintext_char = 0;
+    return scanner_in.count;
+}
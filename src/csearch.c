@@ -0,0 +1,440 @@
+/*
+csearch.c - c source to searching rcnb code for a plaintext pattern
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/csearch.h>
+#include <rcnb/cdecode.h>
+#include <rcnb/cencode.h>
+#include <rcnb/rcnb.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Bytes of text checked for candidates at a time, one bit each in a row of masks.
+#define SEARCH_SPAN 1024
+
+typedef struct
+{
+    const unsigned char* bytes;
+    size_t length;
+    // bytes in a code unit, 0 for UTF-8
+    size_t width;
+} text;
+
+typedef struct
+{
+    const rcnb_searcher* searcher;
+    text text;
+    size_t start;
+    size_t* offsets;
+    size_t max_matches;
+    size_t count;
+    // the code units before counted_position, for UTF-8
+    size_t counted_position;
+    size_t counted_units;
+} search;
+
+static unsigned lowest_bit(uint64_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward64(&i, mask);
+    return (unsigned)i;
+#else
+    return (unsigned)__builtin_ctzll(mask);
+#endif
+}
+
+static unsigned bit_count(uint64_t mask)
+{
+#if defined(_MSC_VER)
+    return (unsigned)__popcnt64(mask);
+#else
+    return (unsigned)__builtin_popcountll(mask);
+#endif
+}
+
+static size_t to_utf8(const wchar_t* code_in, size_t length_in, char* text_out)
+{
+    char* text_char = text_out;
+    for (size_t i = 0; i < length_in; ++i) {
+        unsigned long c = (unsigned long)code_in[i];
+        if (c < 0x80) {
+            *text_char++ = (char)c;
+        } else if (c < 0x800) {
+            *text_char++ = (char)(0xC0 | c >> 6);
+            *text_char++ = (char)(0x80 | (c & 0x3F));
+        } else {
+            *text_char++ = (char)(0xE0 | c >> 12);
+            *text_char++ = (char)(0x80 | (c >> 6 & 0x3F));
+            *text_char++ = (char)(0x80 | (c & 0x3F));
+        }
+    }
+    return text_char - text_out;
+}
+
+bool rcnb_init_searcher(rcnb_searcher* searcher_out, const char* pattern_in, size_t length_in,
+        const rcnb_alphabet* alphabet)
+{
+    searcher_out->memory = NULL;
+    if (length_in == 0)
+        return false;
+    searcher_out->alphabet = alphabet ? alphabet : &rcnb_builtin_alphabet;
+    searcher_out->length = length_in;
+    searcher_out->first = (unsigned char)pattern_in[0];
+    searcher_out->last = (unsigned char)pattern_in[length_in - 1];
+
+    // an odd offset leaves the first byte to the group before the whole pairs
+    size_t units[2] = { 4 * (length_in / 2), 4 * ((length_in - 1) / 2) };
+    size_t total = units[0] + units[1];
+    // each unit takes at most three bytes of UTF-8
+    char* memory = (char*)malloc(total * (sizeof(wchar_t) + sizeof(unsigned short) + 3) + 1);
+    if (memory == NULL)
+        return false;
+    searcher_out->memory = memory;
+    wchar_t* wide = (wchar_t*)memory;
+    unsigned short* utf16 = (unsigned short*)(wide + total);
+    char* utf8 = (char*)(utf16 + total);
+    for (int a = 0; a < 2; ++a) {
+        rcnb_searchcore* core = &searcher_out->core[a];
+        core->units = units[a];
+        core->wide = wide;
+        core->utf16 = utf16;
+        core->utf8 = utf8;
+        wchar_t* code_char = wide;
+        for (size_t i = a; i + 2 <= length_in; i += 2) {
+            rcnb_encode_short((unsigned short)((unsigned char)pattern_in[i] << 8 | (unsigned char)pattern_in[i + 1]),
+                    &code_char, searcher_out->alphabet);
+        }
+        for (size_t i = 0; i < units[a]; ++i)
+            utf16[i] = (unsigned short)wide[i];
+        core->utf8_length = to_utf8(wide, units[a], utf8);
+        wide += units[a];
+        utf16 += units[a];
+        utf8 += core->utf8_length;
+    }
+    return true;
+}
+
+void rcnb_free_searcher(rcnb_searcher* searcher_in)
+{
+    free(searcher_in->memory);
+    searcher_in->memory = NULL;
+}
+
+// Reads the code unit at position into unit_out and returns how many bytes it takes, 0 at the end of the text
+// or on malformed UTF-8.
+static size_t read_unit(const text* text_in, size_t position, wchar_t* unit_out)
+{
+    const unsigned char* bytes = text_in->bytes + position;
+    size_t left = text_in->length - position;
+    if (text_in->width == sizeof(wchar_t)) {
+        if (left < sizeof(wchar_t))
+            return 0;
+        memcpy(unit_out, bytes, sizeof(wchar_t));
+        return sizeof(wchar_t);
+    }
+    if (text_in->width == 2) {
+        unsigned short unit;
+        if (left < 2)
+            return 0;
+        memcpy(&unit, bytes, 2);
+        *unit_out = (wchar_t)unit;
+        return 2;
+    }
+    if (left == 0)
+        return 0;
+    if (bytes[0] < 0x80) {
+        *unit_out = (wchar_t)bytes[0];
+        return 1;
+    }
+    if ((bytes[0] & 0xE0) == 0xC0 && left >= 2 && (bytes[1] & 0xC0) == 0x80) {
+        *unit_out = (wchar_t)((bytes[0] & 0x1F) << 6 | (bytes[1] & 0x3F));
+        return 2;
+    }
+    if ((bytes[0] & 0xF0) == 0xE0 && left >= 3 && (bytes[1] & 0xC0) == 0x80 && (bytes[2] & 0xC0) == 0x80) {
+        *unit_out = (wchar_t)((bytes[0] & 0x0F) << 12 | (bytes[1] & 0x3F) << 6 | (bytes[2] & 0x3F));
+        return 3;
+    }
+    return 0;
+}
+
+// Moves position over count code units, forwards or backwards; false if the text ends first.
+static bool skip_units(const text* text_in, size_t* position, size_t count, bool backwards)
+{
+    if (text_in->width != 0) {
+        size_t bytes = count * text_in->width;
+        if (backwards ? bytes > *position : bytes > text_in->length - *position)
+            return false;
+        *position = backwards ? *position - bytes : *position + bytes;
+        return true;
+    }
+    const unsigned char* bytes = text_in->bytes;
+    size_t i = *position;
+    for (; count > 0; --count) {
+        if (backwards ? i == 0 : i == text_in->length)
+            return false;
+        if (backwards) {
+            while (--i > 0 && (bytes[i] & 0xC0) == 0x80)
+                ;
+        } else {
+            while (++i < text_in->length && (bytes[i] & 0xC0) == 0x80)
+                ;
+        }
+    }
+    *position = i;
+    return true;
+}
+
+// The UTF-8 code points in bytes[from, to), all the bytes but those that continue one.
+static size_t count_utf8(const unsigned char* bytes, size_t from, size_t to)
+{
+    size_t count = to - from;
+    size_t i = from;
+    for (; i + 8 <= to; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        count -= bit_count(word & ~(word << 1) & 0x8080808080808080ull);
+    }
+    for (; i < to; ++i)
+        count -= (bytes[i] & 0xC0) == 0x80;
+    return count;
+}
+
+// Decodes the group at position into plaintext_out, moves past it and returns how many bytes it holds, 0 if it
+// is not a valid group. Only two units that end the text make a group of one byte.
+static size_t decode_group(const search* search_in, size_t* position, char* plaintext_out)
+{
+    const text* text_in = &search_in->text;
+    wchar_t units[4];
+    size_t next = *position;
+    size_t middle = next;
+    size_t count = 0;
+    for (; count < 4; ++count) {
+        size_t width = read_unit(text_in, next, &units[count]);
+        if (width == 0)
+            break;
+        next += width;
+        if (count == 1)
+            middle = next;
+    }
+    char* plaintext_char = plaintext_out;
+    if (count == 4 && rcnb_decode_short(units, &plaintext_char, search_in->searcher->alphabet)) {
+        *position = next;
+        return 2;
+    }
+    if (count >= 2 && middle == text_in->length
+        && rcnb_decode_byte(units, &plaintext_char, search_in->searcher->alphabet)) {
+        *position = middle;
+        return 1;
+    }
+    return 0;
+}
+
+// False once max_matches are found.
+static bool report(search* search_in, size_t offset)
+{
+    if (offset < search_in->start)
+        return true;
+    search_in->offsets[search_in->count++] = offset;
+    return search_in->count < search_in->max_matches;
+}
+
+// Patterns of one or two bytes, decoding group after group from the one at position, offset in the plaintext.
+static void walk_groups(search* search_in, size_t position, size_t offset)
+{
+    const rcnb_searcher* searcher = search_in->searcher;
+    unsigned char plaintext[2];
+    bool previous = false;
+    while (position < search_in->text.length) {
+        size_t length = decode_group(search_in, &position, (char*)plaintext);
+        if (length == 0) {
+            // not code, step over a group's worth of units and pick up the grid behind it
+            if (!skip_units(&search_in->text, &position, 4, false))
+                return;
+            previous = false;
+            offset += 2;
+            continue;
+        }
+        if (searcher->length == 1) {
+            for (size_t i = 0; i < length; ++i) {
+                if (plaintext[i] == searcher->first && !report(search_in, offset + i))
+                    return;
+            }
+        } else {
+            if (previous && plaintext[0] == searcher->last && !report(search_in, offset - 1))
+                return;
+            if (length == 2 && plaintext[0] == searcher->first && plaintext[1] == searcher->last
+                && !report(search_in, offset))
+                return;
+            previous = length == 2 && plaintext[1] == searcher->first;
+        }
+        offset += length;
+    }
+}
+
+// Sets bit i % 64 of masks_out[i / 64] where the text at position + i starts with the first byte of the needle
+// and has its last byte distance further on.
+static void candidates(const text* text_in, size_t position, size_t length, const unsigned char* needle,
+        size_t distance, uint64_t* masks_out)
+{
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+    if (length == SEARCH_SPAN && text_in->length - position >= SEARCH_SPAN + distance) {
+        unsigned short masks[SEARCH_SPAN / 16];
+        rcnb_match_16n_asm((const char *)text_in->bytes + position, masks, SEARCH_SPAN / 16, needle[0],
+                needle[distance], distance);
+        for (size_t k = 0; k < SEARCH_SPAN / 64; ++k) {
+            masks_out[k] = (uint64_t)masks[4 * k] | (uint64_t)masks[4 * k + 1] << 16
+                         | (uint64_t)masks[4 * k + 2] << 32 | (uint64_t)masks[4 * k + 3] << 48;
+        }
+        return;
+    }
+#endif
+    const unsigned char* bytes = text_in->bytes + position;
+    memset(masks_out, 0, SEARCH_SPAN / 8);
+    for (size_t i = 0; i < length && text_in->length - position - i > distance; ++i)
+        masks_out[i / 64] |= (uint64_t)(bytes[i] == needle[0] && bytes[i + distance] == needle[distance]) << i % 64;
+}
+
+// Checks a candidate for the whole pairs of the pattern in alignment a at position, and the bytes at either end.
+static bool check(search* search_in, int a, size_t position, const unsigned char* needle, size_t length,
+        size_t* offset_out)
+{
+    const text* text_in = &search_in->text;
+    const rcnb_searcher* searcher = search_in->searcher;
+    if (text_in->length - position < length || memcmp(text_in->bytes + position, needle, length) != 0)
+        return false;
+    size_t unit;
+    if (text_in->width != 0) {
+        if (position % text_in->width != 0)
+            return false;
+        unit = position / text_in->width;
+    } else {
+        // candidates come in order, so the units are only ever counted once
+        search_in->counted_units += count_utf8(text_in->bytes, search_in->counted_position, position);
+        search_in->counted_position = position;
+        unit = search_in->counted_units;
+    }
+    if (unit % 4 != 0 || unit / 2 < (size_t)a)
+        return false;
+
+    unsigned char plaintext[2];
+    if (a == 1) {
+        size_t head = position;
+        if (!skip_units(text_in, &head, 4, true) || decode_group(search_in, &head, (char*)plaintext) != 2
+            || plaintext[1] != searcher->first)
+            return false;
+    }
+    if ((searcher->length - a) % 2 != 0) {
+        size_t tail = position + length;
+        if (decode_group(search_in, &tail, (char*)plaintext) == 0 || plaintext[0] != searcher->last)
+            return false;
+    }
+    *offset_out = unit / 2 - a;
+    return true;
+}
+
+static size_t run_search(search* search_in)
+{
+    const rcnb_searcher* searcher = search_in->searcher;
+    const text* text_in = &search_in->text;
+    search_in->count = 0;
+    if (search_in->max_matches == 0 || searcher->memory == NULL)
+        return 0;
+
+    // no match at start or later begins its whole pairs before unit 2 * start
+    size_t unit = (2 * search_in->start) & ~(size_t)3;
+    size_t position = 0;
+    if (!skip_units(text_in, &position, unit, false))
+        return 0;
+    search_in->counted_position = position;
+    search_in->counted_units = unit;
+    if (searcher->length <= 2) {
+        walk_groups(search_in, position, unit / 2);
+        return search_in->count;
+    }
+
+    const unsigned char* needles[2];
+    size_t lengths[2];
+    size_t distances[2];
+    for (int a = 0; a < 2; ++a) {
+        const rcnb_searchcore* core = &searcher->core[a];
+        if (text_in->width == sizeof(wchar_t)) {
+            needles[a] = (const unsigned char*)core->wide;
+            lengths[a] = core->units * sizeof(wchar_t);
+        } else if (text_in->width == 2) {
+            needles[a] = (const unsigned char*)core->utf16;
+            lengths[a] = core->units * 2;
+        } else {
+            needles[a] = (const unsigned char*)core->utf8;
+            lengths[a] = core->utf8_length;
+        }
+        // the high bytes of wide units are mostly zero, which makes a poor filter
+        distances[a] = lengths[a] - 1;
+        while (distances[a] > 0 && needles[a][distances[a]] == 0)
+            distances[a]--;
+    }
+
+    for (; position < text_in->length; position += SEARCH_SPAN) {
+        size_t length = text_in->length - position < SEARCH_SPAN ? text_in->length - position : SEARCH_SPAN;
+        uint64_t masks[2][SEARCH_SPAN / 64];
+        for (int a = 0; a < 2; ++a)
+            candidates(text_in, position, length, needles[a], distances[a], masks[a]);
+        for (size_t k = 0; k < SEARCH_SPAN / 64; ++k) {
+            uint64_t all = masks[0][k] | masks[1][k];
+            while (all != 0) {
+                unsigned i = lowest_bit(all);
+                all &= all - 1;
+                // at the same position the odd alignment starts a byte earlier
+                for (int a = 1; a >= 0; --a) {
+                    size_t offset;
+                    if ((masks[a][k] >> i & 1)
+                        && check(search_in, a, position + 64 * k + i, needles[a], lengths[a], &offset)
+                        && !report(search_in, offset))
+                        return search_in->count;
+                }
+            }
+        }
+    }
+    return search_in->count;
+}
+
+static size_t search_text(const rcnb_searcher* searcher_in, const void* bytes_in, size_t length_in, size_t width,
+        size_t start, size_t* offsets_out, size_t max_matches)
+{
+    search search_in;
+    search_in.searcher = searcher_in;
+    search_in.text.bytes = (const unsigned char*)bytes_in;
+    search_in.text.length = length_in;
+    search_in.text.width = width;
+    search_in.start = start;
+    search_in.offsets = offsets_out;
+    search_in.max_matches = max_matches;
+    return run_search(&search_in);
+}
+
+size_t rcnb_search(const rcnb_searcher* searcher_in, const wchar_t* code_in, size_t length_in, size_t start,
+        size_t* offsets_out, size_t max_matches)
+{
+    return search_text(searcher_in, code_in, length_in * sizeof(wchar_t), sizeof(wchar_t), start, offsets_out,
+            max_matches);
+}
+
+size_t rcnb_search_utf8(const rcnb_searcher* searcher_in, const char* text_in, size_t length_in, size_t start,
+        size_t* offsets_out, size_t max_matches)
+{
+    return search_text(searcher_in, text_in, length_in, 0, start, offsets_out, max_matches);
+}
+
+size_t rcnb_search_utf16(const rcnb_searcher* searcher_in, const unsigned short* text_in, size_t length_in,
+        size_t start, size_t* offsets_out, size_t max_matches)
+{
+    return search_text(searcher_in, text_in, length_in * 2, 2, start, offsets_out, max_matches);
+}
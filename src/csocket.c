@@ -0,0 +1,487 @@
+/*
+csocket.c - c source to streaming rcnb over non-blocking sockets
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/csocket.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
+// Code units are at most three bytes of UTF-8, since every alphabet stays below U+8000.
+#define UTF8_MAX 3
+
+static size_t to_utf8(const wchar_t* code_in, size_t length_in, char* bytes_out)
+{
+    char* bytes_char = bytes_out;
+    for (size_t i = 0; i < length_in; ++i) {
+        unsigned long value = (unsigned long)code_in[i];
+        if (value < 0x80) {
+            *bytes_char++ = (char)value;
+        } else if (value < 0x800) {
+            *bytes_char++ = (char)(0xC0 | value >> 6);
+            *bytes_char++ = (char)(0x80 | (value & 0x3F));
+        } else {
+            *bytes_char++ = (char)(0xE0 | value >> 12);
+            *bytes_char++ = (char)(0x80 | (value >> 6 & 0x3F));
+            *bytes_char++ = (char)(0x80 | (value & 0x3F));
+        }
+    }
+    return bytes_char - bytes_out;
+}
+
+// Converts whole sequences and leaves the bytes of an incomplete last one in *length_in; -1 on malformed UTF-8.
+static ptrdiff_t from_utf8(const char* bytes_in, size_t* length_in, wchar_t* code_out)
+{
+    const unsigned char* bytes = (const unsigned char*)bytes_in;
+    size_t length = *length_in;
+    size_t i = 0;
+    wchar_t* code_char = code_out;
+    while (i < length) {
+        unsigned long value = bytes[i];
+        size_t count = value < 0x80 ? 0 : value >= 0xC2 && value < 0xE0 ? 1 : value >= 0xE0 && value < 0xF0 ? 2 : 3;
+        if (count == 3)
+            return -1;
+        if (i + count >= length)
+            break;
+        value &= count == 0 ? 0x7F : count == 1 ? 0x1F : 0x0F;
+        for (size_t j = 1; j <= count; ++j) {
+            if ((bytes[i + j] & 0xC0) != 0x80)
+                return -1;
+            value = value << 6 | (bytes[i + j] & 0x3F);
+        }
+        if (count == 2 && value < 0x800)
+            return -1;
+        *code_char++ = (wchar_t)value;
+        i += count + 1;
+    }
+    *length_in = length - i;
+    return code_char - code_out;
+}
+
+void rcnb_init_sockoptions(rcnb_sockoptions* options_out)
+{
+    options_out->chunk_size = 16384;
+    options_out->chunks = 16;
+    options_out->batch = 0;
+}
+
+static void normalize_options(rcnb_sockoptions* options_out, const rcnb_sockoptions* options_in)
+{
+    if (options_in)
+        *options_out = *options_in;
+    else
+        rcnb_init_sockoptions(options_out);
+    // whole kernel batches per chunk, and no more chunks than one writev() takes
+    options_out->chunk_size = options_out->chunk_size < 32 ? 32 : options_out->chunk_size & ~(size_t)31;
+    if (options_out->chunks == 0)
+        options_out->chunks = 1;
+    if (options_out->chunks > IOV_MAX)
+        options_out->chunks = IOV_MAX;
+}
+
+bool rcnb_init_socksender(rcnb_socksender* sender_in, int fd, const rcnb_sockoptions* options_in)
+{
+    sender_in->fd = fd;
+    normalize_options(&sender_in->options, options_in);
+    rcnb_init_encodestate(&sender_in->state);
+    sender_in->head = 0;
+    sender_in->count = 0;
+    sender_in->sent = 0;
+    sender_in->pending = 0;
+    sender_in->finished = false;
+    sender_in->blocked = false;
+
+    // a chunk also takes the code of the byte the previous one held back
+    size_t code_length = 2 * sender_in->options.chunk_size + 2;
+    sender_in->scratch = malloc((code_length + 1) * sizeof(wchar_t));
+    sender_in->ring = calloc(sender_in->options.chunks, sizeof(rcnb_sockchunk));
+    bool ok = sender_in->scratch && sender_in->ring;
+    for (size_t i = 0; ok && i < sender_in->options.chunks; ++i) {
+        sender_in->ring[i].code = malloc(UTF8_MAX * code_length);
+        ok = sender_in->ring[i].code != NULL;
+    }
+    if (!ok)
+        rcnb_free_socksender(sender_in);
+    return ok;
+}
+
+static rcnb_sockchunk* tail_chunk(rcnb_socksender* sender_in)
+{
+    return &sender_in->ring[(sender_in->head + sender_in->count - 1) % sender_in->options.chunks];
+}
+
+// Returns the chunk to append to, opening a new one once the last is full, or NULL if the ring is.
+static rcnb_sockchunk* open_chunk(rcnb_socksender* sender_in)
+{
+    if (sender_in->count > 0 && tail_chunk(sender_in)->plaintext < sender_in->options.chunk_size)
+        return tail_chunk(sender_in);
+    if (sender_in->count == sender_in->options.chunks)
+        return NULL;
+    sender_in->count++;
+    rcnb_sockchunk* chunk = tail_chunk(sender_in);
+    chunk->length = 0;
+    chunk->plaintext = 0;
+    return chunk;
+}
+
+size_t rcnb_socksender_push(rcnb_socksender* sender_in, const char* plaintext_in, size_t length_in)
+{
+    size_t pushed = 0;
+    while (pushed < length_in && !sender_in->finished) {
+        rcnb_sockchunk* chunk = open_chunk(sender_in);
+        if (!chunk)
+            break;
+        size_t length = sender_in->options.chunk_size - chunk->plaintext;
+        if (length > length_in - pushed)
+            length = length_in - pushed;
+        size_t code_length = rcnb_encode_block(plaintext_in + pushed, length, sender_in->scratch, &sender_in->state);
+        size_t bytes = to_utf8(sender_in->scratch, code_length, chunk->code + chunk->length);
+        chunk->length += bytes;
+        chunk->plaintext += length;
+        sender_in->pending += bytes;
+        pushed += length;
+    }
+    return pushed;
+}
+
+void rcnb_socksender_finish(rcnb_socksender* sender_in)
+{
+    if (sender_in->finished)
+        return;
+    sender_in->finished = true;
+    size_t code_length = rcnb_encode_blockend(sender_in->scratch, &sender_in->state);
+    if (code_length == 0)
+        return;
+    // the held back byte was pushed into the last chunk, which has room for its code
+    rcnb_sockchunk* chunk = tail_chunk(sender_in);
+    size_t bytes = to_utf8(sender_in->scratch, code_length, chunk->code + chunk->length);
+    chunk->length += bytes;
+    sender_in->pending += bytes;
+}
+
+// Drops the chunks that went out in full, and rewinds the last one if it went out but is still open.
+static void retire_chunks(rcnb_socksender* sender_in)
+{
+    while (sender_in->count > 0) {
+        rcnb_sockchunk* chunk = &sender_in->ring[sender_in->head];
+        if (sender_in->sent < chunk->length)
+            return;
+        if (sender_in->count == 1 && chunk->plaintext < sender_in->options.chunk_size && !sender_in->finished) {
+            chunk->length = 0;
+            sender_in->sent = 0;
+            return;
+        }
+        sender_in->head = (sender_in->head + 1) % sender_in->options.chunks;
+        sender_in->count--;
+        sender_in->sent = 0;
+    }
+}
+
+ptrdiff_t rcnb_socksender_flush(rcnb_socksender* sender_in, bool force)
+{
+    if (sender_in->pending == 0 || (!force && sender_in->pending < sender_in->options.batch))
+        return 0;
+    struct iovec iov[IOV_MAX];
+    int iovcnt = 0;
+    for (size_t i = 0; i < sender_in->count; ++i) {
+        rcnb_sockchunk* chunk = &sender_in->ring[(sender_in->head + i) % sender_in->options.chunks];
+        size_t offset = i == 0 ? sender_in->sent : 0;
+        if (chunk->length > offset) {
+            iov[iovcnt].iov_base = chunk->code + offset;
+            iov[iovcnt].iov_len = chunk->length - offset;
+            iovcnt++;
+        }
+    }
+    ssize_t written;
+    do {
+        written = writev(sender_in->fd, iov, iovcnt);
+    } while (written < 0 && errno == EINTR);
+    if (written < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return -1;
+        sender_in->blocked = true;
+        return 0;
+    }
+    sender_in->blocked = false;
+    sender_in->pending -= (size_t)written;
+
+    size_t remaining = (size_t)written;
+    while (remaining > 0) {
+        rcnb_sockchunk* chunk = &sender_in->ring[sender_in->head];
+        size_t left = chunk->length - sender_in->sent;
+        if (remaining < left) {
+            sender_in->sent += remaining;
+            break;
+        }
+        sender_in->sent = chunk->length;
+        remaining -= left;
+        retire_chunks(sender_in);
+    }
+    retire_chunks(sender_in);
+    return written;
+}
+
+size_t rcnb_socksender_pending(const rcnb_socksender* sender_in)
+{
+    return sender_in->pending;
+}
+
+size_t rcnb_socksender_room(const rcnb_socksender* sender_in)
+{
+    if (sender_in->finished)
+        return 0;
+    size_t room = (sender_in->options.chunks - sender_in->count) * sender_in->options.chunk_size;
+    if (sender_in->count > 0) {
+        const rcnb_sockchunk* chunk =
+            &sender_in->ring[(sender_in->head + sender_in->count - 1) % sender_in->options.chunks];
+        room += sender_in->options.chunk_size - chunk->plaintext;
+    }
+    return room;
+}
+
+void rcnb_free_socksender(rcnb_socksender* sender_in)
+{
+    if (sender_in->ring) {
+        for (size_t i = 0; i < sender_in->options.chunks; ++i)
+            free(sender_in->ring[i].code);
+    }
+    free(sender_in->ring);
+    free(sender_in->scratch);
+    sender_in->ring = NULL;
+    sender_in->scratch = NULL;
+}
+
+// Bytes of code taken off the socket per read.
+static size_t receive_length(const rcnb_sockoptions* options_in)
+{
+    return 4 * options_in->chunk_size;
+}
+
+bool rcnb_init_sockreceiver(rcnb_sockreceiver* receiver_in, int fd, const rcnb_sockoptions* options_in)
+{
+    receiver_in->fd = fd;
+    normalize_options(&receiver_in->options, options_in);
+    rcnb_init_decodestate(&receiver_in->state);
+    receiver_in->buffered = 0;
+    receiver_in->eof = false;
+    receiver_in->blocked = false;
+    size_t length = receive_length(&receiver_in->options) + UTF8_MAX;
+    receiver_in->bytes = malloc(length);
+    receiver_in->code = malloc(length * sizeof(wchar_t));
+    if (!receiver_in->bytes || !receiver_in->code) {
+        rcnb_free_sockreceiver(receiver_in);
+        return false;
+    }
+    return true;
+}
+
+size_t rcnb_sockreceiver_bound(const rcnb_sockreceiver* receiver_in)
+{
+    // every code unit takes at least a byte, plus the three units the state may hold back
+    return (receive_length(&receiver_in->options) + UTF8_MAX + 3) / 4 * 2 + 1;
+}
+
+ptrdiff_t rcnb_sockreceiver_read(rcnb_sockreceiver* receiver_in, char* plaintext_out)
+{
+    if (receiver_in->eof)
+        return 0;
+    ssize_t received;
+    do {
+        received = read(receiver_in->fd, receiver_in->bytes + receiver_in->buffered,
+                        receive_length(&receiver_in->options));
+    } while (received < 0 && errno == EINTR);
+    if (received < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return -1;
+        receiver_in->blocked = true;
+        return 0;
+    }
+    receiver_in->blocked = false;
+    if (received == 0) {
+        receiver_in->eof = true;
+        return 0;
+    }
+
+    size_t length = receiver_in->buffered + (size_t)received;
+    size_t left = length;
+    ptrdiff_t code_length = from_utf8(receiver_in->bytes, &left, receiver_in->code);
+    if (code_length < 0) {
+        errno = EILSEQ;
+        return -1;
+    }
+    for (size_t i = 0; i < left; ++i)
+        receiver_in->bytes[i] = receiver_in->bytes[length - left + i];
+    receiver_in->buffered = left;
+
+    ptrdiff_t plain_length = rcnb_decode_block(receiver_in->code, (size_t)code_length, plaintext_out,
+                                               &receiver_in->state);
+    if (plain_length < 0)
+        errno = EILSEQ;
+    return plain_length;
+}
+
+ptrdiff_t rcnb_sockreceiver_end(rcnb_sockreceiver* receiver_in, char* plaintext_out)
+{
+    ptrdiff_t plain_length = receiver_in->buffered == 0 ? rcnb_decode_blockend(plaintext_out, &receiver_in->state) : -1;
+    if (plain_length < 0)
+        errno = EILSEQ;
+    return plain_length;
+}
+
+void rcnb_free_sockreceiver(rcnb_sockreceiver* receiver_in)
+{
+    free(receiver_in->bytes);
+    free(receiver_in->code);
+    receiver_in->bytes = NULL;
+    receiver_in->code = NULL;
+}
+
+#ifdef __linux__
+
+// Registers fd edge-triggered; regular files cannot be polled, but never block either.
+static bool watch(int epoll_fd, int fd, uint32_t events)
+{
+    struct epoll_event event;
+    event.events = events | EPOLLET;
+    event.data.fd = fd;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0 || errno == EPERM;
+}
+
+// Edge-triggered, so only ever called after the fd in question returned EAGAIN.
+static bool wait_ready(int epoll_fd)
+{
+    struct epoll_event events[2];
+    int ready;
+    do {
+        ready = epoll_wait(epoll_fd, events, 2, -1);
+    } while (ready < 0 && errno == EINTR);
+    return ready >= 0;
+}
+
+int rcnb_epoll_encode(int source_fd, int socket_fd, const rcnb_sockoptions* options_in)
+{
+    rcnb_socksender sender;
+    if (!rcnb_init_socksender(&sender, socket_fd, options_in))
+        return -1;
+    char* plaintext = malloc(sender.options.chunk_size);
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int result = -1;
+    if (!plaintext || epoll_fd < 0 || !watch(epoll_fd, source_fd, EPOLLIN) || !watch(epoll_fd, socket_fd, EPOLLOUT))
+        goto done;
+
+    while (true) {
+        bool drained = false;
+        size_t room;
+        while ((room = rcnb_socksender_room(&sender)) > 0) {
+            ssize_t length = read(source_fd, plaintext, room < sender.options.chunk_size ? room : sender.options.chunk_size);
+            if (length > 0) {
+                rcnb_socksender_push(&sender, plaintext, (size_t)length);
+            } else if (length == 0) {
+                rcnb_socksender_finish(&sender);
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                drained = true;
+                break;
+            } else if (errno != EINTR) {
+                goto done;
+            }
+        }
+        // gather up to batch bytes while the source keeps up, send whatever there is once it does not
+        if (rcnb_socksender_flush(&sender, drained || rcnb_socksender_room(&sender) == 0) < 0)
+            goto done;
+        if (sender.finished && rcnb_socksender_pending(&sender) == 0)
+            break;
+        if ((sender.blocked || drained) && !wait_ready(epoll_fd))
+            goto done;
+    }
+    result = 0;
+
+done:
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+    free(plaintext);
+    rcnb_free_socksender(&sender);
+    return result;
+}
+
+static bool write_all(int epoll_fd, int fd, const char* bytes_in, size_t length_in)
+{
+    while (length_in > 0) {
+        ssize_t written = write(fd, bytes_in, length_in);
+        if (written > 0) {
+            bytes_in += written;
+            length_in -= (size_t)written;
+        } else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!wait_ready(epoll_fd))
+                return false;
+        } else if (written < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int rcnb_epoll_decode(int socket_fd, int sink_fd, const rcnb_sockoptions* options_in)
+{
+    rcnb_sockreceiver receiver;
+    if (!rcnb_init_sockreceiver(&receiver, socket_fd, options_in))
+        return -1;
+    char* plaintext = malloc(rcnb_sockreceiver_bound(&receiver));
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int result = -1;
+    if (!plaintext || epoll_fd < 0 || !watch(epoll_fd, socket_fd, EPOLLIN) || !watch(epoll_fd, sink_fd, EPOLLOUT))
+        goto done;
+
+    while (!receiver.eof) {
+        ptrdiff_t length = rcnb_sockreceiver_read(&receiver, plaintext);
+        if (length < 0 || !write_all(epoll_fd, sink_fd, plaintext, (size_t)length))
+            goto done;
+        if (receiver.blocked && !wait_ready(epoll_fd))
+            goto done;
+    }
+    ptrdiff_t length = rcnb_sockreceiver_end(&receiver, plaintext);
+    if (length < 0 || !write_all(epoll_fd, sink_fd, plaintext, (size_t)length))
+        goto done;
+    result = 0;
+
+done:
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+    free(plaintext);
+    rcnb_free_sockreceiver(&receiver);
+    return result;
+}
+
+#else
+
+int rcnb_epoll_encode(int source_fd, int socket_fd, const rcnb_sockoptions* options_in)
+{
+    (void)source_fd;
+    (void)socket_fd;
+    (void)options_in;
+    errno = ENOSYS;
+    return -1;
+}
+
+int rcnb_epoll_decode(int socket_fd, int sink_fd, const rcnb_sockoptions* options_in)
+{
+    (void)socket_fd;
+    (void)sink_fd;
+    (void)options_in;
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
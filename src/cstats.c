@@ -0,0 +1,63 @@
+/*
+cstats.c - c source to the rcnb instrumentation counters
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/cstats.h>
+#include <string.h>
+#include "instrument.h"
+
+#if defined(ENABLE_AVX2)
+#define RCNB_KERNEL "avx2"
+#elif defined(ENABLE_SSSE3)
+#define RCNB_KERNEL "ssse3"
+#elif defined(ENABLE_NEON)
+#define RCNB_KERNEL "neon"
+#else
+#define RCNB_KERNEL "scalar"
+#endif
+
+#ifdef ENABLE_STATS
+rcnb_stats rcnb_stats_counters;
+
+#if defined(_MSC_VER)
+#define load_counter(field) \
+    (unsigned long long)_InterlockedCompareExchange64((volatile __int64*)&rcnb_stats_counters.field, 0, 0)
+#define reset_counter(field) \
+    _InterlockedExchange64((volatile __int64*)&rcnb_stats_counters.field, 0)
+#else
+#define load_counter(field) __atomic_load_n(&rcnb_stats_counters.field, __ATOMIC_RELAXED)
+#define reset_counter(field) __atomic_store_n(&rcnb_stats_counters.field, 0, __ATOMIC_RELAXED)
+#endif
+#endif
+
+void rcnb_get_stats(rcnb_stats* stats_out)
+{
+    memset(stats_out, 0, sizeof(rcnb_stats));
+    stats_out->kernel = RCNB_KERNEL;
+#ifdef ENABLE_STATS
+    stats_out->enabled = true;
+    stats_out->encode_calls = load_counter(encode_calls);
+    stats_out->encode_simd_bytes = load_counter(encode_simd_bytes);
+    stats_out->encode_scalar_bytes = load_counter(encode_scalar_bytes);
+    stats_out->decode_calls = load_counter(decode_calls);
+    stats_out->decode_simd_bytes = load_counter(decode_simd_bytes);
+    stats_out->decode_scalar_bytes = load_counter(decode_scalar_bytes);
+    stats_out->decode_failures = load_counter(decode_failures);
+#endif
+}
+
+void rcnb_reset_stats(void)
+{
+#ifdef ENABLE_STATS
+    reset_counter(encode_calls);
+    reset_counter(encode_simd_bytes);
+    reset_counter(encode_scalar_bytes);
+    reset_counter(decode_calls);
+    reset_counter(decode_simd_bytes);
+    reset_counter(decode_scalar_bytes);
+    reset_counter(decode_failures);
+#endif
+}
@@ -0,0 +1,415 @@
+/*
+ctune.c - c source to tuning rcnb to the machine it runs on
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/ctune.h>
+#include <rcnb/cencode.h>
+#include <rcnb/cdecode.h>
+#include <rcnb/cstats.h>
+#include "threshold.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Plaintext per trial, beyond the last level cache of most hosts.
+#define TUNE_LENGTH (1 << 24)
+// The thread trial's chunks, each encoded into a slot of its own with room for the terminating NUL.
+#define TUNE_CHUNK (1 << 20)
+#define TUNE_SLOT (2 * TUNE_CHUNK + RCNB_ALIGNMENT)
+#define TUNE_CODE_LENGTH ((size_t)(TUNE_LENGTH / TUNE_CHUNK) * TUNE_SLOT)
+// Runs per setting, of which the fastest counts.
+#define TUNE_RUNS 3
+// A larger setting has to be this much faster than a smaller one to be chosen over it.
+#define TUNE_MARGIN 1.05
+
+static const size_t tune_chunks[] = { 4096, 16384, 65536, 262144, 1048576 };
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+static const size_t tune_thresholds[] = { 1 << 20, 1 << 22, 1 << 24 };
+#endif
+
+typedef struct
+{
+    char* plaintext;
+    wchar_t* code;
+} trial_buffers;
+
+static double seconds(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#endif
+}
+
+static unsigned processors(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (unsigned)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned)count : 1;
+#endif
+}
+
+void rcnb_init_profile(rcnb_profile* profile_out)
+{
+    rcnb_stats stats;
+    rcnb_get_stats(&stats);
+    memset(profile_out->kernel, 0, sizeof(profile_out->kernel));
+    strncpy(profile_out->kernel, stats.kernel, sizeof(profile_out->kernel) - 1);
+    profile_out->chunk_size = RCNB_PROFILE_CHUNK;
+    profile_out->stream_threshold = RCNB_STREAM_THRESHOLD;
+    profile_out->threads = processors();
+}
+
+// Streams the whole plaintext through reused buffers of one chunk, there and back again.
+static double chunk_trial(const trial_buffers* buffers_in, size_t chunk_size)
+{
+    rcnb_encodestate encode_state;
+    rcnb_decodestate decode_state;
+    rcnb_init_encodestate(&encode_state);
+    rcnb_init_decodestate(&decode_state);
+    char* plaintext = buffers_in->plaintext + TUNE_LENGTH;
+    double start = seconds();
+    for (size_t i = 0; i < TUNE_LENGTH; i += chunk_size) {
+        size_t code_length = rcnb_encode_block(buffers_in->plaintext + i, chunk_size, buffers_in->code, &encode_state);
+        rcnb_decode_block(buffers_in->code, code_length, plaintext, &decode_state);
+    }
+    return seconds() - start;
+}
+
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+// Encodes the whole plaintext in blocks of the given length into one large output, as a big file would be.
+static double threshold_trial(const trial_buffers* buffers_in, size_t block_length, bool stream)
+{
+    rcnb_store_stream_threshold(stream ? block_length : SIZE_MAX);
+    rcnb_encodestate state;
+    rcnb_init_encodestate(&state);
+    double start = seconds();
+    for (size_t i = 0; i < TUNE_LENGTH; i += block_length)
+        rcnb_encode_block(buffers_in->plaintext + i, block_length, buffers_in->code + 2 * i, &state);
+    return seconds() - start;
+}
+#endif
+
+typedef struct
+{
+    const trial_buffers* buffers;
+    unsigned thread;
+    unsigned threads;
+} thread_trial_job;
+
+// Each thread encodes every threads-th chunk, as the chunked container format does.
+static void encode_share(const thread_trial_job* job_in)
+{
+    for (size_t i = job_in->thread; i < TUNE_LENGTH / TUNE_CHUNK; i += job_in->threads)
+        rcnb_encode(job_in->buffers->plaintext + i * TUNE_CHUNK, TUNE_CHUNK, job_in->buffers->code + i * TUNE_SLOT);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI encode_share_thread(LPVOID job_in)
+{
+    encode_share((const thread_trial_job*)job_in);
+    return 0;
+}
+#else
+static void* encode_share_thread(void* job_in)
+{
+    encode_share((const thread_trial_job*)job_in);
+    return NULL;
+}
+#endif
+
+// Returns a negative time if the threads could not be started.
+static double thread_trial(const trial_buffers* buffers_in, unsigned threads)
+{
+    thread_trial_job* jobs = malloc(threads * sizeof(thread_trial_job));
+#ifdef _WIN32
+    HANDLE* handles = malloc(threads * sizeof(HANDLE));
+#else
+    pthread_t* handles = malloc(threads * sizeof(pthread_t));
+#endif
+    if (!jobs || !handles) {
+        free(jobs);
+        free(handles);
+        return -1;
+    }
+    unsigned started = 1;
+    double start = seconds();
+    for (unsigned t = 0; t < threads; ++t) {
+        jobs[t].buffers = buffers_in;
+        jobs[t].thread = t;
+        jobs[t].threads = threads;
+    }
+    for (; started < threads; ++started) {
+#ifdef _WIN32
+        handles[started] = CreateThread(NULL, 0, encode_share_thread, &jobs[started], 0, NULL);
+        if (!handles[started])
+            break;
+#else
+        if (pthread_create(&handles[started], NULL, encode_share_thread, &jobs[started]) != 0)
+            break;
+#endif
+    }
+    encode_share(&jobs[0]);
+    for (unsigned t = 1; t < started; ++t) {
+#ifdef _WIN32
+        WaitForSingleObject(handles[t], INFINITE);
+        CloseHandle(handles[t]);
+#else
+        pthread_join(handles[t], NULL);
+#endif
+    }
+    double elapsed = seconds() - start;
+    free(jobs);
+    free(handles);
+    return started == threads ? elapsed : -1;
+}
+
+bool rcnb_autotune(rcnb_profile* profile_out)
+{
+    rcnb_init_profile(profile_out);
+    trial_buffers buffers;
+    // the second half of the plaintext buffer takes the chunk trial's decoded output
+    buffers.plaintext = malloc(2 * (size_t)TUNE_LENGTH);
+    buffers.code = rcnb_alloc_code(TUNE_CODE_LENGTH);
+    if (!buffers.plaintext || !buffers.code) {
+        free(buffers.plaintext);
+        rcnb_free_code(buffers.code);
+        return false;
+    }
+    uint32_t seed = 0x9E3779B9;
+    for (size_t i = 0; i < TUNE_LENGTH; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        buffers.plaintext[i] = (char)(seed >> 24);
+    }
+    // a first pass over both buffers, so that page faults do not count against the first setting
+    rcnb_encode(buffers.plaintext, TUNE_LENGTH, buffers.code);
+    size_t saved_threshold = rcnb_get_stream_threshold();
+
+    double best = 0;
+    for (size_t i = 0; i < sizeof(tune_chunks) / sizeof(tune_chunks[0]); ++i) {
+        double fastest = chunk_trial(&buffers, tune_chunks[i]);
+        for (int run = 1; run < TUNE_RUNS; ++run) {
+            double elapsed = chunk_trial(&buffers, tune_chunks[i]);
+            fastest = elapsed < fastest ? elapsed : fastest;
+        }
+        if (i == 0 || fastest * TUNE_MARGIN < best) {
+            best = fastest;
+            profile_out->chunk_size = tune_chunks[i];
+        }
+    }
+
+#if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3) || defined(ENABLE_NEON)
+    // the smallest block length from which streaming stores keep winning, or none
+    profile_out->stream_threshold = SIZE_MAX;
+    for (size_t i = sizeof(tune_thresholds) / sizeof(tune_thresholds[0]); i-- > 0;) {
+        double cached = threshold_trial(&buffers, tune_thresholds[i], false);
+        double streamed = threshold_trial(&buffers, tune_thresholds[i], true);
+        for (int run = 1; run < TUNE_RUNS; ++run) {
+            double elapsed = threshold_trial(&buffers, tune_thresholds[i], false);
+            cached = elapsed < cached ? elapsed : cached;
+            elapsed = threshold_trial(&buffers, tune_thresholds[i], true);
+            streamed = elapsed < streamed ? elapsed : streamed;
+        }
+        if (streamed * TUNE_MARGIN >= cached)
+            break;
+        profile_out->stream_threshold = tune_thresholds[i];
+    }
+#endif
+    rcnb_store_stream_threshold(saved_threshold);
+
+    unsigned limit = processors();
+    for (unsigned threads = 1; threads <= limit; threads = threads < limit && 2 * threads > limit ? limit : 2 * threads) {
+        double fastest = thread_trial(&buffers, threads);
+        if (fastest < 0)
+            break;
+        for (int run = 1; run < TUNE_RUNS; ++run) {
+            double elapsed = thread_trial(&buffers, threads);
+            fastest = elapsed >= 0 && elapsed < fastest ? elapsed : fastest;
+        }
+        if (threads == 1 || fastest * TUNE_MARGIN < best) {
+            best = fastest;
+            profile_out->threads = threads;
+        }
+        if (threads == limit)
+            break;
+    }
+
+    free(buffers.plaintext);
+    rcnb_free_code(buffers.code);
+    return true;
+}
+
+bool rcnb_load_profile(rcnb_profile* profile_out, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return false;
+    rcnb_profile profile;
+    rcnb_init_profile(&profile);
+    profile.kernel[0] = 0;
+    char key[32];
+    char value[32];
+    bool ok = true;
+    while (ok && fscanf(file, "%31s %31s", key, value) == 2) {
+        unsigned long long number = strtoull(value, NULL, 10);
+        if (strcmp(key, "kernel") == 0) {
+            // a longer name is no kernel of this build, and cut short it could pass for one
+            size_t length = strlen(value);
+            ok = length < sizeof(profile.kernel);
+            if (ok)
+                memcpy(profile.kernel, value, length + 1);
+        } else if (strcmp(key, "chunk_size") == 0) {
+            // the C++ wrappers take it as an int
+            profile.chunk_size = (size_t)number;
+            ok = number > 0 && number <= RCNB_PROFILE_CHUNK_MAX;
+        } else if (strcmp(key, "stream_threshold") == 0) {
+            profile.stream_threshold = number > SIZE_MAX ? SIZE_MAX : (size_t)number;
+            ok = number >= RCNB_STREAM_THRESHOLD_MIN;
+        } else if (strcmp(key, "threads") == 0) {
+            ok = (profile.threads = (unsigned)number) > 0;
+        }
+        // other keys are left to later versions
+    }
+    ok = ok && !ferror(file);
+    fclose(file);
+    if (!ok)
+        return false;
+    *profile_out = profile;
+    return true;
+}
+
+bool rcnb_save_profile(const rcnb_profile* profile_in, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+    fprintf(file, "kernel %s\nchunk_size %llu\nstream_threshold %llu\nthreads %u\n", profile_in->kernel,
+            (unsigned long long)profile_in->chunk_size, (unsigned long long)profile_in->stream_threshold,
+            profile_in->threads);
+    return fclose(file) == 0;
+}
+
+bool rcnb_profile_path(char* path_out, size_t length)
+{
+    const char* path = getenv("RCNB_PROFILE");
+    int written;
+    if (path && *path) {
+        written = snprintf(path_out, length, "%s", path);
+    } else {
+#ifdef _WIN32
+        const char* directory = getenv("APPDATA");
+        if (!directory || !*directory)
+            return false;
+        written = snprintf(path_out, length, "%s\\rcnb\\profile", directory);
+#else
+        const char* directory = getenv("XDG_CONFIG_HOME");
+        if (directory && *directory) {
+            written = snprintf(path_out, length, "%s/rcnb/profile", directory);
+        } else {
+            directory = getenv("HOME");
+            if (!directory || !*directory)
+                return false;
+            written = snprintf(path_out, length, "%s/.config/rcnb/profile", directory);
+        }
+#endif
+    }
+    return written > 0 && (size_t)written < length;
+}
+
+// The profile in effect is never changed in place: rcnb_set_profile publishes a new copy, and the ones handed out
+// before stay valid for the threads still reading them.
+static rcnb_profile loaded_profile;
+static const rcnb_profile* current_profile;
+
+#if defined(_MSC_VER)
+#define load_current() ((const rcnb_profile*)_InterlockedCompareExchangePointer((void* volatile*)&current_profile, \
+        NULL, NULL))
+#define store_current(value) _InterlockedExchangePointer((void* volatile*)&current_profile, (void*)(value))
+#else
+#define load_current() __atomic_load_n(&current_profile, __ATOMIC_ACQUIRE)
+#define store_current(value) __atomic_store_n(&current_profile, value, __ATOMIC_RELEASE)
+#endif
+
+static void load_profile(void)
+{
+    rcnb_profile defaults;
+    char path[4096];
+    rcnb_init_profile(&defaults);
+    if (rcnb_profile_path(path, sizeof(path)) && rcnb_load_profile(&loaded_profile, path) &&
+        strcmp(loaded_profile.kernel, defaults.kernel) == 0) {
+        // a threshold the caller already set stays
+        if (!rcnb_stream_threshold_chosen())
+            rcnb_store_stream_threshold(loaded_profile.stream_threshold);
+    } else {
+        loaded_profile = defaults;
+    }
+    loaded_profile.stream_threshold = rcnb_get_stream_threshold();
+    store_current(&loaded_profile);
+}
+
+#ifdef _WIN32
+static INIT_ONCE profile_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK load_profile_once(PINIT_ONCE once, PVOID parameter, PVOID* context)
+{
+    (void)once;
+    (void)parameter;
+    (void)context;
+    load_profile();
+    return TRUE;
+}
+
+#define call_profile_once() InitOnceExecuteOnce(&profile_once, load_profile_once, NULL, NULL)
+#else
+static pthread_once_t profile_once = PTHREAD_ONCE_INIT;
+
+#define call_profile_once() pthread_once(&profile_once, load_profile)
+#endif
+
+const rcnb_profile* rcnb_get_profile(void)
+{
+    call_profile_once();
+    return load_current();
+}
+
+bool rcnb_set_profile(const rcnb_profile* profile_in)
+{
+    call_profile_once();
+    rcnb_profile* profile = (rcnb_profile*)malloc(sizeof(rcnb_profile));
+    if (!profile)
+        return false;
+    *profile = *profile_in;
+    if (profile->chunk_size == 0)
+        profile->chunk_size = 1;
+    else if (profile->chunk_size > RCNB_PROFILE_CHUNK_MAX)
+        profile->chunk_size = RCNB_PROFILE_CHUNK_MAX;
+    rcnb_set_stream_threshold(profile->stream_threshold);
+    profile->stream_threshold = rcnb_get_stream_threshold();
+    store_current(profile);
+    return true;
+}
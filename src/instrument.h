@@ -0,0 +1,39 @@
+/*
+instrument.h - private instrumentation hooks for the rcnb encoding algorithm
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+Counters are only updated when built with ENABLE_STATS, probes are only
+emitted when built with ENABLE_USDT. Otherwise every hook compiles to nothing.
+*/
+
+#ifndef RCNB_INSTRUMENT_H
+#define RCNB_INSTRUMENT_H
+
+#include <rcnb/cstats.h>
+
+#ifdef ENABLE_STATS
+extern rcnb_stats rcnb_stats_counters;
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define RCNB_STAT_ADD(field, n) \
+    _InterlockedExchangeAdd64((volatile __int64*)&rcnb_stats_counters.field, (__int64)(n))
+#else
+#define RCNB_STAT_ADD(field, n) \
+    __atomic_fetch_add(&rcnb_stats_counters.field, (unsigned long long)(n), __ATOMIC_RELAXED)
+#endif
+#else
+#define RCNB_STAT_ADD(field, n) ((void)0)
+#endif
+
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+#define RCNB_PROBE1(name, a) DTRACE_PROBE1(rcnb, name, a)
+#define RCNB_PROBE2(name, a, b) DTRACE_PROBE2(rcnb, name, a, b)
+#else
+#define RCNB_PROBE1(name, a) ((void)0)
+#define RCNB_PROBE2(name, a, b) ((void)0)
+#endif
+
+#endif // RCNB_INSTRUMENT_H
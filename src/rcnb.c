@@ -7,12 +7,33 @@ For details, see https://github.com/rikakomoe/librcnb
 
 #include <rcnb/rcnb.h>
 
-const wchar_t cr[] = {'r','R',L'Ŕ',L'ŕ',L'Ŗ',L'ŗ',L'Ř',L'ř',L'Ʀ',L'Ȑ',L'ȑ',L'Ȓ',L'ȓ',L'Ɍ',L'ɍ'};
-const wchar_t cc[] = {'c','C',L'Ć',L'ć',L'Ĉ',L'ĉ',L'Ċ',L'ċ',L'Č',L'č',L'Ƈ',L'ƈ',L'Ç',L'Ȼ',L'ȼ'};
-const wchar_t cn[] = {'n','N',L'Ń',L'ń',L'Ņ',L'ņ',L'Ň',L'ň',L'Ɲ',L'ƞ',L'Ñ',L'Ǹ',L'ǹ',L'Ƞ',L'ȵ'};
-const wchar_t cb[] = {'b','B',L'ƀ',L'Ɓ',L'ƃ',L'Ƅ',L'ƅ',L'ß',L'Þ',L'þ'};
-
-const unsigned short sr = sizeof(cr) / sizeof(wchar_t);
-const unsigned short sc = sizeof(cc) / sizeof(wchar_t);
-const unsigned short sn = sizeof(cn) / sizeof(wchar_t);
-const unsigned short sb = sizeof(cb) / sizeof(wchar_t);
+/* the tables below are what rcnb_init_alphabet derives from the code points */
+const rcnb_alphabet rcnb_builtin_alphabet = {
+    {'r','R',L'Ŕ',L'ŕ',L'Ŗ',L'ŗ',L'Ř',L'ř',L'Ʀ',L'Ȑ',L'ȑ',L'Ȓ',L'ȓ',L'Ɍ',L'ɍ'},
+    {'c','C',L'Ć',L'ć',L'Ĉ',L'ĉ',L'Ċ',L'ċ',L'Č',L'č',L'Ƈ',L'ƈ',L'Ç',L'Ȼ',L'ȼ'},
+    {'n','N',L'Ń',L'ń',L'Ņ',L'ņ',L'Ň',L'ň',L'Ɲ',L'ƞ',L'Ñ',L'Ǹ',L'ǹ',L'Ƞ',L'ȵ'},
+    {'b','B',L'ƀ',L'Ɓ',L'ƃ',L'Ƅ',L'ƅ',L'ß',L'Þ',L'þ'},
+    true,
+    {
+        {114, 82, 84, 85, 86, 87, 88, 89, 166, 16, 17, 18, 19, 76, 77},
+        {99, 67, 6, 7, 8, 9, 10, 11, 12, 13, 135, 136, 199, 59, 60},
+        {110, 78, 67, 68, 69, 70, 71, 72, 157, 158, 209, 248, 249, 32, 53},
+        {98, 66, 128, 129, 131, 132, 133, 223, 222, 254}
+    },
+    {
+        {0, 0, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2},
+        {0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 2, 2},
+        {0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 2, 2},
+        {0, 0, 1, 1, 1, 1, 1, 0, 0, 0}
+    },
+    {4675, 11482, 9726, 2559},
+    {0, 0, 0, 0},
+    {
+        {14, 8, 0, 255, 2, 3, 4, 5, 6, 7, 9, 10, 11, 1, 12, 13},
+        {13, 3, 9, 14, 4, 0, 5, 255, 10, 6, 11, 1, 7, 12, 2, 8},
+        {10, 3, 255, 4, 8, 0, 5, 9, 6, 1, 7, 13, 11, 14, 2, 12},
+        {3, 4, 5, 6, 255, 255, 255, 255, 255, 1, 8, 7, 255, 0, 9, 2}
+    },
+    {77, 166, 114, 0, 84, 85, 86, 87, 88, 89, 16, 17, 18, 82, 19, 76},
+    {2, 1, 0, 0, 1, 1, 1, 1, 1, 1, 2, 2, 2, 0, 2, 2}
+};
@@ -10,16 +10,7 @@ For details, see https://github.com/rikakomoe/librcnb
 #include <arm_neon.h>
 #include <rcnb/cencode.h>
 #include <rcnb/cdecode.h>
-
-static const unsigned char r_lo[16] = {114, 82, 84, 85, 86, 87, 88, 89, 166, 16, 17, 18, 19, 76, 77};
-static const unsigned char c_lo[16] = {99, 67, 6, 7, 8, 9, 10, 11, 12, 13, 135, 136, 199, 59, 60};
-static const unsigned char n_lo[16] = {110, 78, 67, 68, 69, 70, 71, 72, 157, 158, 209, 248, 249, 32, 53};
-static const unsigned char b_lo[16] = {98, 66, 128, 129, 131, 132, 133, 223, 222, 254};
-
-static const unsigned char r_hi[16] = {0, 0, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2};
-static const unsigned char c_hi[16] = {0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 2, 2};
-static const unsigned char n_hi[16] = {0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 2, 2};
-static const unsigned char b_hi[16] = {0, 0, 1, 1, 1, 1, 1, 0, 0, 0};
+#include <rcnb/rcnb.h>
 
 static const unsigned char s_tbl[16] = {0, 0, 255, 255, 255, 0, 255, 0};
 
@@ -28,8 +19,16 @@ static const unsigned char c_tbl[16] = {13, 3, 9, 14, 4, 0, 5, 255, 10, 6, 11, 1
 static const unsigned char n_tbl[16] = {10, 3, 255, 4, 8, 0, 5, 9, 6, 1, 7, 13, 11, 14, 2, 12};
 static const unsigned char b_tbl[16] = {2, 3, 255, 255, 4, 255, 5, 6, 8, 7, 255, 1, 9, 255, 255, 0};
 
-void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n) {
+void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
     const int16x8_t mask = vdupq_n_s16(0x7fff);
+    const uint8x16_t r_lo = vld1q_u8(alphabet->lo[0]);
+    const uint8x16_t c_lo = vld1q_u8(alphabet->lo[1]);
+    const uint8x16_t n_lo = vld1q_u8(alphabet->lo[2]);
+    const uint8x16_t b_lo = vld1q_u8(alphabet->lo[3]);
+    const uint8x16_t r_hi = vld1q_u8(alphabet->hi[0]);
+    const uint8x16_t c_hi = vld1q_u8(alphabet->hi[1]);
+    const uint8x16_t n_hi = vld1q_u8(alphabet->hi[2]);
+    const uint8x16_t b_hi = vld1q_u8(alphabet->hi[3]);
     for (size_t i = 0; i < n; ++i) {
         int16x8_t sinput1 = (int16x8_t) vrev16q_s8(vld1q_s8((const signed char *) value_in));
         int16x8_t sinput2 = (int16x8_t) vrev16q_s8(vld1q_s8((const signed char *) (value_in + 16)));
@@ -97,14 +96,14 @@ void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n) {
         uint8x8_t idx_bt = vmovn_u16(idx_b1);
         uint8x16_t idx_b = vmovn_high_u16(idx_bt, idx_b2);
 
-        uint8x16_t r_l = vqtbl1q_u8(vld1q_u8(r_lo), idx_r);
-        uint8x16_t r_h = vqtbl1q_u8(vld1q_u8(r_hi), idx_r);
-        uint8x16_t c_l = vqtbl1q_u8(vld1q_u8(c_lo), idx_c);
-        uint8x16_t c_h = vqtbl1q_u8(vld1q_u8(c_hi), idx_c);
-        uint8x16_t n_l = vqtbl1q_u8(vld1q_u8(n_lo), idx_n);
-        uint8x16_t n_h = vqtbl1q_u8(vld1q_u8(n_hi), idx_n);
-        uint8x16_t b_l = vqtbl1q_u8(vld1q_u8(b_lo), idx_b);
-        uint8x16_t b_h = vqtbl1q_u8(vld1q_u8(b_hi), idx_b);
+        uint8x16_t r_l = vqtbl1q_u8(r_lo, idx_r);
+        uint8x16_t r_h = vqtbl1q_u8(r_hi, idx_r);
+        uint8x16_t c_l = vqtbl1q_u8(c_lo, idx_c);
+        uint8x16_t c_h = vqtbl1q_u8(c_hi, idx_c);
+        uint8x16_t n_l = vqtbl1q_u8(n_lo, idx_n);
+        uint8x16_t n_h = vqtbl1q_u8(n_hi, idx_n);
+        uint8x16_t b_l = vqtbl1q_u8(b_lo, idx_b);
+        uint8x16_t b_h = vqtbl1q_u8(b_hi, idx_b);
 
         uint16x8_t r1t = (uint16x8_t) vzip1q_u8(r_l, r_h);
         uint16x8_t r2t = (uint16x8_t) vzip2q_u8(r_l, r_h);
@@ -174,8 +173,23 @@ void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n) {
     }
 }
 
-int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
+// Sets the bytes of the units that are not the code point their index stands for. The hashes send every unit to
+// some slot, so a unit outside the set that lands in an occupied one is only caught here.
+static inline uint8x16_t mismatch_u8(uint16x8_t unit1, uint16x8_t unit2, uint8x16_t index,
+                                     uint8x16_t lo, uint8x16_t hi) {
+    uint8x16_t unit_lo = vcombine_u8(vmovn_u16(unit1), vmovn_u16(unit2));
+    uint8x16_t unit_hi = vcombine_u8(vshrn_n_u16(unit1, 8), vshrn_n_u16(unit2, 8));
+    return vmvnq_u8(vandq_u8(vceqq_u8(vqtbl1q_u8(lo, index), unit_lo),
+                             vceqq_u8(vqtbl1q_u8(hi, index), unit_hi)));
+}
+
+static int decode_32n_builtin(const char *value_in, char *value_out, size_t n) {
     uint16x8x4_t rcnb1, rcnb2;
+    uint8x16_t lo[4], hi[4];
+    for (int s = 0; s < 4; ++s) {
+        lo[s] = vld1q_u8(rcnb_builtin_alphabet.lo[s]);
+        hi[s] = vld1q_u8(rcnb_builtin_alphabet.hi[s]);
+    }
     for (size_t i = 0; i < n; ++i) {
         if (sizeof(wchar_t) == 2) {
             rcnb1 = vld4q_u16((const unsigned short *) value_in);
@@ -185,18 +199,18 @@ int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
             uint32x4x4_t tmp1, tmp2;
             tmp1 = vld4q_u32((const unsigned int *) value_in);
             tmp2 = vld4q_u32((const unsigned int *) (value_in + 64));
-            rcnb1.val[0] = vcombine_u16(vmovn_u32(tmp1.val[0]), vmovn_u32(tmp2.val[0]));
-            rcnb1.val[1] = vcombine_u16(vmovn_u32(tmp1.val[1]), vmovn_u32(tmp2.val[1]));
-            rcnb1.val[2] = vcombine_u16(vmovn_u32(tmp1.val[2]), vmovn_u32(tmp2.val[2]));
-            rcnb1.val[3] = vcombine_u16(vmovn_u32(tmp1.val[3]), vmovn_u32(tmp2.val[3]));
+            rcnb1.val[0] = vcombine_u16(vqmovn_u32(tmp1.val[0]), vqmovn_u32(tmp2.val[0]));
+            rcnb1.val[1] = vcombine_u16(vqmovn_u32(tmp1.val[1]), vqmovn_u32(tmp2.val[1]));
+            rcnb1.val[2] = vcombine_u16(vqmovn_u32(tmp1.val[2]), vqmovn_u32(tmp2.val[2]));
+            rcnb1.val[3] = vcombine_u16(vqmovn_u32(tmp1.val[3]), vqmovn_u32(tmp2.val[3]));
             value_in += 128;
 
             tmp1 = vld4q_u32((const unsigned int *) value_in);
             tmp2 = vld4q_u32((const unsigned int *) (value_in + 64));
-            rcnb2.val[0] = vcombine_u16(vmovn_u32(tmp1.val[0]), vmovn_u32(tmp2.val[0]));
-            rcnb2.val[1] = vcombine_u16(vmovn_u32(tmp1.val[1]), vmovn_u32(tmp2.val[1]));
-            rcnb2.val[2] = vcombine_u16(vmovn_u32(tmp1.val[2]), vmovn_u32(tmp2.val[2]));
-            rcnb2.val[3] = vcombine_u16(vmovn_u32(tmp1.val[3]), vmovn_u32(tmp2.val[3]));
+            rcnb2.val[0] = vcombine_u16(vqmovn_u32(tmp1.val[0]), vqmovn_u32(tmp2.val[0]));
+            rcnb2.val[1] = vcombine_u16(vqmovn_u32(tmp1.val[1]), vqmovn_u32(tmp2.val[1]));
+            rcnb2.val[2] = vcombine_u16(vqmovn_u32(tmp1.val[2]), vqmovn_u32(tmp2.val[2]));
+            rcnb2.val[3] = vcombine_u16(vqmovn_u32(tmp1.val[3]), vqmovn_u32(tmp2.val[3]));
             value_in += 128;
         }
 
@@ -219,24 +233,27 @@ int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
         sign1 = vshlq_n_u16(sign1, 15);
         sign2 = vshlq_n_u16(sign2, 15);
 
-        r_c1 = vshrq_n_u16(vmulq_n_u16(r_c1, 4675), 12);
-        c_c1 = vshrq_n_u16(vmulq_n_u16(c_c1, 11482), 12);
-        n_c1 = vshrq_n_u16(vmulq_n_u16(n_c1, 9726), 12);
-        b_c1 = vsraq_n_u16(vsraq_n_u16(b_c1, b_c1, 1), b_c1, 3);
+        uint16x8_t r_h1 = vshrq_n_u16(vmulq_n_u16(r_c1, 4675), 12);
+        uint16x8_t c_h1 = vshrq_n_u16(vmulq_n_u16(c_c1, 11482), 12);
+        uint16x8_t n_h1 = vshrq_n_u16(vmulq_n_u16(n_c1, 9726), 12);
+        uint16x8_t b_h1 = vsraq_n_u16(vsraq_n_u16(b_c1, b_c1, 1), b_c1, 3);
 
-        r_c2 = vshrq_n_u16(vmulq_n_u16(r_c2, 4675), 12);
-        c_c2 = vshrq_n_u16(vmulq_n_u16(c_c2, 11482), 12);
-        n_c2 = vshrq_n_u16(vmulq_n_u16(n_c2, 9726), 12);
-        b_c2 = vsraq_n_u16(vsraq_n_u16(b_c2, b_c2, 1), b_c2, 3);
+        uint16x8_t r_h2 = vshrq_n_u16(vmulq_n_u16(r_c2, 4675), 12);
+        uint16x8_t c_h2 = vshrq_n_u16(vmulq_n_u16(c_c2, 11482), 12);
+        uint16x8_t n_h2 = vshrq_n_u16(vmulq_n_u16(n_c2, 9726), 12);
+        uint16x8_t b_h2 = vsraq_n_u16(vsraq_n_u16(b_c2, b_c2, 1), b_c2, 3);
 
-        uint8x16_t r_v = vqtbl1q_u8(vld1q_u8(r_tbl), vcombine_u8(vmovn_u16(r_c1), vmovn_u16(r_c2)));
-        uint8x16_t c_v = vqtbl1q_u8(vld1q_u8(c_tbl), vcombine_u8(vmovn_u16(c_c1), vmovn_u16(c_c2)));
-        uint8x16_t n_v = vqtbl1q_u8(vld1q_u8(n_tbl), vcombine_u8(vmovn_u16(n_c1), vmovn_u16(n_c2)));
-        uint8x16_t b_v = vqtbl1q_u8(vld1q_u8(b_tbl), vbicq_u8(vcombine_u8(vmovn_u16(b_c1), vmovn_u16(b_c2)), vdupq_n_u8(0xf0)));
+        uint8x16_t r_v = vqtbl1q_u8(vld1q_u8(r_tbl), vcombine_u8(vmovn_u16(r_h1), vmovn_u16(r_h2)));
+        uint8x16_t c_v = vqtbl1q_u8(vld1q_u8(c_tbl), vcombine_u8(vmovn_u16(c_h1), vmovn_u16(c_h2)));
+        uint8x16_t n_v = vqtbl1q_u8(vld1q_u8(n_tbl), vcombine_u8(vmovn_u16(n_h1), vmovn_u16(n_h2)));
+        uint8x16_t b_v = vqtbl1q_u8(vld1q_u8(b_tbl), vbicq_u8(vcombine_u8(vmovn_u16(b_h1), vmovn_u16(b_h2)), vdupq_n_u8(0xf0)));
 
         uint8x16_t bad_cv = vdupq_n_u8(0xff);
         uint8x16_t bad_v = vorrq_u8(vorrq_u8(vceqq_u8(r_v, bad_cv), vceqq_u8(c_v, bad_cv)),
                                     vorrq_u8(vceqq_u8(n_v, bad_cv), vceqq_u8(b_v, bad_cv)));
+        bad_v = vorrq_u8(bad_v, vorrq_u8(
+                vorrq_u8(mismatch_u8(r_c1, r_c2, r_v, lo[0], hi[0]), mismatch_u8(c_c1, c_c2, c_v, lo[1], hi[1])),
+                vorrq_u8(mismatch_u8(n_c1, n_c2, n_v, lo[2], hi[2]), mismatch_u8(b_c1, b_c2, b_v, lo[3], hi[3]))));
 
         uint16x8_t rn1 = vmovl_u8(vget_low_u8(n_v));
         uint16x8_t rn2 = vmovl_u8(vget_high_u8(n_v));
@@ -255,6 +272,11 @@ int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
         uint16x8x2_t result;
         result.val[0] = vmlaq_n_u16(cb1, rn1, 10);
         result.val[1] = vmlaq_n_u16(cb2, rn2, 10);
+
+        if (vmaxvq_u16(vorrq_u16(result.val[0], result.val[1])) > 0x7fff) {
+            return 0;
+        }
+
         result.val[0] = vorrq_u16(result.val[0], sign1);
         result.val[1] = vorrq_u16(result.val[1], sign2);
         result.val[0] = (uint16x8_t)vrev16q_u8((uint8x16_t)result.val[0]);
@@ -267,4 +289,136 @@ int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
     return 1;
 }
 
+void rcnb_match_16n_asm(const char *value_in, unsigned short *mask_out, size_t n, unsigned char first,
+                        unsigned char last, size_t distance) {
+    uint8x16_t head = vdupq_n_u8(first);
+    uint8x16_t tail = vdupq_n_u8(last);
+    for (size_t i = 0; i < n; ++i) {
+        uint8x16_t at_head = vceqq_u8(vld1q_u8((const uint8_t *) value_in), head);
+        uint8x16_t at_tail = vceqq_u8(vld1q_u8((const uint8_t *) (value_in + distance)), tail);
+        mask_out[i] = movemask_u8(vandq_u8(at_head, at_tail));
+        value_in += 16;
+    }
+}
+
+size_t rcnb_find_mark_16n_asm(const char *value_in, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t marks;
+        if (sizeof(wchar_t) == 2) {
+            uint16x8_t base = vdupq_n_u16(0x300);
+            uint16x8_t high = vdupq_n_u16(0x70);
+            uint16x8_t unit1 = vsubq_u16(vld1q_u16((const unsigned short *) value_in), base);
+            uint16x8_t unit2 = vsubq_u16(vld1q_u16((const unsigned short *) (value_in + 16)), base);
+            marks = vmaxvq_u16(vorrq_u16(vcltq_u16(unit1, high), vcltq_u16(unit2, high)));
+            value_in += 32;
+        } else {
+            uint32x4_t base = vdupq_n_u32(0x300);
+            uint32x4_t high = vdupq_n_u32(0x70);
+            uint32x4_t any = vdupq_n_u32(0);
+            for (int k = 0; k < 4; ++k)
+                any = vorrq_u32(any, vcltq_u32(vsubq_u32(vld1q_u32((const unsigned int *) (value_in + 16 * k)), base),
+                                               high));
+            marks = vmaxvq_u32(any);
+            value_in += 64;
+        }
+        if (marks)
+            return i;
+    }
+    return n;
+}
+
+int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
+    if (alphabet == &rcnb_builtin_alphabet)
+        return decode_32n_builtin(value_in, value_out, n);
+    // Other alphabets decode on the scalar path until a vector kernel for them can be built and tested on arm64.
+    const wchar_t *code = (const wchar_t *) value_in;
+    for (size_t i = 0; i < 16 * n; ++i)
+        if (!rcnb_decode_short(code + 4 * i, &value_out, alphabet))
+            return 0;
+    return 1;
+}
+
+void rcnb_encode_32n_stream_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
+    // NEON has no non-temporal store intrinsic, so only prefetch the input ahead of the regular kernel.
+    for (size_t i = 0; i < n; i += 16) {
+        size_t batch = n - i < 16 ? n - i : 16;
+        __builtin_prefetch(value_in + 32 * (i + batch), 0, 0);
+        rcnb_encode_32n_asm(value_in + 32 * i, value_out + 64 * sizeof(wchar_t) * i, batch, alphabet);
+    }
+}
+
+void rcnb_encode_tail_asm(const char *value_in, char *value_out, size_t length, const rcnb_alphabet *alphabet) {
+    // The NEON tail stays on the scalar encoder until a vector variant can be built and tested on arm64.
+    wchar_t *code = (wchar_t *) value_out;
+    for (size_t i = 0; i < length; i += 2)
+        rcnb_encode_short((unsigned short) ((unsigned char) value_in[i] << 8 | (unsigned char) value_in[i + 1]), &code,
+                          alphabet);
+}
+
+int rcnb_decode_tail_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
+    // Like the encoder tail, decode the remaining groups on the scalar path.
+    const wchar_t *code = (const wchar_t *) value_in;
+    for (size_t i = 0; i < n; ++i)
+        if (!rcnb_decode_short(code + 4 * i, &value_out, alphabet))
+            return 0;
+    return 1;
+}
+
+// Hashes each code unit to its slot, (u * mul + add) mod 2^16 >> 12.
+#define hash_u16(u, s) vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(alphabet->add[s]), u, alphabet->mul[s]), 12)
+
+// Packs a byte mask into one bit per byte, as movemask does on x86.
+static inline unsigned short movemask_u8(uint8x16_t mask) {
+    static const unsigned char weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t bits = vandq_u8(mask, vld1q_u8(weights));
+    return (unsigned short) (vaddv_u8(vget_low_u8(bits)) | vaddv_u8(vget_high_u8(bits)) << 8);
+}
+
+// Looks up the code point each unit's hash slot holds in every set, which it is a member of if they are equal.
+void rcnb_classify_16n_asm(const char *value_in, unsigned short *mask_out, size_t n, const rcnb_alphabet *alphabet) {
+    uint8x16_t tbl[4], lo[4], hi[4];
+    for (int s = 0; s < 4; ++s) {
+        tbl[s] = vld1q_u8(alphabet->index[s]);
+        lo[s] = vld1q_u8(alphabet->lo[s]);
+        hi[s] = vld1q_u8(alphabet->hi[s]);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        uint16x8_t unit1, unit2;
+        if (sizeof(wchar_t) == 2) {
+            unit1 = vld1q_u16((const unsigned short *) value_in);
+            unit2 = vld1q_u16((const unsigned short *) (value_in + 16));
+            value_in += 32;
+        } else if (sizeof(wchar_t) == 4) {
+            // units above U+FFFF saturate to 0xFFFF, which no alphabet holds
+            unit1 = vcombine_u16(vqmovn_u32(vld1q_u32((const unsigned int *) value_in)),
+                                 vqmovn_u32(vld1q_u32((const unsigned int *) (value_in + 16))));
+            unit2 = vcombine_u16(vqmovn_u32(vld1q_u32((const unsigned int *) (value_in + 32))),
+                                 vqmovn_u32(vld1q_u32((const unsigned int *) (value_in + 48))));
+            value_in += 64;
+        }
+
+        uint8x16_t unit_lo = vcombine_u8(vmovn_u16(unit1), vmovn_u16(unit2));
+        uint8x16_t unit_hi = vcombine_u8(vshrn_n_u16(unit1, 8), vshrn_n_u16(unit2, 8));
+        uint8x16_t rn = vdupq_n_u8(0);
+        uint8x16_t cb = vdupq_n_u8(0);
+        for (int s = 0; s < 4; ++s) {
+            uint8x16_t idx = vqtbl1q_u8(tbl[s], vcombine_u8(vmovn_u16(hash_u16(unit1, s)),
+                                                            vmovn_u16(hash_u16(unit2, s))));
+            // an empty slot looks up 0 in both bytes, which U+0000 would match
+            uint8x16_t hit = vandq_u8(vceqq_u8(vqtbl1q_u8(lo[s], idx), unit_lo),
+                                      vceqq_u8(vqtbl1q_u8(hi[s], idx), unit_hi));
+            hit = vbicq_u8(hit, vceqq_u8(idx, vdupq_n_u8(0xFF)));
+            if (s % 2 == 0)
+                rn = vorrq_u8(rn, hit);
+            else
+                cb = vorrq_u8(cb, hit);
+        }
+        mask_out[0] = movemask_u8(rn);
+        mask_out[1] = movemask_u8(cb);
+        mask_out += 2;
+    }
+}
+
+#undef hash_u16
+
 #endif
@@ -8,8 +8,10 @@ For details, see https://github.com/rikakomoe/librcnb
 #if defined(ENABLE_AVX2) || defined(ENABLE_SSSE3)
 
 #include <immintrin.h>
+#include <string.h>
 #include <rcnb/cencode.h>
 #include <rcnb/cdecode.h>
+#include <rcnb/rcnb.h>
 
 typedef struct concat_tbl {
     unsigned char first[16];
@@ -18,23 +20,6 @@ typedef struct concat_tbl {
 
 static const unsigned char swizzle[16] = {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14};
 
-static const concat_tbl rc_lo = {
-        {114, 82, 84, 85, 86, 87, 88, 89, 166, 16, 17, 18, 19, 76, 77},
-        {99, 67, 6, 7, 8, 9, 10, 11, 12, 13, 135, 136, 199, 59, 60}
-};
-static const concat_tbl rc_hi = {
-        {0, 0, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2},
-        {0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 2, 2}
-};
-static const concat_tbl nb_lo = {
-        {110, 78, 67, 68, 69, 70, 71, 72, 157, 158, 209, 248, 249, 32, 53},
-        {98, 66, 128, 129, 131, 132, 133, 223, 222, 254}
-};
-static const concat_tbl nb_hi = {
-        {0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 2, 2},
-        {0, 0, 1, 1, 1, 1, 1, 0, 0, 0}
-};
-
 static const concat_tbl rc_tbl = {
         {14, 8, 0, 255, 2, 3, 4, 5, 6, 7, 9, 10, 11, 1, 12, 13},
         {13, 3, 9, 14, 4, 0, 5, 255, 10, 6, 11, 1, 7, 12, 2, 8}
@@ -56,20 +41,373 @@ static const concat_tbl mul_c = {
 // Mark this as potentially non-const to force Clang using vpermd.
 static unsigned int permuted[8] = {0, 4, 1, 5, 2, 6, 3, 7};
 static unsigned char shuffler[16] = {0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15};
-void unused_force_clang_use_vpermd() { permuted[0] = 0; }
-void unused_force_clang_use_vpshufb() { shuffler[0] = 0; }
+RCNB_API void unused_force_clang_use_vpermd() { permuted[0] = 0; }
+RCNB_API void unused_force_clang_use_vpshufb() { shuffler[0] = 0; }
 #else
 static const unsigned int permuted[8] = {0, 4, 1, 5, 2, 6, 3, 7};
 static const unsigned char shuffler[16] = {0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15};
 #endif
-#endif
 
-#ifdef ENABLE_SSSE3
+// Input bytes ahead of the current batch that the streaming kernels prefetch.
+#define RCNB_PREFETCH_DISTANCE 512
 
 #define mm_blendv_epi8(a, b, mask) _mm_or_si128(_mm_and_si128(mask, b), _mm_andnot_si128(mask, a))
 
-void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n) {
+// Encodes the 8 big-endian shorts in input into 32 code units.
+static inline void encode_16_sse(__m128i input, __m128i *rcnb, const rcnb_alphabet *alphabet) {
+    input = _mm_shuffle_epi8(input, *(__m128i *) &swizzle);
+    __m128i sign = _mm_srai_epi16(input, 15);
+    input = _mm_and_si128(input, _mm_set1_epi16(0x7fff));
+
+    __m128i idx_r16 = _mm_srli_epi16(_mm_mulhi_epu16(input, _mm_set1_epi16(-5883)), 11);
+    __m128i r_mul_2250 = _mm_mullo_epi16(idx_r16, _mm_set1_epi16(2250));
+    __m128i i_mod_2250 = _mm_sub_epi16(input, r_mul_2250);
+    __m128i idx_c16 = _mm_srli_epi16(_mm_mulhi_epu16(i_mod_2250, _mm_set1_epi16(-9611)), 7);
+    __m128i c_mul_150 = _mm_add_epi16(r_mul_2250, _mm_mullo_epi16(idx_c16, _mm_set1_epi16(150)));
+    __m128i i_mod_150 = _mm_sub_epi16(input, c_mul_150);
+    __m128i idx_n16 = _mm_srli_epi16(_mm_mulhi_epu16(i_mod_150, _mm_set1_epi16(-13107)), 3);
+    __m128i n_mul_10 = _mm_add_epi16(c_mul_150, _mm_mullo_epi16(idx_n16, _mm_set1_epi16(10)));
+    __m128i idx_b16 = _mm_sub_epi16(input, n_mul_10);
+
+    __m128i idx_r = _mm_packus_epi16(idx_r16, idx_r16);
+    __m128i idx_c = _mm_packus_epi16(idx_c16, idx_c16);
+    __m128i idx_n = _mm_packus_epi16(idx_n16, idx_n16);
+    __m128i idx_b = _mm_packus_epi16(idx_b16, idx_b16);
+
+    __m128i r = _mm_unpacklo_epi8(_mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->lo[0]), idx_r),
+                                  _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->hi[0]), idx_r));
+    __m128i c = _mm_unpacklo_epi8(_mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->lo[1]), idx_c),
+                                  _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->hi[1]), idx_c));
+    __m128i n = _mm_unpacklo_epi8(_mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->lo[2]), idx_n),
+                                  _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->hi[2]), idx_n));
+    __m128i b = _mm_unpacklo_epi8(_mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->lo[3]), idx_b),
+                                  _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->hi[3]), idx_b));
+
+    __m128i rc1_t = _mm_unpacklo_epi16(r, c);
+    __m128i rc2_t = _mm_unpackhi_epi16(r, c);
+    __m128i nb1_t = _mm_unpacklo_epi16(n, b);
+    __m128i nb2_t = _mm_unpackhi_epi16(n, b);
+
+    __m128i mask1 = _mm_unpacklo_epi16(sign, sign);
+    __m128i mask2 = _mm_unpackhi_epi16(sign, sign);
+
+    __m128i rc1 = mm_blendv_epi8(rc1_t, nb1_t, mask1);
+    __m128i rc2 = mm_blendv_epi8(rc2_t, nb2_t, mask2);
+    __m128i nb1 = mm_blendv_epi8(nb1_t, rc1_t, mask1);
+    __m128i nb2 = mm_blendv_epi8(nb2_t, rc2_t, mask2);
+
+    rcnb[0] = _mm_unpacklo_epi32(rc1, nb1);
+    rcnb[1] = _mm_unpackhi_epi32(rc1, nb1);
+    rcnb[2] = _mm_unpacklo_epi32(rc2, nb2);
+    rcnb[3] = _mm_unpackhi_epi32(rc2, nb2);
+}
+
+// Stores 8 code units, widening them when wchar_t is 32 bits.
+static inline char *store_code_sse(char *value_out, __m128i rcnb) {
+    if (sizeof(wchar_t) == 2) {
+        _mm_storeu_si128((__m128i *) value_out, rcnb);
+    } else if (sizeof(wchar_t) == 4) {
+        _mm_storeu_si128((__m128i *) value_out, _mm_unpacklo_epi16(rcnb, _mm_setzero_si128()));
+        _mm_storeu_si128((__m128i *) (value_out + 16), _mm_unpackhi_epi16(rcnb, _mm_setzero_si128()));
+    }
+    return value_out + 8 * sizeof(wchar_t);
+}
+
+void rcnb_encode_tail_asm(const char *value_in, char *value_out, size_t length, const rcnb_alphabet *alphabet) {
+    __m128i rcnb[4];
+    if (length >= 16) {
+        encode_16_sse(_mm_loadu_si128((__m128i *) value_in), rcnb, alphabet);
+        value_out = store_code_sse(value_out, rcnb[0]);
+        value_out = store_code_sse(value_out, rcnb[1]);
+        value_out = store_code_sse(value_out, rcnb[2]);
+        value_out = store_code_sse(value_out, rcnb[3]);
+        value_in += 16;
+        length -= 16;
+    }
+    if (length >= 8) {
+        encode_16_sse(_mm_loadl_epi64((__m128i *) value_in), rcnb, alphabet);
+        value_out = store_code_sse(value_out, rcnb[0]);
+        value_out = store_code_sse(value_out, rcnb[1]);
+        value_in += 8;
+        length -= 8;
+    }
+    if (length > 0) {
+        // 2, 4 or 6 bytes left, which would overrun both buffers with full-width loads and stores.
+        char input[8] = {0};
+        wchar_t code[16];
+        memcpy(input, value_in, length);
+        encode_16_sse(_mm_loadl_epi64((__m128i *) input), rcnb, alphabet);
+        store_code_sse(store_code_sse((char *) code, rcnb[0]), rcnb[1]);
+        memcpy(value_out, code, 2 * length * sizeof(wchar_t));
+    }
+}
+
+// Sets the bytes of the units that are not the code point their index stands for. The hashes send every unit to
+// some slot, so a unit outside the set that lands in an occupied one is only caught here.
+static inline __m128i mismatch_sse(__m128i unit1, __m128i unit2, __m128i index, __m128i lo, __m128i hi) {
+    __m128i unit_lo = _mm_packus_epi16(_mm_and_si128(unit1, _mm_set1_epi16(0xFF)),
+                                       _mm_and_si128(unit2, _mm_set1_epi16(0xFF)));
+    __m128i unit_hi = _mm_packus_epi16(_mm_srli_epi16(unit1, 8), _mm_srli_epi16(unit2, 8));
+    __m128i match = _mm_and_si128(_mm_cmpeq_epi8(_mm_shuffle_epi8(lo, index), unit_lo),
+                                  _mm_cmpeq_epi8(_mm_shuffle_epi8(hi, index), unit_hi));
+    return _mm_andnot_si128(match, _mm_set1_epi8(-1));
+}
+
+// Narrows 8 units, flagging those above U+7FFF, which saturate to a code point an alphabet may hold.
+static inline __m128i pack_units_sse(const char *value_in, __m128i *wide) {
+    __m128i unit_0 = _mm_loadu_si128((__m128i *) value_in);
+    __m128i unit_1 = _mm_loadu_si128((__m128i *) (value_in + 16));
+    __m128i limit = _mm_set1_epi32(0x7FFF);
+    *wide = _mm_or_si128(*wide, _mm_or_si128(_mm_cmpgt_epi32(unit_0, limit), _mm_cmpgt_epi32(unit_1, limit)));
+    return _mm_packs_epi32(unit_0, unit_1);
+}
+
+// Hashes each code unit to its slot, (u * mul + add) mod 2^16 >> 12.
+#define hash_epi16(u, s) _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(u, mul[s]), add[s]), 12)
+
+// Decodes 4 or 8 groups into 8 or 16 bytes with the tables rcnb_init_alphabet derived, which the built-in
+// alphabet carries as well. Four groups are decoded twice over, so only the low half of result is theirs.
+static inline int decode_16_sse(const char *value_in, size_t groups, __m128i *result, const rcnb_alphabet *alphabet) {
+    __m128i rcnb1, rcnb2, rcnb3, rcnb4;
+    __m128i mul[4], add[4];
+    for (int s = 0; s < 4; ++s) {
+        mul[s] = _mm_set1_epi16((short) alphabet->mul[s]);
+        add[s] = _mm_set1_epi16((short) alphabet->add[s]);
+    }
+
+    if (sizeof(wchar_t) == 2) {
+        rcnb1 = _mm_loadu_si128((__m128i *) value_in);
+        rcnb2 = _mm_loadu_si128((__m128i *) (value_in + 16));
+        rcnb3 = groups == 8 ? _mm_loadu_si128((__m128i *) (value_in + 32)) : rcnb1;
+        rcnb4 = groups == 8 ? _mm_loadu_si128((__m128i *) (value_in + 48)) : rcnb2;
+    } else {
+        __m128i wide = _mm_setzero_si128();
+        rcnb1 = pack_units_sse(value_in, &wide);
+        rcnb2 = pack_units_sse(value_in + 32, &wide);
+        rcnb3 = groups == 8 ? pack_units_sse(value_in + 64, &wide) : rcnb1;
+        rcnb4 = groups == 8 ? pack_units_sse(value_in + 96, &wide) : rcnb2;
+        if (_mm_movemask_epi8(wide)) {
+            return 0;
+        }
+    }
+
+    __m128i rcnb_04 = _mm_unpacklo_epi16(rcnb1, rcnb3);
+    __m128i rcnb_15 = _mm_unpackhi_epi16(rcnb1, rcnb3);
+    __m128i rcnb_26 = _mm_unpacklo_epi16(rcnb2, rcnb4);
+    __m128i rcnb_37 = _mm_unpackhi_epi16(rcnb2, rcnb4);
+
+    __m128i rcnb_0246_1 = _mm_unpacklo_epi16(rcnb_04, rcnb_26);
+    __m128i rcnb_0246_2 = _mm_unpackhi_epi16(rcnb_04, rcnb_26);
+    __m128i rcnb_1357_1 = _mm_unpacklo_epi16(rcnb_15, rcnb_37);
+    __m128i rcnb_1357_2 = _mm_unpackhi_epi16(rcnb_15, rcnb_37);
+
+    __m128i r_ct = _mm_unpacklo_epi16(rcnb_0246_1, rcnb_1357_1);
+    __m128i c_ct = _mm_unpackhi_epi16(rcnb_0246_1, rcnb_1357_1);
+    __m128i n_ct = _mm_unpacklo_epi16(rcnb_0246_2, rcnb_1357_2);
+    __m128i b_ct = _mm_unpackhi_epi16(rcnb_0246_2, rcnb_1357_2);
+
+    __m128i slot = hash_epi16(r_ct, 0);
+    __m128i expect = _mm_or_si128(
+            _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->check_lo), _mm_or_si128(slot, _mm_set1_epi16(-0x8000))),
+            _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->check_hi),
+                             _mm_or_si128(_mm_slli_epi16(slot, 8), _mm_set1_epi16(0x80))));
+    __m128i sign = _mm_andnot_si128(_mm_cmpeq_epi16(expect, r_ct), _mm_set1_epi16(-1));
+
+    __m128i r_c = mm_blendv_epi8(r_ct, n_ct, sign);
+    __m128i c_c = mm_blendv_epi8(c_ct, b_ct, sign);
+    __m128i n_c = mm_blendv_epi8(n_ct, r_ct, sign);
+    __m128i b_c = mm_blendv_epi8(b_ct, c_ct, sign);
+
+    __m128i r_v = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->index[0]),
+                                   _mm_packus_epi16(hash_epi16(r_c, 0), hash_epi16(r_c, 0)));
+    __m128i c_v = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->index[1]),
+                                   _mm_packus_epi16(hash_epi16(c_c, 1), hash_epi16(c_c, 1)));
+    __m128i n_v = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->index[2]),
+                                   _mm_packus_epi16(hash_epi16(n_c, 2), hash_epi16(n_c, 2)));
+    __m128i b_v = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) alphabet->index[3]),
+                                   _mm_packus_epi16(hash_epi16(b_c, 3), hash_epi16(b_c, 3)));
+
+    __m128i bad_v = _mm_or_si128(
+            _mm_or_si128(
+                    _mm_cmpeq_epi8(r_v, _mm_set1_epi8(-1)),
+                    _mm_cmpeq_epi8(c_v, _mm_set1_epi8(-1))
+            ),
+            _mm_or_si128(
+                    _mm_cmpeq_epi8(n_v, _mm_set1_epi8(-1)),
+                    _mm_cmpeq_epi8(b_v, _mm_set1_epi8(-1))
+            )
+    );
+    __m128i lo[4], hi[4];
+    for (int s = 0; s < 4; ++s) {
+        lo[s] = _mm_loadu_si128((__m128i *) alphabet->lo[s]);
+        hi[s] = _mm_loadu_si128((__m128i *) alphabet->hi[s]);
+    }
+    bad_v = _mm_or_si128(bad_v, _mm_or_si128(
+            _mm_or_si128(mismatch_sse(r_c, r_c, r_v, lo[0], hi[0]), mismatch_sse(c_c, c_c, c_v, lo[1], hi[1])),
+            _mm_or_si128(mismatch_sse(n_c, n_c, n_v, lo[2], hi[2]), mismatch_sse(b_c, b_c, b_v, lo[3], hi[3]))));
+    if (_mm_movemask_epi8(bad_v)) {
+        return 0;
+    }
+
+    __m128i rn = _mm_maddubs_epi16(*(__m128i *) mul_c.first, _mm_unpacklo_epi8(r_v, n_v));
+    __m128i cb = _mm_maddubs_epi16(*(__m128i *) mul_c.second, _mm_unpacklo_epi8(c_v, b_v));
+    __m128i value = _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(rn, 3), _mm_slli_epi16(rn, 1)), cb);
+    if (_mm_movemask_epi8(value) & 0xAAAA) {
+        return 0;
+    }
+    *result = _mm_shuffle_epi8(_mm_or_si128(value, _mm_slli_epi16(sign, 15)), *(__m128i *) &swizzle);
+    return 1;
+}
+
+int rcnb_decode_tail_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
+    __m128i result;
+    if (n >= 8) {
+        if (!decode_16_sse(value_in, 8, &result, alphabet))
+            return 0;
+        _mm_storeu_si128((__m128i *) value_out, result);
+        value_in += 32 * sizeof(wchar_t);
+        value_out += 16;
+        n -= 8;
+    }
+    if (n >= 4) {
+        if (!decode_16_sse(value_in, 4, &result, alphabet))
+            return 0;
+        _mm_storel_epi64((__m128i *) value_out, result);
+        value_in += 16 * sizeof(wchar_t);
+        value_out += 8;
+        n -= 4;
+    }
+    if (n > 0) {
+        // 1 to 3 groups left, which would overrun the code with full-width loads. Repeat the first of them to
+        // fill the rest, it is checked either way.
+        wchar_t code[16];
+        char plaintext[16];
+        for (size_t i = 0; i < 4; ++i)
+            memcpy(code + 4 * i, value_in + (i < n ? i : 0) * 4 * sizeof(wchar_t), 4 * sizeof(wchar_t));
+        if (!decode_16_sse((const char *) code, 4, &result, alphabet))
+            return 0;
+        _mm_storeu_si128((__m128i *) plaintext, result);
+        memcpy(value_out, plaintext, 2 * n);
+    }
+    return 1;
+}
+
+// Looks up the code point each unit's hash slot holds in every set, which it is a member of if they are equal.
+void rcnb_classify_16n_asm(const char *value_in, unsigned short *mask_out, size_t n, const rcnb_alphabet *alphabet) {
+    __m128i mul[4], add[4], tbl[4], lo[4], hi[4];
+    for (int s = 0; s < 4; ++s) {
+        mul[s] = _mm_set1_epi16((short) alphabet->mul[s]);
+        add[s] = _mm_set1_epi16((short) alphabet->add[s]);
+        tbl[s] = _mm_loadu_si128((__m128i *) alphabet->index[s]);
+        lo[s] = _mm_loadu_si128((__m128i *) alphabet->lo[s]);
+        hi[s] = _mm_loadu_si128((__m128i *) alphabet->hi[s]);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        __m128i unit1, unit2;
+        __m128i wide = _mm_setzero_si128();
+        if (sizeof(wchar_t) == 2) {
+            unit1 = _mm_loadu_si128((__m128i *) value_in);
+            unit2 = _mm_loadu_si128((__m128i *) (value_in + 16));
+            value_in += 32;
+        } else if (sizeof(wchar_t) == 4) {
+            __m128i unit_0 = _mm_loadu_si128((__m128i *) value_in);
+            __m128i unit_1 = _mm_loadu_si128((__m128i *) (value_in + 16));
+            __m128i unit_2 = _mm_loadu_si128((__m128i *) (value_in + 32));
+            __m128i unit_3 = _mm_loadu_si128((__m128i *) (value_in + 48));
+            // units above U+7FFF saturate to 0x7FFF, which an alphabet may hold, so they are masked out below
+            __m128i limit = _mm_set1_epi32(0x7FFF);
+            wide = _mm_packs_epi16(
+                    _mm_packs_epi32(_mm_cmpgt_epi32(unit_0, limit), _mm_cmpgt_epi32(unit_1, limit)),
+                    _mm_packs_epi32(_mm_cmpgt_epi32(unit_2, limit), _mm_cmpgt_epi32(unit_3, limit)));
+            unit1 = _mm_packs_epi32(unit_0, unit_1);
+            unit2 = _mm_packs_epi32(unit_2, unit_3);
+            value_in += 64;
+        }
+
+        __m128i unit_lo = _mm_packus_epi16(_mm_and_si128(unit1, _mm_set1_epi16(0xFF)),
+                                           _mm_and_si128(unit2, _mm_set1_epi16(0xFF)));
+        __m128i unit_hi = _mm_packus_epi16(_mm_srli_epi16(unit1, 8), _mm_srli_epi16(unit2, 8));
+        __m128i rn = _mm_setzero_si128();
+        __m128i cb = _mm_setzero_si128();
+        for (int s = 0; s < 4; ++s) {
+            __m128i idx = _mm_shuffle_epi8(tbl[s], _mm_packus_epi16(hash_epi16(unit1, s), hash_epi16(unit2, s)));
+            // an empty slot looks up 0 in both bytes, which U+0000 would match
+            __m128i hit = _mm_and_si128(_mm_cmpeq_epi8(_mm_shuffle_epi8(lo[s], idx), unit_lo),
+                                        _mm_cmpeq_epi8(_mm_shuffle_epi8(hi[s], idx), unit_hi));
+            hit = _mm_andnot_si128(_mm_cmpeq_epi8(idx, _mm_set1_epi8(-1)), hit);
+            if (s % 2 == 0)
+                rn = _mm_or_si128(rn, hit);
+            else
+                cb = _mm_or_si128(cb, hit);
+        }
+        mask_out[0] = (unsigned short) _mm_movemask_epi8(_mm_andnot_si128(wide, rn));
+        mask_out[1] = (unsigned short) _mm_movemask_epi8(_mm_andnot_si128(wide, cb));
+        mask_out += 2;
+    }
+}
+
+#undef hash_epi16
+
+void rcnb_match_16n_asm(const char *value_in, unsigned short *mask_out, size_t n, unsigned char first,
+                        unsigned char last, size_t distance) {
+    __m128i head = _mm_set1_epi8((char) first);
+    __m128i tail = _mm_set1_epi8((char) last);
+    for (size_t i = 0; i < n; ++i) {
+        __m128i at_head = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) value_in), head);
+        __m128i at_tail = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) (value_in + distance)), tail);
+        mask_out[i] = (unsigned short) _mm_movemask_epi8(_mm_and_si128(at_head, at_tail));
+        value_in += 16;
+    }
+}
+
+// A unit u is a mark when u - 0x300 lies in [0, 0x70) unsigned, which takes a single signed comparison once the
+// bias of the sign bit is added with the 0x300.
+size_t rcnb_find_mark_16n_asm(const char *value_in, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        __m128i marks;
+        if (sizeof(wchar_t) == 2) {
+            __m128i bias = _mm_set1_epi16(0x8000 - 0x300);
+            __m128i limit = _mm_set1_epi16(-0x8000 + 0x70);
+            __m128i unit1 = _mm_add_epi16(_mm_loadu_si128((__m128i *) value_in), bias);
+            __m128i unit2 = _mm_add_epi16(_mm_loadu_si128((__m128i *) (value_in + 16)), bias);
+            marks = _mm_or_si128(_mm_cmplt_epi16(unit1, limit), _mm_cmplt_epi16(unit2, limit));
+            value_in += 32;
+        } else {
+            __m128i bias = _mm_set1_epi32(0x7FFFFD00);
+            __m128i limit = _mm_set1_epi32(-0x7FFFFF90);
+            marks = _mm_setzero_si128();
+            for (int k = 0; k < 4; ++k) {
+                __m128i unit = _mm_add_epi32(_mm_loadu_si128((__m128i *) (value_in + 16 * k)), bias);
+                marks = _mm_or_si128(marks, _mm_cmplt_epi32(unit, limit));
+            }
+            value_in += 64;
+        }
+        if (_mm_movemask_epi8(marks))
+            return i;
+    }
+    return n;
+}
+#endif
+
+#ifdef ENABLE_SSSE3
+
+#define store_si128(p, v) (stream ? _mm_stream_si128(p, v) : _mm_storeu_si128(p, v))
+
+// With stream set, value_out must be 16-byte aligned and the stores bypass the cache.
+static inline void encode_32n(const char *value_in, char *value_out, size_t n, int stream,
+                              const rcnb_alphabet *alphabet) {
+    __m128i r_lo = _mm_loadu_si128((__m128i *) alphabet->lo[0]);
+    __m128i c_lo = _mm_loadu_si128((__m128i *) alphabet->lo[1]);
+    __m128i n_lo = _mm_loadu_si128((__m128i *) alphabet->lo[2]);
+    __m128i b_lo = _mm_loadu_si128((__m128i *) alphabet->lo[3]);
+    __m128i r_hi = _mm_loadu_si128((__m128i *) alphabet->hi[0]);
+    __m128i c_hi = _mm_loadu_si128((__m128i *) alphabet->hi[1]);
+    __m128i n_hi = _mm_loadu_si128((__m128i *) alphabet->hi[2]);
+    __m128i b_hi = _mm_loadu_si128((__m128i *) alphabet->hi[3]);
     for (size_t i = 0; i < n; ++i) {
+        if (stream)
+            _mm_prefetch(value_in + RCNB_PREFETCH_DISTANCE, _MM_HINT_NTA);
         __m128i input1 = _mm_loadu_si128((__m128i *) value_in);
         input1 = _mm_shuffle_epi8(input1, *(__m128i *) &swizzle);
         // 0xffff for neg, 0x0000 for pos
@@ -123,15 +461,15 @@ void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n) {
         __m128i idx_n = _mm_packus_epi16(idx_n1, idx_n2);
         __m128i idx_b = _mm_packus_epi16(idx_b1, idx_b2);
 
-        __m128i r_l = _mm_shuffle_epi8(*(__m128i *) &rc_lo.first, idx_r);
-        __m128i c_l = _mm_shuffle_epi8(*(__m128i *) &rc_lo.second, idx_c);
-        __m128i n_l = _mm_shuffle_epi8(*(__m128i *) &nb_lo.first, idx_n);
-        __m128i b_l = _mm_shuffle_epi8(*(__m128i *) &nb_lo.second, idx_b);
+        __m128i r_l = _mm_shuffle_epi8(r_lo, idx_r);
+        __m128i c_l = _mm_shuffle_epi8(c_lo, idx_c);
+        __m128i n_l = _mm_shuffle_epi8(n_lo, idx_n);
+        __m128i b_l = _mm_shuffle_epi8(b_lo, idx_b);
 
-        __m128i r_h = _mm_shuffle_epi8(*(__m128i *) &rc_hi.first, idx_r);
-        __m128i c_h = _mm_shuffle_epi8(*(__m128i *) &rc_hi.second, idx_c);
-        __m128i n_h = _mm_shuffle_epi8(*(__m128i *) &nb_hi.first, idx_n);
-        __m128i b_h = _mm_shuffle_epi8(*(__m128i *) &nb_hi.second, idx_b);
+        __m128i r_h = _mm_shuffle_epi8(r_hi, idx_r);
+        __m128i c_h = _mm_shuffle_epi8(c_hi, idx_c);
+        __m128i n_h = _mm_shuffle_epi8(n_hi, idx_n);
+        __m128i b_h = _mm_shuffle_epi8(b_hi, idx_b);
 
         __m128i r1 = _mm_unpacklo_epi8(r_l, r_h);
         __m128i r2 = _mm_unpackhi_epi8(r_l, r_h);
@@ -175,60 +513,69 @@ void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n) {
         __m128i rcnb8 = _mm_unpackhi_epi32(rc4, nb4);
 
         if (sizeof(wchar_t) == 2) {
-            _mm_storeu_si128((__m128i *) (value_out), rcnb1);
+            store_si128((__m128i *) (value_out), rcnb1);
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), rcnb2);
+            store_si128((__m128i *) (value_out), rcnb2);
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), rcnb3);
+            store_si128((__m128i *) (value_out), rcnb3);
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), rcnb4);
+            store_si128((__m128i *) (value_out), rcnb4);
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), rcnb5);
+            store_si128((__m128i *) (value_out), rcnb5);
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), rcnb6);
+            store_si128((__m128i *) (value_out), rcnb6);
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), rcnb7);
+            store_si128((__m128i *) (value_out), rcnb7);
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), rcnb8);
+            store_si128((__m128i *) (value_out), rcnb8);
             value_out += 16;
         } else if (sizeof(wchar_t) == 4) {
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb1, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb1, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb1, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb1, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb2, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb2, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb2, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb2, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb3, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb3, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb3, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb3, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb4, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb4, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb4, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb4, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb5, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb5, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb5, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb5, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb6, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb6, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb6, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb6, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb7, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb7, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb7, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb7, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb8, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpacklo_epi16(rcnb8, _mm_setzero_si128()));
             value_out += 16;
-            _mm_storeu_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb8, _mm_setzero_si128()));
+            store_si128((__m128i *) (value_out), _mm_unpackhi_epi16(rcnb8, _mm_setzero_si128()));
             value_out += 16;
         }
     }
 }
 
-int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
+void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
+    encode_32n(value_in, value_out, n, 0, alphabet);
+}
+
+void rcnb_encode_32n_stream_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
+    encode_32n(value_in, value_out, n, 1, alphabet);
+    _mm_sfence();
+}
+
+static int decode_32n_builtin(const char *value_in, char *value_out, size_t n) {
     __m128i rcnb1, rcnb2, rcnb3, rcnb4, rcnb5, rcnb6, rcnb7, rcnb8;
 
     __m128i s_t = *(__m128i *) &s_tbl;
@@ -243,6 +590,12 @@ int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
 
     __m128i r_swizzle = *(__m128i *) &swizzle;
 
+    __m128i lo[4], hi[4];
+    for (int s = 0; s < 4; ++s) {
+        lo[s] = _mm_loadu_si128((__m128i *) rcnb_builtin_alphabet.lo[s]);
+        hi[s] = _mm_loadu_si128((__m128i *) rcnb_builtin_alphabet.hi[s]);
+    }
+
     for (size_t i = 0; i < n; ++i) {
         if (sizeof(wchar_t) == 2) {
             rcnb1 = _mm_loadu_si128((__m128i *) value_in);
@@ -374,6 +727,176 @@ int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
                         _mm_cmpeq_epi8(b_v, _mm_set1_epi8(-1))
                 )
         );
+        bad_v = _mm_or_si128(bad_v, _mm_or_si128(
+                _mm_or_si128(mismatch_sse(r_c1, r_c2, r_v, lo[0], hi[0]), mismatch_sse(c_c1, c_c2, c_v, lo[1], hi[1])),
+                _mm_or_si128(mismatch_sse(n_c1, n_c2, n_v, lo[2], hi[2]), mismatch_sse(b_c1, b_c2, b_v, lo[3], hi[3]))));
+
+        __m128i rn_1 = _mm_unpacklo_epi8(r_v, n_v);
+        __m128i rn_2 = _mm_unpackhi_epi8(r_v, n_v);
+        __m128i cb_1 = _mm_unpacklo_epi8(c_v, b_v);
+        __m128i cb_2 = _mm_unpackhi_epi8(c_v, b_v);
+        rn_1 = _mm_maddubs_epi16(mul_rc, rn_1);
+        rn_2 = _mm_maddubs_epi16(mul_rc, rn_2);
+        cb_1 = _mm_maddubs_epi16(mul_nb, cb_1);
+        cb_2 = _mm_maddubs_epi16(mul_nb, cb_2);
+
+        if (_mm_movemask_epi8(bad_v)) {
+            return 0;
+        }
+
+        __m128i result1 = _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(rn_1, 3), _mm_slli_epi16(rn_1, 1)), cb_1);
+        __m128i result2 = _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(rn_2, 3), _mm_slli_epi16(rn_2, 1)), cb_2);
+
+        if (_mm_movemask_epi8(_mm_or_si128(result1, result2)) & 0xAAAA) {
+            return 0;
+        }
+
+        result1 = _mm_or_si128(result1, sign1);
+        result1 = _mm_shuffle_epi8(result1, r_swizzle);
+        result2 = _mm_or_si128(result2, sign2);
+        result2 = _mm_shuffle_epi8(result2, r_swizzle);
+
+        _mm_storeu_si128((__m128i *) value_out, result1);
+        _mm_storeu_si128((__m128i *) (value_out + 16), result2);
+        value_out += 32;
+    }
+    return 1;
+}
+
+// Hashes each code unit to its slot, (u * mul + add) mod 2^16 >> 12.
+#define hash_epi16(u, s) _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(u, mul[s]), add[s]), 12)
+
+// Decodes with the tables rcnb_init_alphabet derived. A group is taken as reversed unless its
+// first code unit is exactly the r code point in its hash slot.
+static int decode_32n_alphabet(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
+    __m128i rcnb1, rcnb2, rcnb3, rcnb4, rcnb5, rcnb6, rcnb7, rcnb8;
+
+    __m128i mul[4], add[4], tbl[4], lo[4], hi[4];
+    for (int s = 0; s < 4; ++s) {
+        mul[s] = _mm_set1_epi16((short) alphabet->mul[s]);
+        add[s] = _mm_set1_epi16((short) alphabet->add[s]);
+        tbl[s] = _mm_loadu_si128((__m128i *) alphabet->index[s]);
+        lo[s] = _mm_loadu_si128((__m128i *) alphabet->lo[s]);
+        hi[s] = _mm_loadu_si128((__m128i *) alphabet->hi[s]);
+    }
+    __m128i chk_lo = _mm_loadu_si128((__m128i *) alphabet->check_lo);
+    __m128i chk_hi = _mm_loadu_si128((__m128i *) alphabet->check_hi);
+
+    __m128i mul_rc = *(__m128i *) mul_c.first;
+    __m128i mul_nb = *(__m128i *) mul_c.second;
+
+    __m128i r_swizzle = *(__m128i *) &swizzle;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (sizeof(wchar_t) == 2) {
+            rcnb1 = _mm_loadu_si128((__m128i *) value_in);
+            rcnb2 = _mm_loadu_si128((__m128i *) (value_in + 16));
+            rcnb3 = _mm_loadu_si128((__m128i *) (value_in + 32));
+            rcnb4 = _mm_loadu_si128((__m128i *) (value_in + 48));
+            rcnb5 = _mm_loadu_si128((__m128i *) (value_in + 64));
+            rcnb6 = _mm_loadu_si128((__m128i *) (value_in + 80));
+            rcnb7 = _mm_loadu_si128((__m128i *) (value_in + 96));
+            rcnb8 = _mm_loadu_si128((__m128i *) (value_in + 112));
+            value_in += 128;
+        } else if (sizeof(wchar_t) == 4) {
+            __m128i wide = _mm_setzero_si128();
+            rcnb1 = pack_units_sse(value_in, &wide);
+            rcnb2 = pack_units_sse(value_in + 32, &wide);
+            rcnb3 = pack_units_sse(value_in + 64, &wide);
+            rcnb4 = pack_units_sse(value_in + 96, &wide);
+            rcnb5 = pack_units_sse(value_in + 128, &wide);
+            rcnb6 = pack_units_sse(value_in + 160, &wide);
+            rcnb7 = pack_units_sse(value_in + 192, &wide);
+            rcnb8 = pack_units_sse(value_in + 224, &wide);
+            if (_mm_movemask_epi8(wide)) {
+                return 0;
+            }
+            value_in += 256;
+        }
+
+        __m128i r_c1t, r_c2t, c_c1t, c_c2t, n_c1t, n_c2t, b_c1t, b_c2t;
+
+        {
+            __m128i rcnb_04 = _mm_unpacklo_epi16(rcnb1, rcnb3);
+            __m128i rcnb_15 = _mm_unpackhi_epi16(rcnb1, rcnb3);
+            __m128i rcnb_26 = _mm_unpacklo_epi16(rcnb2, rcnb4);
+            __m128i rcnb_37 = _mm_unpackhi_epi16(rcnb2, rcnb4);
+
+            __m128i rcnb_0246_1 = _mm_unpacklo_epi16(rcnb_04, rcnb_26);
+            __m128i rcnb_0246_2 = _mm_unpackhi_epi16(rcnb_04, rcnb_26);
+            __m128i rcnb_1357_1 = _mm_unpacklo_epi16(rcnb_15, rcnb_37);
+            __m128i rcnb_1357_2 = _mm_unpackhi_epi16(rcnb_15, rcnb_37);
+
+            r_c1t = _mm_unpacklo_epi16(rcnb_0246_1, rcnb_1357_1);
+            c_c1t = _mm_unpackhi_epi16(rcnb_0246_1, rcnb_1357_1);
+            n_c1t = _mm_unpacklo_epi16(rcnb_0246_2, rcnb_1357_2);
+            b_c1t = _mm_unpackhi_epi16(rcnb_0246_2, rcnb_1357_2);
+        }
+
+        {
+            __m128i rcnb_04 = _mm_unpacklo_epi16(rcnb5, rcnb7);
+            __m128i rcnb_15 = _mm_unpackhi_epi16(rcnb5, rcnb7);
+            __m128i rcnb_26 = _mm_unpacklo_epi16(rcnb6, rcnb8);
+            __m128i rcnb_37 = _mm_unpackhi_epi16(rcnb6, rcnb8);
+
+            __m128i rcnb_0246_1 = _mm_unpacklo_epi16(rcnb_04, rcnb_26);
+            __m128i rcnb_0246_2 = _mm_unpackhi_epi16(rcnb_04, rcnb_26);
+            __m128i rcnb_1357_1 = _mm_unpacklo_epi16(rcnb_15, rcnb_37);
+            __m128i rcnb_1357_2 = _mm_unpackhi_epi16(rcnb_15, rcnb_37);
+
+            r_c2t = _mm_unpacklo_epi16(rcnb_0246_1, rcnb_1357_1);
+            c_c2t = _mm_unpackhi_epi16(rcnb_0246_1, rcnb_1357_1);
+            n_c2t = _mm_unpacklo_epi16(rcnb_0246_2, rcnb_1357_2);
+            b_c2t = _mm_unpackhi_epi16(rcnb_0246_2, rcnb_1357_2);
+        }
+
+        // look up the expected r code point of each slot, low byte into the low half of the lane
+        __m128i slot1 = hash_epi16(r_c1t, 0);
+        __m128i slot2 = hash_epi16(r_c2t, 0);
+        __m128i expect1 = _mm_or_si128(
+                _mm_shuffle_epi8(chk_lo, _mm_or_si128(slot1, _mm_set1_epi16(-0x8000))),
+                _mm_shuffle_epi8(chk_hi, _mm_or_si128(_mm_slli_epi16(slot1, 8), _mm_set1_epi16(0x80))));
+        __m128i expect2 = _mm_or_si128(
+                _mm_shuffle_epi8(chk_lo, _mm_or_si128(slot2, _mm_set1_epi16(-0x8000))),
+                _mm_shuffle_epi8(chk_hi, _mm_or_si128(_mm_slli_epi16(slot2, 8), _mm_set1_epi16(0x80))));
+        __m128i sign1 = _mm_andnot_si128(_mm_cmpeq_epi16(expect1, r_c1t), _mm_set1_epi16(-1));
+        __m128i sign2 = _mm_andnot_si128(_mm_cmpeq_epi16(expect2, r_c2t), _mm_set1_epi16(-1));
+
+        __m128i r_c1 = mm_blendv_epi8(r_c1t, n_c1t, sign1);
+        __m128i c_c1 = mm_blendv_epi8(c_c1t, b_c1t, sign1);
+        __m128i n_c1 = mm_blendv_epi8(n_c1t, r_c1t, sign1);
+        __m128i b_c1 = mm_blendv_epi8(b_c1t, c_c1t, sign1);
+        __m128i r_c2 = mm_blendv_epi8(r_c2t, n_c2t, sign2);
+        __m128i c_c2 = mm_blendv_epi8(c_c2t, b_c2t, sign2);
+        __m128i n_c2 = mm_blendv_epi8(n_c2t, r_c2t, sign2);
+        __m128i b_c2 = mm_blendv_epi8(b_c2t, c_c2t, sign2);
+
+        sign1 = _mm_slli_epi16(sign1, 15);
+        sign2 = _mm_slli_epi16(sign2, 15);
+
+        __m128i r_i = _mm_packus_epi16(hash_epi16(r_c1, 0), hash_epi16(r_c2, 0));
+        __m128i c_i = _mm_packus_epi16(hash_epi16(c_c1, 1), hash_epi16(c_c2, 1));
+        __m128i n_i = _mm_packus_epi16(hash_epi16(n_c1, 2), hash_epi16(n_c2, 2));
+        __m128i b_i = _mm_packus_epi16(hash_epi16(b_c1, 3), hash_epi16(b_c2, 3));
+
+        __m128i r_v = _mm_shuffle_epi8(tbl[0], r_i);
+        __m128i c_v = _mm_shuffle_epi8(tbl[1], c_i);
+        __m128i n_v = _mm_shuffle_epi8(tbl[2], n_i);
+        __m128i b_v = _mm_shuffle_epi8(tbl[3], b_i);
+
+        __m128i bad_v = _mm_or_si128(
+                _mm_or_si128(
+                        _mm_cmpeq_epi8(r_v, _mm_set1_epi8(-1)),
+                        _mm_cmpeq_epi8(c_v, _mm_set1_epi8(-1))
+                ),
+                _mm_or_si128(
+                        _mm_cmpeq_epi8(n_v, _mm_set1_epi8(-1)),
+                        _mm_cmpeq_epi8(b_v, _mm_set1_epi8(-1))
+                )
+        );
+        bad_v = _mm_or_si128(bad_v, _mm_or_si128(
+                _mm_or_si128(mismatch_sse(r_c1, r_c2, r_v, lo[0], hi[0]), mismatch_sse(c_c1, c_c2, c_v, lo[1], hi[1])),
+                _mm_or_si128(mismatch_sse(n_c1, n_c2, n_v, lo[2], hi[2]), mismatch_sse(b_c1, b_c2, b_v, lo[3], hi[3]))));
 
         __m128i rn_1 = _mm_unpacklo_epi8(r_v, n_v);
         __m128i rn_2 = _mm_unpackhi_epi8(r_v, n_v);
@@ -391,6 +914,10 @@ int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
         __m128i result1 = _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(rn_1, 3), _mm_slli_epi16(rn_1, 1)), cb_1);
         __m128i result2 = _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(rn_2, 3), _mm_slli_epi16(rn_2, 1)), cb_2);
 
+        if (_mm_movemask_epi8(_mm_or_si128(result1, result2)) & 0xAAAA) {
+            return 0;
+        }
+
         result1 = _mm_or_si128(result1, sign1);
         result1 = _mm_shuffle_epi8(result1, r_swizzle);
         result2 = _mm_or_si128(result2, sign2);
@@ -403,15 +930,33 @@ int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
     return 1;
 }
 
+#undef hash_epi16
+
+int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
+    if (alphabet == &rcnb_builtin_alphabet)
+        return decode_32n_builtin(value_in, value_out, n);
+    return decode_32n_alphabet(value_in, value_out, n, alphabet);
+}
+
 #endif
 
 #ifdef ENABLE_AVX2
 
-void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n) {
+#define store_si256(p, v) (stream ? _mm256_stream_si256(p, v) : _mm256_storeu_si256(p, v))
+
+// With stream set, value_out must be 32-byte aligned and the stores bypass the cache.
+static inline void encode_32n(const char *value_in, char *value_out, size_t n, int stream,
+                              const rcnb_alphabet *alphabet) {
+    __m256i rc_lo = _mm256_loadu_si256((__m256i *) alphabet->lo[0]);
+    __m256i rc_hi = _mm256_loadu_si256((__m256i *) alphabet->hi[0]);
+    __m256i nb_lo = _mm256_loadu_si256((__m256i *) alphabet->lo[2]);
+    __m256i nb_hi = _mm256_loadu_si256((__m256i *) alphabet->hi[2]);
     __m256i r_swizzle = _mm256_broadcastsi128_si256(*(__m128i *) &swizzle);
     __m256i r_permute = *(__m256i *) &permuted;
     __m256i r_shuffler = _mm256_broadcastsi128_si256(*(__m128i *) &shuffler);
     for (size_t i = 0; i < n; ++i) {
+        if (stream)
+            _mm_prefetch(value_in + RCNB_PREFETCH_DISTANCE, _MM_HINT_NTA);
         __m256i input = _mm256_loadu_si256((__m256i *) value_in);
         value_in += 32;
         input = _mm256_shuffle_epi8(input, r_swizzle);
@@ -434,10 +979,10 @@ void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n) {
         idx_rc = _mm256_permute4x64_epi64(idx_rc, 0xd8);
         idx_nb = _mm256_permute4x64_epi64(idx_nb, 0xd8);
 
-        __m256i rc_l = _mm256_shuffle_epi8(*(__m256i *) &rc_lo, idx_rc);
-        __m256i rc_h = _mm256_shuffle_epi8(*(__m256i *) &rc_hi, idx_rc);
-        __m256i nb_l = _mm256_shuffle_epi8(*(__m256i *) &nb_lo, idx_nb);
-        __m256i nb_h = _mm256_shuffle_epi8(*(__m256i *) &nb_hi, idx_nb);
+        __m256i rc_l = _mm256_shuffle_epi8(rc_lo, idx_rc);
+        __m256i rc_h = _mm256_shuffle_epi8(rc_hi, idx_rc);
+        __m256i nb_l = _mm256_shuffle_epi8(nb_lo, idx_nb);
+        __m256i nb_h = _mm256_shuffle_epi8(nb_hi, idx_nb);
 
         __m256i r1c1_t = _mm256_unpacklo_epi8(rc_l, rc_h);
         __m256i r2c2_t = _mm256_unpackhi_epi8(rc_l, rc_h);
@@ -468,36 +1013,58 @@ void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n) {
         __m256i rcnb4 = _mm256_shuffle_epi8(rncb4, r_shuffler);
 
         if (sizeof(wchar_t) == 2) {
-            _mm256_storeu_si256((__m256i *) (value_out), rcnb1);
+            store_si256((__m256i *) (value_out), rcnb1);
             value_out += 32;
-            _mm256_storeu_si256((__m256i *) (value_out), rcnb2);
+            store_si256((__m256i *) (value_out), rcnb2);
             value_out += 32;
-            _mm256_storeu_si256((__m256i *) (value_out), rcnb3);
+            store_si256((__m256i *) (value_out), rcnb3);
             value_out += 32;
-            _mm256_storeu_si256((__m256i *) (value_out), rcnb4);
+            store_si256((__m256i *) (value_out), rcnb4);
             value_out += 32;
         } else if (sizeof(wchar_t) == 4) {
-            _mm256_storeu_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb1, 0)));
+            store_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb1, 0)));
             value_out += 32;
-            _mm256_storeu_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb1, 1)));
+            store_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb1, 1)));
             value_out += 32;
-            _mm256_storeu_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb2, 0)));
+            store_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb2, 0)));
             value_out += 32;
-            _mm256_storeu_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb2, 1)));
+            store_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb2, 1)));
             value_out += 32;
-            _mm256_storeu_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb3, 0)));
+            store_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb3, 0)));
             value_out += 32;
-            _mm256_storeu_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb3, 1)));
+            store_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb3, 1)));
             value_out += 32;
-            _mm256_storeu_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb4, 0)));
+            store_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb4, 0)));
             value_out += 32;
-            _mm256_storeu_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb4, 1)));
+            store_si256((__m256i *) (value_out), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(rcnb4, 1)));
             value_out += 32;
         }
     }
 }
 
-int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
+void rcnb_encode_32n_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
+    encode_32n(value_in, value_out, n, 0, alphabet);
+}
+
+void rcnb_encode_32n_stream_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
+    encode_32n(value_in, value_out, n, 1, alphabet);
+    _mm_sfence();
+}
+
+// Sets the bytes of the units that are not the code point their index stands for, as in the SSSE3 version. The
+// units of two sets are packed and permuted the same way as their indices.
+static inline __m256i mismatch_avx2(__m256i unit_a, __m256i unit_b, __m256i index, __m256i lo, __m256i hi) {
+    __m256i mask = _mm256_set1_epi16(0xFF);
+    __m256i unit_lo = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(_mm256_and_si256(unit_a, mask), _mm256_and_si256(unit_b, mask)), 0xd8);
+    __m256i unit_hi = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(_mm256_srli_epi16(unit_a, 8), _mm256_srli_epi16(unit_b, 8)), 0xd8);
+    __m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_shuffle_epi8(lo, index), unit_lo),
+                                     _mm256_cmpeq_epi8(_mm256_shuffle_epi8(hi, index), unit_hi));
+    return _mm256_andnot_si256(match, _mm256_set1_epi8(-1));
+}
+
+static int decode_32n_builtin(const char *value_in, char *value_out, size_t n) {
     __m256i rcnb1, rcnb2, rcnb3, rcnb4;
 
     __m256i rc_t = *(__m256i *) &rc_tbl;
@@ -507,6 +1074,12 @@ int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
     __m256i mul = *(__m256i *) &mul_c;
     __m256i r_swizzle = _mm256_broadcastsi128_si256(*(__m128i *) &swizzle);
 
+    // the code points of r and c, and of n and b, one set in each half
+    __m256i rc_lo = _mm256_loadu_si256((__m256i *) rcnb_builtin_alphabet.lo[0]);
+    __m256i rc_hi = _mm256_loadu_si256((__m256i *) rcnb_builtin_alphabet.hi[0]);
+    __m256i nb_lo = _mm256_loadu_si256((__m256i *) rcnb_builtin_alphabet.lo[2]);
+    __m256i nb_hi = _mm256_loadu_si256((__m256i *) rcnb_builtin_alphabet.hi[2]);
+
     for (size_t i = 0; i < n; ++i) {
         if (sizeof(wchar_t) == 2) {
             rcnb1 = _mm256_loadu_si256((__m256i*) value_in);
@@ -587,6 +1160,8 @@ int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
                 _mm256_cmpeq_epi8(rc_v, _mm256_set1_epi8(-1)),
                 _mm256_cmpeq_epi8(nb_v, _mm256_set1_epi8(-1))
                 );
+        bad_v = _mm256_or_si256(bad_v, _mm256_or_si256(mismatch_avx2(r_c, c_c, rc_v, rc_lo, rc_hi),
+                                                        mismatch_avx2(n_c, b_c, nb_v, nb_lo, nb_hi)));
 
         __m256i rn_cb_1 = _mm256_unpacklo_epi8(rc_v, nb_v);
         __m256i rn_cb_2 = _mm256_unpackhi_epi8(rc_v, nb_v);
@@ -600,6 +1175,10 @@ int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
         __m256i rn = _mm256_permute2x128_si256(rn_cb_1, rn_cb_2, 0x20);
         __m256i cb = _mm256_permute2x128_si256(rn_cb_1, rn_cb_2, 0x31);
         __m256i result = _mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(rn, 3), _mm256_slli_epi16(rn, 1)), cb);
+        if (_mm256_movemask_epi8(result) & 0xAAAAAAAA) {
+            return 0;
+        }
+
         result = _mm256_or_si256(result, sign);
         result = _mm256_shuffle_epi8(result, r_swizzle);
 
@@ -608,4 +1187,125 @@ int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n) {
     }
     return 1;
 }
+
+#define hash_epi16(u, s) _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(u, mul[s]), add[s]), 12)
+
+// Decodes with the tables rcnb_init_alphabet derived, see the SSSE3 version.
+static int decode_32n_alphabet(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
+    __m256i rcnb1, rcnb2, rcnb3, rcnb4;
+
+    __m256i mul[4], add[4];
+    for (int s = 0; s < 4; ++s) {
+        mul[s] = _mm256_set1_epi16((short) alphabet->mul[s]);
+        add[s] = _mm256_set1_epi16((short) alphabet->add[s]);
+    }
+    __m256i rc_t = _mm256_loadu_si256((__m256i *) alphabet->index[0]);
+    __m256i nb_t = _mm256_loadu_si256((__m256i *) alphabet->index[2]);
+    __m256i chk_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) alphabet->check_lo));
+    __m256i chk_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) alphabet->check_hi));
+    __m256i rc_lo = _mm256_loadu_si256((__m256i *) alphabet->lo[0]);
+    __m256i rc_hi = _mm256_loadu_si256((__m256i *) alphabet->hi[0]);
+    __m256i nb_lo = _mm256_loadu_si256((__m256i *) alphabet->lo[2]);
+    __m256i nb_hi = _mm256_loadu_si256((__m256i *) alphabet->hi[2]);
+
+    __m256i mul_rcnb = *(__m256i *) &mul_c;
+    __m256i r_swizzle = _mm256_broadcastsi128_si256(*(__m128i *) &swizzle);
+
+    for (size_t i = 0; i < n; ++i) {
+        if (sizeof(wchar_t) == 2) {
+            rcnb1 = _mm256_loadu_si256((__m256i*) value_in);
+            rcnb2 = _mm256_loadu_si256((__m256i*) (value_in + 32));
+            rcnb3 = _mm256_loadu_si256((__m256i*) (value_in + 64));
+            rcnb4 = _mm256_loadu_si256((__m256i*) (value_in + 96));
+            value_in += 128;
+        } else if (sizeof(wchar_t) == 4) {
+            rcnb1 = _mm256_permute4x64_epi64(_mm256_packus_epi32(_mm256_loadu_si256((__m256i*) value_in),
+                                                                 _mm256_loadu_si256((__m256i*) (value_in + 32))), 0xd8);
+            rcnb2 = _mm256_permute4x64_epi64(_mm256_packus_epi32(_mm256_loadu_si256((__m256i*) (value_in + 64)),
+                                                                 _mm256_loadu_si256((__m256i*) (value_in + 96))), 0xd8);
+            rcnb3 = _mm256_permute4x64_epi64(_mm256_packus_epi32(_mm256_loadu_si256((__m256i*) (value_in + 128)),
+                                                                 _mm256_loadu_si256((__m256i*) (value_in + 160))), 0xd8);
+            rcnb4 = _mm256_permute4x64_epi64(_mm256_packus_epi32(_mm256_loadu_si256((__m256i*) (value_in + 192)),
+                                                                 _mm256_loadu_si256((__m256i*) (value_in + 224))), 0xd8);
+            value_in += 256;
+        }
+
+        __m256i rcnb_0_1_8_9 = _mm256_permute2x128_si256(rcnb1, rcnb3, 0x20);
+        __m256i rcnb_2_3_a_b = _mm256_permute2x128_si256(rcnb1, rcnb3, 0x31);
+        __m256i rcnb_4_5_c_d = _mm256_permute2x128_si256(rcnb2, rcnb4, 0x20);
+        __m256i rcnb_6_7_e_f = _mm256_permute2x128_si256(rcnb2, rcnb4, 0x31);
+
+        __m256i rcnb_02_8a = _mm256_unpacklo_epi16(rcnb_0_1_8_9, rcnb_2_3_a_b);
+        __m256i rcnb_13_9b = _mm256_unpackhi_epi16(rcnb_0_1_8_9, rcnb_2_3_a_b);
+        __m256i rcnb_46_ce = _mm256_unpacklo_epi16(rcnb_4_5_c_d, rcnb_6_7_e_f);
+        __m256i rcnb_57_df = _mm256_unpackhi_epi16(rcnb_4_5_c_d, rcnb_6_7_e_f);
+
+        __m256i rcnb_0123_89ab_rc = _mm256_unpacklo_epi16(rcnb_02_8a, rcnb_13_9b);
+        __m256i rcnb_0123_89ab_nb = _mm256_unpackhi_epi16(rcnb_02_8a, rcnb_13_9b);
+        __m256i rcnb_4567_cdef_rc = _mm256_unpacklo_epi16(rcnb_46_ce, rcnb_57_df);
+        __m256i rcnb_4567_cdef_nb = _mm256_unpackhi_epi16(rcnb_46_ce, rcnb_57_df);
+
+        __m256i r_ct = _mm256_unpacklo_epi64(rcnb_0123_89ab_rc, rcnb_4567_cdef_rc);
+        __m256i c_ct = _mm256_unpackhi_epi64(rcnb_0123_89ab_rc, rcnb_4567_cdef_rc);
+        __m256i n_ct = _mm256_unpacklo_epi64(rcnb_0123_89ab_nb, rcnb_4567_cdef_nb);
+        __m256i b_ct = _mm256_unpackhi_epi64(rcnb_0123_89ab_nb, rcnb_4567_cdef_nb);
+
+        __m256i slot = hash_epi16(r_ct, 0);
+        __m256i expect = _mm256_or_si256(
+                _mm256_shuffle_epi8(chk_lo, _mm256_or_si256(slot, _mm256_set1_epi16(-0x8000))),
+                _mm256_shuffle_epi8(chk_hi, _mm256_or_si256(_mm256_slli_epi16(slot, 8), _mm256_set1_epi16(0x80))));
+        __m256i sign = _mm256_andnot_si256(_mm256_cmpeq_epi16(expect, r_ct), _mm256_set1_epi16(-1));
+
+        __m256i r_c = _mm256_blendv_epi8(r_ct, n_ct, sign);
+        __m256i c_c = _mm256_blendv_epi8(c_ct, b_ct, sign);
+        __m256i n_c = _mm256_blendv_epi8(n_ct, r_ct, sign);
+        __m256i b_c = _mm256_blendv_epi8(b_ct, c_ct, sign);
+
+        sign = _mm256_slli_epi16(sign, 15);
+
+        __m256i rc_i = _mm256_permute4x64_epi64(_mm256_packus_epi16(hash_epi16(r_c, 0), hash_epi16(c_c, 1)), 0xd8);
+        __m256i nb_i = _mm256_permute4x64_epi64(_mm256_packus_epi16(hash_epi16(n_c, 2), hash_epi16(b_c, 3)), 0xd8);
+
+        __m256i rc_v = _mm256_shuffle_epi8(rc_t, rc_i);
+        __m256i nb_v = _mm256_shuffle_epi8(nb_t, nb_i);
+
+        __m256i bad_v = _mm256_or_si256(
+                _mm256_cmpeq_epi8(rc_v, _mm256_set1_epi8(-1)),
+                _mm256_cmpeq_epi8(nb_v, _mm256_set1_epi8(-1))
+                );
+        bad_v = _mm256_or_si256(bad_v, _mm256_or_si256(mismatch_avx2(r_c, c_c, rc_v, rc_lo, rc_hi),
+                                                        mismatch_avx2(n_c, b_c, nb_v, nb_lo, nb_hi)));
+
+        __m256i rn_cb_1 = _mm256_unpacklo_epi8(rc_v, nb_v);
+        __m256i rn_cb_2 = _mm256_unpackhi_epi8(rc_v, nb_v);
+        rn_cb_1 = _mm256_maddubs_epi16(mul_rcnb, rn_cb_1);
+        rn_cb_2 = _mm256_maddubs_epi16(mul_rcnb, rn_cb_2);
+
+        if (_mm256_movemask_epi8(bad_v)) {
+            return 0;
+        }
+
+        __m256i rn = _mm256_permute2x128_si256(rn_cb_1, rn_cb_2, 0x20);
+        __m256i cb = _mm256_permute2x128_si256(rn_cb_1, rn_cb_2, 0x31);
+        __m256i result = _mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(rn, 3), _mm256_slli_epi16(rn, 1)), cb);
+        if (_mm256_movemask_epi8(result) & 0xAAAAAAAA) {
+            return 0;
+        }
+
+        result = _mm256_or_si256(result, sign);
+        result = _mm256_shuffle_epi8(result, r_swizzle);
+
+        _mm256_storeu_si256((__m256i*)value_out, result);
+        value_out += 32;
+    }
+    return 1;
+}
+
+#undef hash_epi16
+
+int rcnb_decode_32n_asm(const char *value_in, char *value_out, size_t n, const rcnb_alphabet *alphabet) {
+    if (alphabet == &rcnb_builtin_alphabet)
+        return decode_32n_builtin(value_in, value_out, n);
+    return decode_32n_alphabet(value_in, value_out, n, alphabet);
+}
 #endif
@@ -0,0 +1,22 @@
+/*
+threshold.h - private access to the stream threshold for the profile and the autotuner
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+
+A threshold the caller chose with rcnb_set_stream_threshold() outranks the one
+of a profile, so the library sets its own through these instead.
+*/
+
+#ifndef RCNB_THRESHOLD_H
+#define RCNB_THRESHOLD_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* sets the threshold like rcnb_set_stream_threshold, without it counting as the caller's choice */
+void rcnb_store_stream_threshold(size_t length_in);
+/* whether the caller has set the threshold with rcnb_set_stream_threshold */
+bool rcnb_stream_threshold_chosen(void);
+
+#endif /* RCNB_THRESHOLD_H */
@@ -0,0 +1,38 @@
+/*
+check.h - assertions shared by the rcnb tests
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#ifndef RCNB_TESTS_CHECK_H
+#define RCNB_TESTS_CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* stops the test with the failed condition and where it is, unlike assert() also in release builds */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1); \
+        } \
+    } while (0)
+
+/* a small deterministic generator, so a failure reproduces */
+static unsigned long check_seed = 0x2545F491;
+
+static inline unsigned check_random(void)
+{
+    check_seed = check_seed * 6364136223846793005ul + 1442695040888963407ul;
+    return (unsigned)(check_seed >> 33);
+}
+
+static inline void check_fill(char* bytes_out, size_t length_in)
+{
+    for (size_t i = 0; i < length_in; ++i)
+        bytes_out[i] = (char)check_random();
+}
+
+#endif /* RCNB_TESTS_CHECK_H */
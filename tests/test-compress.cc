@@ -0,0 +1,100 @@
+/*
+test-compress.cc - round trips through the compression stage, and compressed payloads cut short or run on
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/encode.h>
+#include <rcnb/decode.h>
+
+#include <sstream>
+#include <string>
+
+#include "check.h"
+
+// Small blocks, so a payload spans many of them on both sides of the pipeline.
+#define BLOCK 4096
+
+static std::wstring encode(const std::string& plaintext, int method)
+{
+    rcnb::encoder encoder(BLOCK, method);
+    std::istringstream input(plaintext);
+    std::wostringstream output;
+    encoder.encode(input, output);
+    CHECK(!output.bad());
+    return output.str();
+}
+
+// Returns false if the decoder flagged the stream as bad.
+static bool decode(const std::wstring& code, std::string& plaintext_out)
+{
+    rcnb::decoder decoder(BLOCK);
+    std::wistringstream input(code);
+    std::ostringstream output;
+    decoder.decode(input, output);
+    plaintext_out = output.str();
+    return !output.bad();
+}
+
+// Encodes the method byte and compressed bytes of a payload again behind the marker, after an edit to them.
+static std::wstring reencode(const std::string& payload)
+{
+    std::wstring code(RCNB_COMPRESS_MARKER);
+    std::vector<wchar_t> encoded(2 * payload.size() + 1);
+    code.append(encoded.data(), rcnb::rcnb_encode(payload.data(), payload.size(), encoded.data()));
+    return code;
+}
+
+static void check_method(int method, const std::string& plaintext)
+{
+    std::wstring code = encode(plaintext, method);
+    CHECK(code.compare(0, RCNB_COMPRESS_MARKER_LENGTH, RCNB_COMPRESS_MARKER) == 0);
+    std::string decoded;
+    CHECK(decode(code, decoded));
+    CHECK(decoded == plaintext);
+
+    // the method byte and the compressed stream behind the marker
+    std::vector<char> bytes(code.size() / 2 + 1);
+    ptrdiff_t length = rcnb::rcnb_decode(code.data() + RCNB_COMPRESS_MARKER_LENGTH,
+                                         code.size() - RCNB_COMPRESS_MARKER_LENGTH, bytes.data());
+    CHECK(length > 1 && (unsigned char)bytes[0] == method);
+    std::string payload(bytes.data(), (size_t)length);
+    CHECK(reencode(payload) == code);
+
+    // cut short right after the method byte, anywhere in the compressed stream, and by its last byte
+    const size_t cuts[] = { 1, 2, payload.size() / 2, payload.size() - 2, payload.size() - 1 };
+    for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); ++i) {
+        if (cuts[i] < 1 || cuts[i] >= payload.size())
+            continue;
+        CHECK(!decode(reencode(payload.substr(0, cuts[i])), decoded));
+    }
+
+    // bytes after the end of the compressed stream, one and several, odd and even
+    CHECK(!decode(reencode(payload + '\0'), decoded));
+    CHECK(!decode(reencode(payload + "trailing garbage"), decoded));
+    CHECK(!decode(reencode(payload + payload.substr(1)), decoded));
+}
+
+int main()
+{
+    std::string plaintexts[4];
+    plaintexts[1] = "r";
+    for (int i = 0; i < 1000; ++i)
+        plaintexts[2] += (char)check_random();
+    // text that compresses, longer than a block of the pipeline compressed
+    for (int i = 0; i < 20000; ++i)
+        plaintexts[3] += "rcnb " + std::to_string(i % 97) + (i % 13 ? ' ' : '\n');
+
+    const int methods[] = { RCNB_COMPRESS_ZLIB, RCNB_COMPRESS_ZSTD };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); ++i) {
+        if (!rcnb::rcnb_compress_supported(methods[i]))
+            continue;
+        for (size_t j = 0; j < sizeof(plaintexts) / sizeof(plaintexts[0]); ++j)
+            check_method(methods[i], plaintexts[j]);
+    }
+
+    // an unknown method is refused
+    CHECK(!decode(reencode(std::string(1, (char)0x7F) + "rcnb"), plaintexts[0]));
+    return 0;
+}
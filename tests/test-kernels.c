@@ -0,0 +1,163 @@
+/*
+test-kernels.c - decoding corrupted code through every kernel width against the scalar decoder
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/cencode.h>
+#include <rcnb/cdecode.h>
+#include <rcnb/calphabet.h>
+#include <rcnb/rcnb.h>
+#include "check.h"
+
+#include <string.h>
+#include <wchar.h>
+
+// Up to three batches of 16 groups, so every tail length follows zero, one and two of them.
+#define MAX_GROUPS 48
+#define KINDS 9
+
+// The scalar decoder, group by group, is the reference the kernels must agree with.
+static ptrdiff_t reference(const wchar_t* code, size_t length, char* plaintext_out, const rcnb_alphabet* alphabet)
+{
+    char* plaintext_char = plaintext_out;
+    for (size_t i = 0; i + 4 <= length; i += 4)
+        if (!rcnb_decode_short(code + i, &plaintext_char, alphabet))
+            return -1;
+    if (length % 4 == 2 && !rcnb_decode_byte(code + length - 2, &plaintext_char, alphabet))
+        return -1;
+    return plaintext_char - plaintext_out;
+}
+
+// Decodes in two blocks split at unit split, which leaves a group open across them when split is not a multiple of 4.
+static ptrdiff_t decode_split(const wchar_t* code, size_t length, size_t split, char* plaintext_out,
+        const rcnb_alphabet* alphabet)
+{
+    rcnb_decodestate state;
+    rcnb_init_decodestate_alphabet(&state, alphabet);
+    ptrdiff_t first = rcnb_decode_block(code, split, plaintext_out, &state);
+    if (first < 0)
+        return -1;
+    ptrdiff_t second = rcnb_decode_block(code + split, length - split, plaintext_out + first, &state);
+    if (second < 0)
+        return -1;
+    ptrdiff_t end = rcnb_decode_blockend(plaintext_out + first + second, &state);
+    if (end < 0)
+        return -1;
+    return first + second + end;
+}
+
+static void check_decode(const wchar_t* code, size_t length, size_t group, const rcnb_alphabet* alphabet)
+{
+    char expected[2 * MAX_GROUPS + 2];
+    char plaintext[2 * MAX_GROUPS + 2];
+    ptrdiff_t expected_length = reference(code, length, expected, alphabet);
+
+    ptrdiff_t plain_length = rcnb_decode_alphabet(code, length, plaintext, alphabet);
+    CHECK(plain_length == expected_length);
+    if (expected_length >= 0)
+        CHECK(memcmp(plaintext, expected, (size_t)expected_length) == 0);
+
+    const size_t splits[] = { 1, 2, 3, 4 * group + 1, 4 * group + 2, 4 * group + 3 };
+    for (size_t i = 0; i < sizeof(splits) / sizeof(splits[0]); ++i) {
+        if (splits[i] >= length)
+            continue;
+        plain_length = decode_split(code, length, splits[i], plaintext, alphabet);
+        CHECK(plain_length == expected_length);
+        if (expected_length >= 0)
+            CHECK(memcmp(plaintext, expected, (size_t)expected_length) == 0);
+    }
+}
+
+// Replaces unit k of group g with a corruption of the given kind.
+static void corrupt(wchar_t* code, size_t g, size_t k, int kind, const rcnb_alphabet* alphabet)
+{
+    wchar_t* group = code + 4 * g;
+    wchar_t unit = group[k];
+    switch (kind) {
+    case 0: // U+0000, which an empty hash slot looks up as
+        group[k] = 0;
+        break;
+    case 1: // the same unit with the sign bit of a 16-bit lane set
+        group[k] = (wchar_t)(unit | 0x8000);
+        break;
+    case 2: // U+7FFF, which wider units saturate to
+        group[k] = 0x7FFF;
+        break;
+    case 3: // U+FFFF
+        group[k] = (wchar_t)0xFFFF;
+        break;
+    case 4: // above U+FFFF, the unit again once truncated to 16 bits
+#if WCHAR_MAX > 0xFFFF
+        group[k] = (wchar_t)(unit + 0x10000);
+#else
+        group[k] = (wchar_t)(unit ^ 0x4000);
+#endif
+        break;
+    case 5: // a member of the set of another position
+        group[k] = group[(k + 1) % 4];
+        break;
+    case 6: // r swapped with n, or c with b
+        group[k] = group[(k + 2) % 4];
+        group[(k + 2) % 4] = unit;
+        break;
+    case 7: // a member of another set, or of the same one decoding to another value
+        group[k] = k % 2 ? alphabet->b[g % RCNB_ALPHABET_B] : alphabet->n[g % RCNB_ALPHABET_N];
+        break;
+    default: // a neighbouring code point
+        group[k] = (wchar_t)(unit ^ 1);
+        break;
+    }
+}
+
+static void check_alphabet(const rcnb_alphabet* alphabet)
+{
+    char plaintext[2 * MAX_GROUPS + 1];
+    wchar_t code[4 * MAX_GROUPS + 3];
+    wchar_t corrupted[4 * MAX_GROUPS + 3];
+    for (size_t groups = 1; groups <= MAX_GROUPS; ++groups) {
+        // every third length ends in an odd byte
+        size_t length = 2 * groups + (groups % 3 == 0);
+        check_fill(plaintext, length);
+        size_t code_length = rcnb_encode_alphabet(plaintext, length, code, alphabet);
+        check_decode(code, code_length, 0, alphabet);
+        for (size_t g = 0; g < groups; ++g) {
+            for (size_t k = 0; k < 4; ++k) {
+                for (int kind = 0; kind < KINDS; ++kind) {
+                    wmemcpy(corrupted, code, code_length);
+                    corrupt(corrupted, g, k, kind, alphabet);
+                    check_decode(corrupted, code_length, g, alphabet);
+                }
+            }
+        }
+    }
+}
+
+int main(void)
+{
+    check_alphabet(rcnb_default_alphabet());
+
+    // a random alphabet the SIMD kernels take, with U+7FFF in it for the saturated units to land on
+    wchar_t sets[RCNB_ALPHABET_R + RCNB_ALPHABET_C + RCNB_ALPHABET_N + RCNB_ALPHABET_B];
+    const size_t count = sizeof(sets) / sizeof(sets[0]);
+    rcnb_alphabet alphabet;
+    bool found = false;
+    for (int attempt = 0; attempt < 1000 && !found; ++attempt) {
+        sets[0] = 0x7FFF;
+        for (size_t i = 1; i < count; ++i) {
+            bool taken;
+            do {
+                sets[i] = (wchar_t)(1 + check_random() % 0x7FFF);
+                taken = false;
+                for (size_t j = 0; j < i; ++j)
+                    taken = taken || sets[j] == sets[i];
+            } while (taken);
+        }
+        found = rcnb_init_alphabet(&alphabet, sets, sets + RCNB_ALPHABET_R, sets + RCNB_ALPHABET_R + RCNB_ALPHABET_C,
+                sets + RCNB_ALPHABET_R + RCNB_ALPHABET_C + RCNB_ALPHABET_N) && alphabet.simd;
+    }
+    CHECK(found);
+    check_alphabet(&alphabet);
+    return 0;
+}
@@ -0,0 +1,103 @@
+/*
+test-patch.c - patching and splicing rcnb code against encoding the edited plaintext again
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/cpatch.h>
+#include <rcnb/cencode.h>
+#include "check.h"
+
+#include <string.h>
+#include <wchar.h>
+
+#define MAX_LENGTH 1100
+#define MAX_EDIT 6
+
+static char plaintext[MAX_LENGTH];
+static char edit[MAX_EDIT];
+static char edited[MAX_LENGTH + MAX_EDIT];
+static wchar_t code[2 * (MAX_LENGTH + MAX_EDIT) + 1];
+static wchar_t expected[2 * (MAX_LENGTH + MAX_EDIT) + 1];
+
+static void check_splice(size_t length, size_t offset, size_t removed, size_t inserted,
+        const rcnb_alphabet* alphabet)
+{
+    size_t code_length = rcnb_encode_alphabet(plaintext, length, code, alphabet);
+    check_fill(edit, MAX_EDIT);
+
+    memcpy(edited, plaintext, offset);
+    memcpy(edited + offset, edit, inserted);
+    memcpy(edited + offset + inserted, plaintext + offset + removed, length - offset - removed);
+    size_t expected_length = rcnb_encode_alphabet(edited, length - removed + inserted, expected, alphabet);
+
+    ptrdiff_t spliced_length = rcnb_splice_encoded_alphabet(code, code_length, offset, removed, edit, inserted,
+            alphabet);
+    CHECK(spliced_length == (ptrdiff_t)expected_length);
+    CHECK(wmemcmp(code, expected, expected_length) == 0);
+
+    if (removed == inserted) {
+        code_length = rcnb_encode_alphabet(plaintext, length, code, alphabet);
+        CHECK(rcnb_patch_encoded_alphabet(code, code_length, offset, edit, inserted, alphabet));
+        CHECK(wmemcmp(code, expected, expected_length) == 0);
+    }
+}
+
+// Edits past the end fail and leave the code as it was.
+static void check_out_of_range(size_t length, const rcnb_alphabet* alphabet)
+{
+    size_t code_length = rcnb_encode_alphabet(plaintext, length, code, alphabet);
+    wmemcpy(expected, code, code_length);
+    check_fill(edit, 2);
+    CHECK(rcnb_splice_encoded_alphabet(code, code_length, length + 1, 0, edit, 1, alphabet) == -1);
+    CHECK(rcnb_splice_encoded_alphabet(code, code_length, length, 1, edit, 1, alphabet) == -1);
+    CHECK(!rcnb_patch_encoded_alphabet(code, code_length, length - 1, edit, 2, alphabet));
+    CHECK(!rcnb_patch_encoded_alphabet(code, code_length + 1, 0, edit, 1, alphabet));
+    CHECK(wmemcmp(code, expected, code_length) == 0);
+}
+
+static void check_alphabet(const rcnb_alphabet* alphabet)
+{
+    // every offset of short payloads of both parities, whose last group is the odd byte in half of them
+    for (size_t length = 0; length <= 70; ++length) {
+        check_fill(plaintext, length);
+        for (size_t offset = 0; offset <= length; ++offset)
+            for (size_t removed = 0; removed <= MAX_EDIT && removed <= length - offset; ++removed)
+                for (size_t inserted = 0; inserted <= MAX_EDIT; ++inserted)
+                    check_splice(length, offset, removed, inserted, alphabet);
+        if (length > 0)
+            check_out_of_range(length, alphabet);
+    }
+
+    // payloads long enough for the SIMD kernels, edited at the start, in the middle and around the last byte
+    static const size_t lengths[] = { 1000, 1001, MAX_LENGTH - 1 };
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+        size_t length = lengths[i];
+        check_fill(plaintext, length);
+        const size_t offsets[] = { 0, 1, 2, 31, 32, 33, 500, 501, length - 3, length - 2, length - 1, length };
+        for (size_t j = 0; j < sizeof(offsets) / sizeof(offsets[0]); ++j)
+            for (size_t removed = 0; removed <= MAX_EDIT && removed <= length - offsets[j]; ++removed)
+                for (size_t inserted = 0; inserted <= MAX_EDIT; ++inserted)
+                    check_splice(length, offsets[j], removed, inserted, alphabet);
+    }
+}
+
+int main(void)
+{
+    check_alphabet(NULL);
+
+    wchar_t r[RCNB_ALPHABET_R], c[RCNB_ALPHABET_C], n[RCNB_ALPHABET_N], b[RCNB_ALPHABET_B];
+    for (int i = 0; i < RCNB_ALPHABET_R; ++i)
+        r[i] = (wchar_t)(0x391 + i);
+    for (int i = 0; i < RCNB_ALPHABET_C; ++i)
+        c[i] = (wchar_t)(0x3B1 + i);
+    for (int i = 0; i < RCNB_ALPHABET_N; ++i)
+        n[i] = (wchar_t)(0x410 + i);
+    for (int i = 0; i < RCNB_ALPHABET_B; ++i)
+        b[i] = (wchar_t)(0x430 + i);
+    rcnb_alphabet alphabet;
+    CHECK(rcnb_init_alphabet(&alphabet, r, c, n, b));
+    check_alphabet(&alphabet);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+test-recover.c - resynchronizing after mangled, dropped and inserted code units
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/crecover.h>
+#include <rcnb/cencode.h>
+#include "check.h"
+
+#include <string.h>
+#include <wchar.h>
+
+// Two batches of the kernels and a scalar tail of 8 groups.
+#define GROUPS 40
+#define MAX_RUNS 4
+// The last group a dropped or inserted unit is put in.
+#define SHIFT_LAST (GROUPS - 4)
+
+typedef struct
+{
+    size_t count;
+    size_t offset[MAX_RUNS];
+    size_t length[MAX_RUNS];
+} runs;
+
+static void record_run(size_t offset, size_t length, void* context)
+{
+    runs* reported = (runs*)context;
+    CHECK(reported->count < MAX_RUNS);
+    reported->offset[reported->count] = offset;
+    reported->length[reported->count] = length;
+    reported->count++;
+}
+
+static char plaintext[2 * GROUPS + 1];
+static wchar_t code[4 * GROUPS + 3];
+static wchar_t damaged[4 * GROUPS + 4];
+static char expected[2 * GROUPS + 2];
+static char recovered[2 * GROUPS + 3];
+
+// Decodes the damaged code both ways and checks it gives back the plaintext with the pair of group g replaced by
+// substitutes substitutes, or left out, after a single run reported at offset for length units.
+static void check_recover(size_t damaged_length, size_t plain_length, size_t g, size_t substitutes, size_t offset,
+        size_t length)
+{
+    runs reported = { 0, { 0 }, { 0 } };
+    rcnb_recoveroptions options;
+    rcnb_init_recoveroptions(&options);
+    options.report = record_run;
+    options.context = &reported;
+
+    for (int policy = RCNB_RECOVER_SKIP; policy <= RCNB_RECOVER_SUBSTITUTE; ++policy) {
+        options.policy = policy;
+        reported.count = 0;
+        size_t written = 0;
+        memcpy(expected, plaintext, 2 * g);
+        written += 2 * g;
+        if (policy == RCNB_RECOVER_SUBSTITUTE) {
+            memset(expected + written, '?', substitutes);
+            written += substitutes;
+        }
+        memcpy(expected + written, plaintext + 2 * g + 2, plain_length - 2 * g - 2);
+        written += plain_length - 2 * g - 2;
+
+        size_t invalid = 0;
+        size_t recovered_length = rcnb_decode_recover(damaged, damaged_length, recovered, &options, &invalid);
+        CHECK(recovered_length == written);
+        CHECK(memcmp(recovered, expected, written) == 0);
+        CHECK(invalid == 1);
+        CHECK(reported.count == 1);
+        CHECK(reported.offset[0] == offset);
+        CHECK(reported.length[0] == length);
+    }
+}
+
+int main(void)
+{
+    // damage at the first groups, on both sides of the first and second batch boundary, and in the scalar tail;
+    // a dropped or inserted unit needs a few groups after it to tell its alignment from the one two units off,
+    // so only a mangled unit goes into the last group
+    static const size_t groups[] = { 0, 1, 15, 16, 17, 31, 32, 33, 35, SHIFT_LAST, GROUPS - 1 };
+    for (int odd = 0; odd < 2; ++odd) {
+        size_t plain_length = 2 * GROUPS + odd;
+        check_fill(plaintext, plain_length);
+        size_t code_length = rcnb_encode(plaintext, plain_length, code);
+
+        for (size_t i = 0; i < sizeof(groups) / sizeof(groups[0]); ++i) {
+            size_t g = groups[i];
+            for (size_t k = 0; k < 4; ++k) {
+                size_t p = 4 * g + k;
+
+                // a mangled unit leaves the groups in place, only its own is lost
+                wmemcpy(damaged, code, code_length);
+                damaged[p] = L'z';
+                check_recover(code_length, plain_length, g, 2, 4 * g, 4);
+                if (g > SHIFT_LAST)
+                    continue;
+
+                // a dropped unit takes the first unit of the next group into this one, whose other three units
+                // are found again right after it
+                wmemcpy(damaged, code, p);
+                wmemcpy(damaged + p, code + p + 1, code_length - p - 1);
+                check_recover(code_length - 1, plain_length, g, 1, 4 * g, 3);
+
+                // an inserted unit breaks up the group it lands in, the next one starts a unit later
+                if (k > 0) {
+                    wmemcpy(damaged, code, p);
+                    damaged[p] = L'z';
+                    wmemcpy(damaged + p + 1, code + p, code_length - p);
+                    check_recover(code_length + 1, plain_length, g, 2, 4 * g, 5);
+                }
+            }
+        }
+    }
+
+    // a unit inserted between two groups costs nothing but the unit itself
+    check_fill(plaintext, 2 * GROUPS);
+    size_t code_length = rcnb_encode(plaintext, 2 * GROUPS, code);
+    for (size_t g = 1; g <= SHIFT_LAST; ++g) {
+        runs reported = { 0, { 0 }, { 0 } };
+        rcnb_recoveroptions options;
+        rcnb_init_recoveroptions(&options);
+        options.report = record_run;
+        options.context = &reported;
+        wmemcpy(damaged, code, 4 * g);
+        damaged[4 * g] = L'z';
+        wmemcpy(damaged + 4 * g + 1, code + 4 * g, code_length - 4 * g);
+        size_t invalid = 0;
+        CHECK(rcnb_decode_recover(damaged, code_length + 1, recovered, &options, &invalid) == 2 * GROUPS);
+        CHECK(memcmp(recovered, plaintext, 2 * GROUPS) == 0);
+        CHECK(invalid == 1);
+        CHECK(reported.count == 1 && reported.offset[0] == 4 * g && reported.length[0] == 1);
+    }
+    return 0;
+}
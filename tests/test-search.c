@@ -0,0 +1,144 @@
+/*
+test-search.c - searching rcnb code against a plain search of its plaintext
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/csearch.h>
+#include <rcnb/cencode.h>
+#include "check.h"
+
+#include <string.h>
+
+#define MAX_LENGTH 1001
+#define MAX_PATTERN 17
+
+static char plaintext[MAX_LENGTH];
+static wchar_t code[2 * MAX_LENGTH + 1];
+static char utf8[6 * MAX_LENGTH];
+static unsigned short utf16[2 * MAX_LENGTH];
+static size_t utf8_length;
+static size_t expected[MAX_LENGTH];
+static size_t found[MAX_LENGTH + 1];
+
+// The code points of an alphabet lie below U+8000, so three bytes of UTF-8 and one unit of UTF-16 are enough.
+static void store_text(const wchar_t* code_in, size_t length_in)
+{
+    utf8_length = 0;
+    for (size_t i = 0; i < length_in; ++i) {
+        unsigned long unit = (unsigned long)code_in[i];
+        if (unit < 0x80) {
+            utf8[utf8_length++] = (char)unit;
+        } else if (unit < 0x800) {
+            utf8[utf8_length++] = (char)(0xC0 | unit >> 6);
+            utf8[utf8_length++] = (char)(0x80 | (unit & 0x3F));
+        } else {
+            utf8[utf8_length++] = (char)(0xE0 | unit >> 12);
+            utf8[utf8_length++] = (char)(0x80 | (unit >> 6 & 0x3F));
+            utf8[utf8_length++] = (char)(0x80 | (unit & 0x3F));
+        }
+        utf16[i] = (unsigned short)unit;
+    }
+}
+
+static size_t naive_search(size_t length, const char* pattern, size_t pattern_length, size_t start)
+{
+    size_t count = 0;
+    for (size_t offset = start; offset + pattern_length <= length; ++offset)
+        if (memcmp(plaintext + offset, pattern, pattern_length) == 0)
+            expected[count++] = offset;
+    return count;
+}
+
+// Collects every match from start on, max_matches at a time, carrying on from the last one plus one.
+static size_t search_pages(const rcnb_searcher* searcher, size_t code_length, size_t start, size_t max_matches,
+        int form)
+{
+    size_t count = 0;
+    for (;;) {
+        size_t page;
+        if (form == 0)
+            page = rcnb_search(searcher, code, code_length, start, found + count, max_matches);
+        else if (form == 1)
+            page = rcnb_search_utf8(searcher, utf8, utf8_length, start, found + count, max_matches);
+        else
+            page = rcnb_search_utf16(searcher, utf16, code_length, start, found + count, max_matches);
+        CHECK(page <= max_matches);
+        count += page;
+        if (page < max_matches)
+            return count;
+        start = found[count - 1] + 1;
+    }
+}
+
+static void check_pattern(size_t length, size_t code_length, const char* pattern, size_t pattern_length,
+        const rcnb_alphabet* alphabet)
+{
+    rcnb_searcher searcher;
+    CHECK(rcnb_init_searcher(&searcher, pattern, pattern_length, alphabet));
+    static const size_t pages[] = { 1, 2, 3, 7, MAX_LENGTH };
+    const size_t starts[] = { 0, 1, 2, 3, length / 2, length / 2 + 1 };
+    for (size_t i = 0; i < sizeof(starts) / sizeof(starts[0]); ++i) {
+        size_t count = naive_search(length, pattern, pattern_length, starts[i]);
+        for (size_t j = 0; j < sizeof(pages) / sizeof(pages[0]); ++j) {
+            for (int form = 0; form < 3; ++form) {
+                CHECK(search_pages(&searcher, code_length, starts[i], pages[j], form) == count);
+                CHECK(memcmp(found, expected, count * sizeof(size_t)) == 0);
+            }
+        }
+    }
+    rcnb_free_searcher(&searcher);
+}
+
+static void check_alphabet(const rcnb_alphabet* alphabet)
+{
+    static const size_t lengths[] = { 1, 2, 3, 4, 5, 16, 33, 64, 65, 300, 1000, MAX_LENGTH };
+    static const size_t pattern_lengths[] = { 1, 2, 3, 4, 5, 6, 7, 8, 16, MAX_PATTERN };
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+        size_t length = lengths[i];
+        // three byte values, so short patterns match many times, overlapping and at both parities
+        static const char values[3] = { 0x00, 0x41, (char)0xFF };
+        for (size_t k = 0; k < length; ++k)
+            plaintext[k] = values[check_random() % 3];
+        size_t code_length = rcnb_encode_alphabet(plaintext, length, code, alphabet);
+        store_text(code, code_length);
+
+        for (size_t j = 0; j < sizeof(pattern_lengths) / sizeof(pattern_lengths[0]); ++j) {
+            size_t pattern_length = pattern_lengths[j];
+            char pattern[MAX_PATTERN];
+            // taken from the payload at an even and at an odd offset, and at its very end
+            if (pattern_length <= length) {
+                const size_t offsets[] = { 0, 1, length - pattern_length };
+                for (size_t k = 0; k < sizeof(offsets) / sizeof(offsets[0]); ++k) {
+                    if (offsets[k] + pattern_length > length)
+                        continue;
+                    memcpy(pattern, plaintext + offsets[k], pattern_length);
+                    check_pattern(length, code_length, pattern, pattern_length, alphabet);
+                }
+            }
+            // and one that is likely nowhere
+            check_fill(pattern, pattern_length);
+            check_pattern(length, code_length, pattern, pattern_length, alphabet);
+        }
+    }
+}
+
+int main(void)
+{
+    check_alphabet(NULL);
+
+    wchar_t r[RCNB_ALPHABET_R], c[RCNB_ALPHABET_C], n[RCNB_ALPHABET_N], b[RCNB_ALPHABET_B];
+    for (int i = 0; i < RCNB_ALPHABET_R; ++i)
+        r[i] = (wchar_t)(0x391 + i);
+    for (int i = 0; i < RCNB_ALPHABET_C; ++i)
+        c[i] = (wchar_t)(0x3B1 + i);
+    for (int i = 0; i < RCNB_ALPHABET_N; ++i)
+        n[i] = (wchar_t)(0x2010 + i);
+    for (int i = 0; i < RCNB_ALPHABET_B; ++i)
+        b[i] = (wchar_t)(0x61 + i);
+    rcnb_alphabet alphabet;
+    CHECK(rcnb_init_alphabet(&alphabet, r, c, n, b));
+    check_alphabet(&alphabet);
+    return 0;
+}
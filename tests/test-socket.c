@@ -0,0 +1,162 @@
+/*
+test-socket.c - loopback round trips through the socket adapter
+
+This is part of the librcnb project, and has been placed in the public domain.
+For details, see https://github.com/rikakomoe/librcnb
+*/
+
+#include <rcnb/csocket.h>
+#include "check.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Iterations of the polling loop after which a round trip counts as stuck.
+#define STUCK (1 << 24)
+
+static void connect_pair(int* fds_out, int buffer)
+{
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds_out) == 0);
+    for (int i = 0; i < 2; ++i) {
+        CHECK(fcntl(fds_out[i], F_SETFL, fcntl(fds_out[i], F_GETFL) | O_NONBLOCK) == 0);
+        if (buffer > 0) {
+            CHECK(setsockopt(fds_out[i], SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer)) == 0);
+            CHECK(setsockopt(fds_out[i], SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer)) == 0);
+        }
+    }
+}
+
+// Drives both ends from one thread. The receiver only reads every `lag` rounds, so with a small
+// socket buffer the sender runs into a full one and must report it as blocked.
+static void round_trip(size_t length, size_t batch, int buffer, size_t lag, bool expect_blocked)
+{
+    int fds[2];
+    connect_pair(fds, buffer);
+    rcnb_sockoptions options;
+    rcnb_init_sockoptions(&options);
+    options.chunk_size = 4096;
+    options.chunks = 4;
+    options.batch = batch;
+
+    char* plaintext = malloc(length + 1);
+    char* decoded = malloc(length + 1);
+    CHECK(plaintext && decoded);
+    check_fill(plaintext, length);
+
+    rcnb_socksender sender;
+    rcnb_sockreceiver receiver;
+    CHECK(rcnb_init_socksender(&sender, fds[0], &options));
+    CHECK(rcnb_init_sockreceiver(&receiver, fds[1], &options));
+    char* received = malloc(rcnb_sockreceiver_bound(&receiver));
+    CHECK(received);
+
+    size_t pushed = 0;
+    size_t decoded_length = 0;
+    bool blocked = false;
+    bool closed = false;
+    for (size_t round = 0; !receiver.eof; ++round) {
+        CHECK(round < STUCK);
+        pushed += rcnb_socksender_push(&sender, plaintext + pushed, length - pushed);
+        if (pushed == length && !sender.finished)
+            rcnb_socksender_finish(&sender);
+        CHECK(rcnb_socksender_flush(&sender, sender.finished) >= 0);
+        blocked = blocked || sender.blocked;
+        if (sender.finished && rcnb_socksender_pending(&sender) == 0 && !closed) {
+            CHECK(shutdown(fds[0], SHUT_WR) == 0);
+            closed = true;
+        }
+        if (round % lag != 0 && !closed)
+            continue;
+        ptrdiff_t plain_length = rcnb_sockreceiver_read(&receiver, received);
+        CHECK(plain_length >= 0);
+        CHECK(decoded_length + (size_t)plain_length <= length);
+        memcpy(decoded + decoded_length, received, (size_t)plain_length);
+        decoded_length += (size_t)plain_length;
+    }
+    ptrdiff_t plain_length = rcnb_sockreceiver_end(&receiver, received);
+    CHECK(plain_length >= 0);
+    CHECK(decoded_length + (size_t)plain_length == length);
+    memcpy(decoded + decoded_length, received, (size_t)plain_length);
+    CHECK(memcmp(decoded, plaintext, length) == 0);
+    CHECK(blocked || !expect_blocked);
+
+    rcnb_free_socksender(&sender);
+    rcnb_free_sockreceiver(&receiver);
+    close(fds[0]);
+    close(fds[1]);
+    free(received);
+    free(plaintext);
+    free(decoded);
+}
+
+typedef struct
+{
+    int source_fd;
+    int socket_fd;
+    int result;
+} encode_job;
+
+static void* encode_thread(void* job_in)
+{
+    encode_job* job = (encode_job*)job_in;
+    job->result = rcnb_epoll_encode(job->source_fd, job->socket_fd, NULL);
+    shutdown(job->socket_fd, SHUT_WR);
+    return NULL;
+}
+
+// The reference loops, from a file through the socket into another file.
+static void epoll_round_trip(size_t length)
+{
+    int fds[2];
+    connect_pair(fds, 4096);
+    char* plaintext = malloc(length + 1);
+    char* decoded = malloc(length + 1);
+    CHECK(plaintext && decoded);
+    check_fill(plaintext, length);
+    FILE* source = tmpfile();
+    FILE* sink = tmpfile();
+    CHECK(source && sink);
+    CHECK(fwrite(plaintext, 1, length, source) == length && fflush(source) == 0);
+    CHECK(lseek(fileno(source), 0, SEEK_SET) == 0);
+
+    encode_job job = { fileno(source), fds[0], -1 };
+    pthread_t encoder;
+    CHECK(pthread_create(&encoder, NULL, encode_thread, &job) == 0);
+    int result = rcnb_epoll_decode(fds[1], fileno(sink), NULL);
+    CHECK(pthread_join(encoder, NULL) == 0);
+    CHECK(job.result == 0);
+    CHECK(result == 0);
+
+    CHECK(lseek(fileno(sink), 0, SEEK_END) == (off_t)length);
+    CHECK(lseek(fileno(sink), 0, SEEK_SET) == 0);
+    CHECK(read(fileno(sink), decoded, length + 1) == (ssize_t)length);
+    CHECK(memcmp(decoded, plaintext, length) == 0);
+
+    fclose(source);
+    fclose(sink);
+    close(fds[0]);
+    close(fds[1]);
+    free(plaintext);
+    free(decoded);
+}
+
+int main(void)
+{
+    static const size_t lengths[] = { 0, 1, 2, 3, 31, 33, 4095, 4096, 4097, 65537, 1000001 };
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+        round_trip(lengths[i], 0, 0, 1, false);
+        round_trip(lengths[i], 1000, 0, 1, false);
+        // a send buffer far smaller than what the sender writes between two reads fills up
+        round_trip(lengths[i], 0, 4096, 64, lengths[i] > 100000);
+        round_trip(lengths[i], 5000, 4096, 64, lengths[i] > 100000);
+    }
+#ifdef __linux__
+    epoll_round_trip(0);
+    epoll_round_trip(1);
+    epoll_round_trip(1000001);
+#endif
+    return 0;
+}